@@ -0,0 +1,187 @@
+#include "AI.h"
+#include "Bench.h"
+#include "Fen.h"
+#include "Game.h"
+
+#include <benchmark/benchmark.h>
+
+// Microbenchmarks for the board and search hot paths
+//
+// Usage: chess_bench [--benchmark_filter=<regex>]
+//                    [--benchmark_out=<file.json> --benchmark_out_format=json]
+//
+// Every benchmark goes over the same positions as "chess bench" and counts
+// one item per call it makes, so items per second compare directly between
+// builds. Two JSON outputs can be compared with Google Benchmark's compare.py
+
+namespace {
+
+// Loaded once and shared, benchmarks that change a board put it back
+struct Positions {
+  std::vector<LumpedBoardAndGameState> states;
+  std::vector<std::unique_ptr<Board>> boards;
+
+  Positions() {
+    for (const auto &fen : getBenchPositions()) {
+      LumpedBoardAndGameState state;
+      if (!readFen(fen, state)) {
+        continue;
+      }
+      auto board = std::make_unique<Board>();
+      board->loadFromState(state);
+      states.push_back(state);
+      boards.push_back(std::move(board));
+    }
+  }
+};
+
+Positions &getPositions() {
+  static Positions positions;
+  return positions;
+}
+
+void BM_GetPieceAt(benchmark::State &state) {
+  auto &positions = getPositions();
+  for (auto _ : state) {
+    for (auto &board : positions.boards) {
+      for (int i = 0; i < k_totalSquares; ++i) {
+        benchmark::DoNotOptimize(board->getPieceAt({i % 8, i / 8}));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * positions.boards.size() *
+                          k_totalSquares);
+}
+BENCHMARK(BM_GetPieceAt);
+
+void BM_IsSquareAttacked(benchmark::State &state) {
+  auto &positions = getPositions();
+  for (auto _ : state) {
+    for (auto &board : positions.boards) {
+      for (int i = 0; i < k_totalSquares; ++i) {
+        benchmark::DoNotOptimize(
+            board->isSquareAttacked(Color::white, {i % 8, i / 8}));
+        benchmark::DoNotOptimize(
+            board->isSquareAttacked(Color::black, {i % 8, i / 8}));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * positions.boards.size() *
+                          k_totalSquares * 2);
+}
+BENCHMARK(BM_IsSquareAttacked);
+
+// Every legal move of the side to move, which leaves the board as it was
+void BM_IsValidMove(benchmark::State &state) {
+  auto &positions = getPositions();
+  size_t numMoves = 0;
+  for (auto _ : state) {
+    for (size_t i = 0; i < positions.boards.size(); ++i) {
+      auto &board = *positions.boards[i];
+      const Color color = positions.states[i].whoseTurn;
+      for (const auto &move : board.getValidMovesFor(color)) {
+        benchmark::DoNotOptimize(
+            board.isValidMove(color, move.start, move.end, true));
+        ++numMoves;
+      }
+    }
+  }
+  state.SetItemsProcessed(numMoves);
+}
+BENCHMARK(BM_IsValidMove);
+
+void BM_RefreshValidMoves(benchmark::State &state) {
+  auto &positions = getPositions();
+  for (auto _ : state) {
+    for (auto &board : positions.boards) {
+      board->refreshValidMoves();
+      benchmark::DoNotOptimize(board->getAllValidMoves().data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * positions.boards.size());
+}
+BENCHMARK(BM_RefreshValidMoves);
+
+// A make and unmake of every legal move, like the search does
+void BM_TestMoveUndoMove(benchmark::State &state) {
+  auto &positions = getPositions();
+  std::vector<std::vector<FullMove>> moves;
+  for (size_t i = 0; i < positions.boards.size(); ++i) {
+    moves.push_back(
+        positions.boards[i]->getValidMovesFor(positions.states[i].whoseTurn));
+  }
+
+  size_t numMoves = 0;
+  for (auto _ : state) {
+    for (size_t i = 0; i < positions.boards.size(); ++i) {
+      auto &board = *positions.boards[i];
+      for (const auto &move : moves[i]) {
+        board.testMove(move.start, move.end);
+        board.undoMove(move.start, move.end);
+      }
+      numMoves += moves[i].size();
+    }
+  }
+  state.SetItemsProcessed(numMoves);
+}
+BENCHMARK(BM_TestMoveUndoMove);
+
+void BM_GetBoardAndGameState(benchmark::State &state) {
+  auto &positions = getPositions();
+  for (auto _ : state) {
+    for (size_t i = 0; i < positions.boards.size(); ++i) {
+      benchmark::DoNotOptimize(&positions.boards[i]->getBoardAndGameState(
+          positions.states[i].whoseTurn));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * positions.boards.size());
+}
+BENCHMARK(BM_GetBoardAndGameState);
+
+void BM_GetAdvantage(benchmark::State &state) {
+  auto &positions = getPositions();
+  std::vector<std::unique_ptr<AI>> computers;
+  for (auto &board : positions.boards) {
+    computers.push_back(std::make_unique<AI>(*board));
+  }
+
+  for (auto _ : state) {
+    for (auto &computer : computers) {
+      benchmark::DoNotOptimize(computer->getAdvantage());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * computers.size());
+}
+BENCHMARK(BM_GetAdvantage);
+
+// Game::parseFenLine(), which is what parseFen() does for each line it reads
+void BM_ParseFen(benchmark::State &state) {
+  const auto &fens = getBenchPositions();
+  Game game;
+  for (auto _ : state) {
+    for (const auto &fen : fens) {
+      benchmark::DoNotOptimize(game.parseFenLine(fen));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * fens.size());
+}
+BENCHMARK(BM_ParseFen);
+
+// Board::toFen(), which all of the FEN writing goes through
+void BM_WriteFen(benchmark::State &state) {
+  auto &positions = getPositions();
+  char fen[k_maxFenLength];
+  for (auto _ : state) {
+    for (size_t i = 0; i < positions.boards.size(); ++i) {
+      benchmark::DoNotOptimize(positions.boards[i]->toFen(
+          positions.states[i].whoseTurn, positions.states[i].turnNum, fen,
+          sizeof(fen)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * positions.boards.size());
+}
+BENCHMARK(BM_WriteFen);
+
+} // namespace
+
+BENCHMARK_MAIN();
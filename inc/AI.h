@@ -3,6 +3,138 @@
 
 #include "Board.h"
 #include "Defs.h"
+#include "OpeningBook.h"
+#include "Tablebase.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+// Deepest an iterative deepening search will go
+constexpr int k_maxSearchDepth = 64;
+
+// Score of a forced mate, for whoever delivers it
+constexpr int k_checkmateScore = 9999;
+
+// What a search is allowed to spend, anything not set is unlimited
+struct SearchLimits {
+  int depth = k_maxSearchDepth;
+  std::optional<std::chrono::milliseconds> time = std::nullopt;
+  std::optional<size_t> nodes = std::nullopt;
+
+  // Set from another thread to end the search early, one that's already set
+  // ends it straight away
+  const std::atomic<bool> *stop = nullptr;
+
+  // Root moves reported in SearchInfo::lines, best first
+  size_t multiPv = 1;
+
+  // Set while searching on the opponent's time. The time limit only starts
+  // counting once it's cleared (a ponder hit), so the search carries on as
+  // the real one without starting over
+  const std::atomic<bool> *ponder = nullptr;
+};
+
+// A root move with its exact score and the line expected to follow it
+struct SearchLine {
+  std::pair<Position, Position> move;
+  int score;
+
+  // Principal variation, starting with move
+  std::vector<std::pair<Position, Position>> pv;
+};
+
+// Counters from a search, for tuning pruning and move ordering
+struct SearchStats {
+  size_t nodes = 0;
+
+  // Positions scored by the evaluation. There's no quiescence search, so
+  // these are all at the horizon
+  size_t leafNodes = 0;
+
+  // The tablebase is the only table the search looks positions up in
+  size_t tablebaseHits = 0;
+
+  // Quiet moves skipped near the leaves for giving material away
+  size_t prunedMoves = 0;
+
+  // Nodes that cut off, and the ones that did so on their first move
+  size_t cutoffs = 0;
+  size_t firstMoveCutoffs = 0;
+
+  // Deepest completed depth, and the furthest from the root any line went
+  int depth = 0;
+  int selDepth = 0;
+
+  std::chrono::milliseconds elapsed = {};
+
+  // Nodes at each ply of the last completed depth's tree, the root being
+  // ply 0
+  std::vector<size_t> nodesPerPly = {};
+
+  inline size_t getNodesPerSecond() const {
+    return nodes * 1000 / std::max<long long>(elapsed.count(), 1);
+  }
+
+  // 1 when the first move searched is always the one that cuts off, lower
+  // as move ordering gets worse
+  inline double getFirstMoveCutoffRate() const {
+    return cutoffs ? static_cast<double>(firstMoveCutoffs) / cutoffs : 0;
+  }
+
+  // Nodes at ply + 1 for every node at ply
+  inline double getBranchingFactor(size_t ply) const {
+    if (ply + 1 >= nodesPerPly.size() || nodesPerPly[ply] == 0) {
+      return 0;
+    }
+    return static_cast<double>(nodesPerPly[ply + 1]) / nodesPerPly[ply];
+  }
+};
+
+// Reported after every completed depth of a search
+struct SearchInfo {
+  int depth;
+  int score;
+  std::pair<Position, Position> bestMove;
+
+  // What the opponent is expected to play after bestMove, if known
+  std::optional<std::pair<Position, Position>> reply;
+
+  size_t nodes;
+  std::chrono::milliseconds elapsed;
+
+  // The best SearchLimits::multiPv root moves, the first being bestMove
+  std::vector<SearchLine> lines;
+
+  // As of the end of this depth
+  SearchStats stats;
+};
+
+using SearchCallback = std::function<void(const SearchInfo &)>;
+
+// Moves to the forced mate a line scored at depth has, negative if it's the
+// computer getting mated. At most, since a shallower mate may not have been
+// searched for
+inline std::optional<int> getMateMoves(int score, int depth) {
+  if (std::abs(score) < k_checkmateScore) {
+    return std::nullopt;
+  }
+  const int moves = (depth + 1) / 2;
+  return (score > 0) ? moves : -moves;
+}
+
+// Moves to the forced mate info found. Iterative deepening stops at the first
+// depth with a mate, so that's the shortest one
+inline std::optional<int> getMateMoves(const SearchInfo &info) {
+  return getMateMoves(info.score, info.depth);
+}
+
+// Time to search a move for with remaining on the clock and increment added
+// after every move, movesToGo being the moves left until the next time
+// control or 0 if there isn't one
+std::chrono::milliseconds getMoveTime(std::chrono::milliseconds remaining,
+                                      std::chrono::milliseconds increment,
+                                      int movesToGo);
 
 // Class that represents a computer player that a user can play against
 class AI {
@@ -15,9 +147,32 @@ public:
   int getAdvantage();
   std::pair<Position, Position> getRandomMove();
 
+  // Every random choice, book moves and getRandomMove() alike, comes from one
+  // generator, so a fixed seed makes games repeatable
+  inline void setSeed(uint32_t seed) { m_generator.seed(seed); }
+
   inline std::optional<Color> getColor() { return m_color; }
   inline void setColor(Color color) { m_color = color; }
 
+  // Positions the tablebase covers are scored exactly instead of searched
+  inline void setTablebase(const Tablebase *tablebase) {
+    m_tablebase = tablebase;
+  }
+
+  // Book moves are played instead of searching for the first maxDepth moves
+  // of the game, picked at random by weight unless bestMoveOnly is set
+  inline void setOpeningBook(const OpeningBook *book, size_t maxDepth,
+                             bool bestMoveOnly) {
+    m_book = book;
+    m_maxBookDepth = maxDepth;
+    m_bestBookMoveOnly = bestMoveOnly;
+  }
+
+  // A legal move from the book for color, ply being the number of half-moves
+  // played so far. Valid moves have to be up to date
+  std::optional<std::pair<Position, Position>> getBookMove(Color color,
+                                                           size_t ply);
+
   inline void setDifficulty(int increment) {
     // Min is indisputably 1, 0 causes a softlock
     // Max could be higher, but a depth of 5 is very slow (1 min or more)
@@ -34,13 +189,128 @@ public:
   std::pair<Position, Position> minimaxRoot(Color max);
   int minimax(Color max, int depth, int alpha, int beta);
 
+  // Iterative deepening for max, which has to be the computer's color, until
+  // the limits run out or a forced mate turns up. callback gets every
+  // completed depth. Returns the best move of the deepest completed depth, or
+  // nullopt if max has no moves
+  std::optional<std::pair<Position, Position>>
+  search(Color max, const SearchLimits &limits,
+         const SearchCallback &callback = nullptr);
+
+  // Positions visited by the last search
+  inline size_t getNodes() const {
+    return m_nodes.load(std::memory_order_relaxed);
+  }
+
+  // Counters for the running search, or the last one if there isn't one.
+  // Safe to call from any thread
+  SearchStats getStats() const;
+
+  // The reply expected to the best move of the last search, for pondering
+  // on. Not known for book moves or searches only one ply deep
+  inline std::optional<std::pair<Position, Position>> getPonderMove() const {
+    return m_ponderMove;
+  }
+
+  // Every root move of the last completed depth, best first. The root is
+  // always searched with a full window, so they all have exact scores
+  inline const std::vector<SearchLine> &getLines() const { return m_lines; }
+
+  inline int getDifficulty() const { return m_difficulty; }
+
 private:
+  // One depth of minimaxRoot, score is set to the best move's and reply to
+  // the opponent's best answer to it. Every root move's line, with its whole
+  // principal variation, is left in m_rootLines
+  std::pair<Position, Position>
+  searchRoot(Color max, int depth, int &score,
+             std::optional<std::pair<Position, Position>> &reply);
+
+  // Sorts the lines of the last searchRoot() into m_lines
+  void storeLines();
+
+  bool isOverLimits();
+
+  // Makes move followed by the principal variation found one ply further down
+  // the one at ply
+  void updatePv(int ply, const FullMove &move);
+
+  void resetStats();
+
+  // Keeps the nodes per ply of the depth just finished for getStats()
+  void storeNodesPerPly();
+
+  bool isCapture(const FullMove &move);
+
+  // Orders captures by static exchange evaluation so winning captures are
+  // searched first and losing ones last
+  void orderMoves(std::vector<FullMove> &moves);
+
+  // True for quiet moves near the leaves that just give material away
+  bool isLosingQuietMove(const FullMove &move, int depth, bool inCheck);
+
   Board &m_board;
 
   // Default color is black if no flag is passed
   std::optional<Color> m_color = Color::black;
 
   int m_difficulty = 3;
+
+  // Not owned, may be null
+  const Tablebase *m_tablebase = nullptr;
+
+  // Not owned, may be null
+  const OpeningBook *m_book = nullptr;
+  size_t m_maxBookDepth = 0;
+  bool m_bestBookMoveOnly = false;
+
+  // For picking book and random moves
+  std::mt19937 m_generator = std::mt19937(std::random_device()());
+
+  // Search bookkeeping. Counters are only written by the search, but can be
+  // read from other threads while it runs
+  std::atomic<size_t> m_nodes = 0;
+  std::atomic<size_t> m_leafNodes = 0;
+  std::atomic<size_t> m_tablebaseHits = 0;
+  std::atomic<size_t> m_prunedMoves = 0;
+  std::atomic<size_t> m_cutoffs = 0;
+  std::atomic<size_t> m_firstMoveCutoffs = 0;
+  std::atomic<int> m_completedDepth = 0;
+  std::atomic<int> m_selDepth = 0;
+
+  // For the depth being searched, and the last one that finished
+  std::array<std::atomic<size_t>, k_maxSearchDepth + 1> m_nodesPerPly = {};
+  std::array<std::atomic<size_t>, k_maxSearchDepth + 1> m_completedNodesPerPly =
+      {};
+
+  // Steady clock ticks, the end being 0 while a search is running
+  std::atomic<int64_t> m_statsStart = 0;
+  std::atomic<int64_t> m_statsEnd = 0;
+
+  bool m_stopped = false;
+  std::chrono::steady_clock::time_point m_searchStart = {};
+  SearchLimits m_limits = {};
+
+  // When the time limit started counting, which is later than m_searchStart
+  // for a ponder hit
+  std::chrono::steady_clock::time_point m_clockStart = {};
+  bool m_isPondering = false;
+
+  // Depth the current searchRoot() started at
+  int m_rootDepth = 0;
+
+  // Triangular principal variation table. The best line found from the node
+  // at ply is m_pv[ply][ply] up to m_pv[ply][m_pvLength[ply] - 1]
+  std::array<std::array<std::pair<Position, Position>, k_maxSearchDepth + 1>,
+             k_maxSearchDepth + 1>
+      m_pv = {};
+  std::array<int, k_maxSearchDepth + 1> m_pvLength = {};
+
+  std::optional<std::pair<Position, Position>> m_ponderMove = std::nullopt;
+
+  // In the order searchRoot() went through them, and sorted
+  std::vector<SearchLine> m_rootLines = {};
+  std::vector<SearchLine> m_lines = {};
 };
 
 #endif // AI_H
\ No newline at end of file
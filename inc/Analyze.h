@@ -0,0 +1,64 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include "AI.h"
+
+// Batch analysis of position files, for running without a window
+//
+// Usage: chess analyze --in <positions.fen> [--out <results.jsonl>]
+//                      [--depth <n>] [--movetime <ms>] [--nodes <n>]
+//                      [--multipv <k>] [--jobs <n>]
+//
+// Every FEN or EPD line of --in is searched by one of --jobs independent
+// searches and written to --out as a line of JSON with the best move, score,
+// pv and node count, plus the best k moves with theirs for --multipv. Lines
+// are written as they finish, so they're tagged with the line number they
+// came from rather than kept in order. Jobs don't share anything, so with
+// --nodes or --depth alone every line comes out the same on every run
+
+// One of the best moves of a multipv search
+struct AnalysisLine {
+  std::string move = "";
+  std::string san = "";
+
+  // UCI, starting with move
+  std::vector<std::string> pv = {};
+
+  int score = 0;
+  std::optional<int> mateMoves = std::nullopt;
+};
+
+struct AnalysisResult {
+  // UCI and SAN, both empty if there's no move to play
+  std::string bestMove = "";
+  std::string san = "";
+
+  // Principal variation in UCI, starting with bestMove
+  std::vector<std::string> pv = {};
+
+  // From the point of view of the side to move
+  int score = 0;
+  std::optional<int> mateMoves = std::nullopt;
+
+  int depth = 0;
+  size_t nodes = 0;
+  std::chrono::milliseconds time = {};
+
+  // Best first, only filled in when limits.multiPv is more than 1
+  std::vector<AnalysisLine> lines = {};
+};
+
+// Searches state on board with computer, which is reused between positions
+// so every job only sets up once
+AnalysisResult analyzePosition(Board &board, AI &computer,
+                               const LumpedBoardAndGameState &state,
+                               const SearchLimits &limits);
+
+// Appends result for the position on line as a line of JSON
+void writeAnalysis(size_t line, const LumpedBoardAndGameState &state,
+                   const AnalysisResult &result, std::string &out);
+
+// Entry point for "chess analyze", argv[0] being "analyze"
+int runAnalyze(int argc, char **argv);
+
+#endif // ANALYZE_H
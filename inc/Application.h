@@ -25,6 +25,10 @@ public:
 
   int run();
 
+  // p50, p99 and max of each latency so far, also printed on exit and by
+  // pressing l
+  void printLatencies() const;
+
 private:
   // Pointer to Window class
   std::unique_ptr<Window> m_window = nullptr;
@@ -36,6 +40,12 @@ private:
   bool m_legacyMode = false;
 
   bool m_saveGames = false;
+
+  // Each run() iteration, from polling events to being ready for the next
+  LatencyHistogram m_frameLatency;
+
+  // From a click or key press to the next frame presented after it
+  LatencyHistogram m_inputLatency;
 };
 
 #endif // APPLICATION_H
@@ -0,0 +1,34 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "AI.h"
+
+// Fixed benchmark for comparing builds
+//
+// Usage: chess bench [--depth <n>] [--nodes <n>] [--threads <n>]
+//
+// Searches a built-in set of positions to a fixed depth, or node count, and
+// prints the nodes each one took and their total. Nothing in it depends on
+// the clock or a random seed, so the total is a signature of the search: a
+// change that alters it changed what gets searched, and one that doesn't only
+// changed the speed. Positions are shared out between --threads independent
+// searches, which doesn't change the total either
+
+struct BenchResult {
+  // UCI, empty if there's no move to play
+  std::string bestMove = "";
+  size_t nodes = 0;
+};
+
+// FENs of the positions searched, also used by the microbenchmarks
+const std::vector<std::string> &getBenchPositions();
+
+// Searches every bench position with limits, which mustn't have a time, on
+// numThreads threads. Results are in the same order as the positions
+std::vector<BenchResult> runBenchSearches(const SearchLimits &limits,
+                                          int numThreads);
+
+// Entry point for "chess bench", argv[0] being "bench"
+int runBench(int argc, char **argv);
+
+#endif // BENCH_H
@@ -1,45 +1,62 @@
 #ifndef BOARD_H
 #define BOARD_H
 
-#include <SDL2/SDL.h>
-#include <SDL2/SDL_image.h>
-
 #include "Macros.h"
 #include "Pieces.h"
 
 // Class to define the board state and manage updates to it
-// Responsible for checking move validity, handling special behavior like
-// check, promotion, etc., and rendering the board and pieces on the window
+// Responsible for checking move validity and handling special behavior like
+// check, promotion, etc. Drawing it is left to BoardRenderer, so nothing in
+// here needs SDL
 // TODO: This class became way too big. Needs to be refactored into 3 or more
 // classes
 class Board {
 public:
-  Board() = default;
-
-  ~Board();
+  // First dimension of 2D vector is for each color
+  using Pieces = std::vector<std::vector<std::unique_ptr<Piece>>>;
 
-  inline void setRenderer(SDL_Renderer *renderer) {
-    RETURN_IF_NULL(renderer);
-    m_renderer = renderer;
-  }
+  Board() = default;
 
-  void loadTextures();
+  // Copies reuse the pieces already in place wherever they match, so cloning
+  // into the same board over and over doesn't allocate
+  Board(const Board &other);
+  Board &operator=(const Board &other);
+  Board(Board &&other) = default;
+  Board &operator=(Board &&other) = default;
 
   void loadGame();
 
   void loadFromState(const LumpedBoardAndGameState &state);
 
-  void cliDisplay(Color color);
+  // Much cheaper than loadFromState(), nothing needs parsing or sorting and
+  // pieces already in place are reused. Valid moves aren't generated, call
+  // refreshValidMoves() if they're needed before the next move is applied
+  void loadFromCompactState(const CompactBoardState &state);
 
-  void sdlDisplay(Color color);
+  void cliDisplay(Color color);
 
   Piece *getPieceAt(const Position &position);
 
+  inline const Pieces &getPieces() const { return m_pieces; }
+
+  const Piece *getKingFromColor(Color color) const;
+
+  // Where color's last move ended up, if it has moved yet
+  inline std::optional<Position> getLastMove(Color color) const {
+    return m_lastMoves[static_cast<size_t>(color)];
+  }
+
+  // Pieces currently on the board, kings included
+  int getPieceCount() const;
+
   bool isValidMove(Color color, const Position &start, const Position &end,
                    const bool forMoveStorage);
 
   bool isKingInCheck(Color color);
 
+  // True if any of the other side's pieces attack position
+  bool isSquareAttacked(Color color, const Position &position);
+
   bool canKingGetOutOfCheck(Color color, const Position &start,
                             const Position &end);
 
@@ -55,24 +72,17 @@ public:
   // For SDL game
   bool promotePawn(const Position &positionToPromoteTo);
 
-  void sdlDisplayPromotionOptions(Color color) const;
-
   void movePiece(const Position &start, const Position &end);
 
   void updateBoardState(const Position &start, const Position &end);
 
-  bool isInputValid(Color color, const std::queue<Position> &positions);
-
-  void highlightPotentialMoves(const Position &position);
-
-  void highlightKingInCheck(Color color);
+  // Plays a move the same way the game does, promoting to promotion (queen if
+  // none) and refreshing the valid moves afterwards. Returns false if the
+  // move isn't legal. The fifty-move count is left to hasStalemateOccurred()
+  bool applyMove(Color color, const Position &start, const Position &end,
+                 PieceType promotion = PieceType::queen);
 
-  inline void clearOldPieceHighlight() {
-    m_movesToHighlight.clear();
-    m_pieceToHighlight.reset();
-  }
-
-  inline void clearOldKingHighlight() { m_kingToHighlight.reset(); }
+  bool isInputValid(Color color, const std::queue<Position> &positions);
 
   inline const std::vector<FullMove> &getAllValidMoves() const {
     return m_allValidMoves;
@@ -85,10 +95,24 @@ public:
   const LumpedBoardAndGameState &
   getBoardAndGameState(Color color, size_t halfMoveNum = 0, size_t turnNum = 1);
 
+  // Everything loadFromCompactState() needs to get back to this position.
+  // Pieces captured during search are left out
+  CompactBoardState getCompactState(Color color, size_t turnNum = 1) const;
+
+  // Writes the position as FEN into buffer without allocating, returns the
+  // length or 0 if it didn't fit. k_maxFenLength is always enough
+  size_t toFen(Color whoseTurn, size_t moveNumber, char *buffer,
+               size_t size) const;
+
   void testMove(const Position &start, const Position &end, int depth = 10);
 
   void undoMove(const Position &start, const Position &end, int depth = 10);
 
+  // Static exchange evaluation: the material the side moving from start
+  // expects to win (or lose, if negative) once every capture on end has been
+  // played out, in centipawns. Works for quiet moves too
+  int see(const Position &start, const Position &end);
+
   inline CastleStatus getCastleStatus() const { return m_castleStatus; }
 
   inline void setComputerPlaying(const bool isPlaying) {
@@ -98,10 +122,6 @@ public:
   inline size_t getFiftyMoveRuleCount() const { return m_fiftyMoveRuleCount; }
 
 private:
-  void sdlDrawSquare(const Position &position, const SDL_Color &sdlColor) const;
-
-  void sdlDrawPiece(Color color, const Piece *piece, int verticalOffset) const;
-
   std::pair<size_t, size_t> getIndexOfPiece(const Piece *piece);
 
   void capturePiece(const Position &position);
@@ -112,24 +132,13 @@ private:
 
   bool isPieceBlockingRook(const Position &start, const Position &end);
 
-  bool isSquareAttacked(Color color, const Position &position);
-
   bool moveAndCheckForCheck(Color color, const Position &start,
                             const Position &end);
 
   void setKingCastleStatus(Color color, CastleSide side);
 
-  const Piece *getKingFromColor(Color color) const;
-
   bool checkForDeadPosition() const;
 
-  SDL_Renderer *m_renderer = NULL;
-
-  // Holds texture of image with all piece sprites
-  SDL_Texture *m_pieceImageTexture = NULL;
-
-  // First dimension of 2D vector is for each color
-  using Pieces = std::vector<std::vector<std::unique_ptr<Piece>>>;
   // Container for every piece
   Pieces m_pieces = {};
 
@@ -138,20 +147,8 @@ private:
   // Container for all possible moves on the board
   std::vector<FullMove> m_allValidMoves = {};
 
-  // Squares to highlight as valid moves
-  std::vector<Position> m_movesToHighlight = {};
-
-  // Piece square to highlight if clicked
-  std::optional<Position> m_pieceToHighlight = std::nullopt;
-
-  // Black's last move to highlight
-  std::optional<Position> m_blackLastMoveHighlight = std::nullopt;
-
-  // White's last move to highlight
-  std::optional<Position> m_whiteLastMoveHighlight = std::nullopt;
-
-  // King square to highlight if in check
-  std::optional<Position> m_kingToHighlight = std::nullopt;
+  // Each side's last move, indexed like Color
+  std::array<std::optional<Position>, 2> m_lastMoves = {};
 
   // Both sides' castling availability
   CastleStatus m_castleStatus = CastleStatus().set();
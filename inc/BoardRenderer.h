@@ -0,0 +1,78 @@
+#ifndef BOARD_RENDERER_H
+#define BOARD_RENDERER_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "Board.h"
+
+// Class to draw a board and its pieces on the window
+// Owns the piece sprites and what's highlighted, none of which the rules care
+// about, so this is the only part of the board that needs SDL
+class BoardRenderer {
+public:
+  explicit BoardRenderer(const Board &board) : m_board(board) {}
+
+  ~BoardRenderer();
+
+  // Disallow copy and assign
+  BoardRenderer(const BoardRenderer &) = delete;
+  void operator=(const BoardRenderer &) = delete;
+
+  inline void setRenderer(SDL_Renderer *renderer) {
+    RETURN_IF_NULL(renderer);
+    m_renderer = renderer;
+  }
+
+  void loadTextures();
+
+  // Draws the board from color's side
+  void display(Color color);
+
+  void displayPromotionOptions(Color color) const;
+
+  void highlightPotentialMoves(const Position &position);
+
+  void highlightKingInCheck(Color color);
+
+  inline void clearOldPieceHighlight() {
+    m_movesToHighlight.clear();
+    m_pieceToHighlight.reset();
+  }
+
+  inline void clearOldKingHighlight() { m_kingToHighlight.reset(); }
+
+  // Best moves from an analysis search, best first
+  inline void
+  setAnalysisMoves(const std::vector<std::pair<Position, Position>> &moves) {
+    m_analysisMovesToHighlight = moves;
+  }
+
+  inline void clearAnalysisMoves() { m_analysisMovesToHighlight.clear(); }
+
+private:
+  void drawSquare(const Position &position, const SDL_Color &sdlColor) const;
+
+  void drawPiece(Color color, const Piece *piece, int verticalOffset) const;
+
+  const Board &m_board;
+
+  SDL_Renderer *m_renderer = NULL;
+
+  // Holds texture of image with all piece sprites
+  SDL_Texture *m_pieceImageTexture = NULL;
+
+  // Squares to highlight as valid moves
+  std::vector<Position> m_movesToHighlight = {};
+
+  // Piece square to highlight if clicked
+  std::optional<Position> m_pieceToHighlight = std::nullopt;
+
+  // King square to highlight if in check
+  std::optional<Position> m_kingToHighlight = std::nullopt;
+
+  // Start and end squares to highlight, fading with each line
+  std::vector<std::pair<Position, Position>> m_analysisMovesToHighlight = {};
+};
+
+#endif // BOARD_RENDERER_H
@@ -0,0 +1,25 @@
+#ifndef COMMAND_LINE_H
+#define COMMAND_LINE_H
+
+#include "Defs.h"
+
+// Reading options off the command line, shared by the game, its subcommands
+// and the tools. Options are matched anywhere in argv, and the ones that take
+// a value expect it as the next argument
+
+bool argumentPassed(char **start, char **end, const std::string &toFind);
+
+// The argument after toFind, if both are there
+std::optional<std::string> getArgumentValue(char **start, char **end,
+                                            const std::string &toFind);
+
+// value as a whole number, if that's all it is
+std::optional<long long> parseNumber(const std::string &value);
+
+// Every argument that isn't an option or the value of one of valueOptions,
+// in order
+std::vector<std::string>
+getInputFilenames(int argc, char **argv,
+                  const std::vector<std::string> &valueOptions);
+
+#endif // COMMAND_LINE_H
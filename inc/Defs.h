@@ -5,6 +5,7 @@
 #include <array>
 #include <bitset>
 #include <cctype>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <optional>
@@ -12,6 +13,7 @@
 #include <regex>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -19,9 +21,6 @@
 // Enables debug logging
 static bool k_verbose = false;
 
-// Increments after every application run() call
-static long k_counter = 0;
-
 // SDL window default dimensions
 constexpr int k_windowWidth = 800;
 constexpr int k_windowHeight = 800;
@@ -96,6 +95,34 @@ struct LumpedBoardAndGameState {
   }
 };
 
+// For squares in CompactBoardState that aren't set
+constexpr int8_t k_noCompactSquare = -1;
+
+// The same state in one flat, trivially copyable block, so keeping lots of
+// games around or handing a copy to another thread is just a memcpy. Squares
+// are indexed rank * 8 + file and hold FEN letters, or 0 when empty. Also
+// keeps what the board needs between moves that FEN has no room for
+struct CompactBoardState {
+  std::array<char, k_totalSquares> squares = {};
+  // Same order as LumpedBoardAndGameState
+  uint8_t castleStatus = 0xf;
+  // The square behind a pawn that just moved two, whose color follows from
+  // the rank it's on
+  int8_t enPassantSquare = k_noCompactSquare;
+  // Pawn waiting to be promoted
+  int8_t pawnToPromote = k_noCompactSquare;
+  // Where each side's last move ended up, indexed like Color
+  std::array<int8_t, 2> lastMoves = {k_noCompactSquare, k_noCompactSquare};
+
+  Color whoseTurn = Color::white;
+  // Both are clamped to what fits
+  uint16_t halfMoveNum = 0;
+  uint16_t turnNum = 1;
+};
+
+static_assert(std::is_trivially_copyable_v<CompactBoardState>);
+static_assert(sizeof(CompactBoardState) <= 80);
+
 // A full move in this case contains all possible information about a
 // potential move: the color, piece type, and starting and ending positions
 // This is particularly useful for the computer player
@@ -0,0 +1,151 @@
+#ifndef ENGINE_SERVER_H
+#define ENGINE_SERVER_H
+
+#include "AI.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Engine server behind chessd, serving any number of games over a Unix domain
+// socket from one epoll loop, with searches run by a fixed pool of threads
+//
+// Requests and responses are lines of JSON, and a numeric "id" on a request
+// is echoed back in its response:
+//   {"op":"new"[,"fen":<fen>][,"seed":<n>]}   -> {"game":<n>,"fen":<fen>}
+//   {"op":"move","game":<n>,"move":"e2e4"}    -> {"game":<n>,"fen":<fen>,
+//                                                 "status":<status>}
+//   {"op":"search","game":<n>[,"depth":<n>][,"movetime":<ms>][,"nodes":<n>]}
+//       -> {"game":<n>,"bestmove":<uci>,"score":<cp>,"mate":<moves>,
+//           "depth":<n>,"nodes":<n>,"time":<ms>}
+//   {"op":"cancel","game":<n>}                -> {"game":<n>}
+//   {"op":"end","game":<n>}                   -> {"game":<n>}
+// Status is one of "playing", "checkmate" or "stalemate". Book moves are
+// picked at random unless the game has a seed. A search answers
+// once it's done, so other requests get answered in the meantime. Cancelling
+// ends it early with the best move so far. Anything that fails comes back as
+// {"error":<reason>}. Games belong to the connection that made them and end
+// when it closes
+class EngineServer {
+public:
+  explicit EngineServer(size_t numWorkers);
+  ~EngineServer();
+
+  // Disallow copy and assign
+  EngineServer(const EngineServer &) = delete;
+  void operator=(const EngineServer &) = delete;
+
+  // Shared by every game, not owned, may be null. Set before run()
+  inline void setTablebase(const Tablebase *tablebase) {
+    m_tablebase = tablebase;
+  }
+
+  inline void setOpeningBook(const OpeningBook *book, size_t maxDepth) {
+    m_book = book;
+    m_maxBookDepth = maxDepth;
+  }
+
+  // Binds to socketPath, replacing whatever socket was left there
+  bool listen(const std::string &socketPath);
+
+  // Serves clients until stop()
+  int run();
+
+  // Makes run() return. Safe to call from other threads and signal handlers
+  void stop();
+
+  inline size_t getGameCount() const { return m_games.size(); }
+
+private:
+  struct Client {
+    int fd = -1;
+    std::string input = "";
+    std::string output = "";
+
+    // True while waiting to be able to write the rest of output
+    bool isWriting = false;
+
+    std::vector<uint64_t> games = {};
+  };
+
+  struct Game {
+    uint64_t client = 0;
+
+    // Only this is kept between requests, boards are loaded from it as needed
+    CompactBoardState position = {};
+
+    // Half-moves since the start of the game, for the book depth
+    size_t ply = 0;
+
+    // Book moves for the same game and seed are always the same
+    std::optional<uint32_t> seed = std::nullopt;
+
+    // Set and cleared under m_mutex. No moves get played while it's set
+    bool isSearching = false;
+    std::atomic<bool> stop = false;
+  };
+
+  struct SearchJob {
+    std::shared_ptr<Game> game;
+    uint64_t gameId;
+
+    // Copied, so the search never touches the game itself
+    CompactBoardState position;
+
+    // Start of the response, with the request's id if it had one
+    std::string response;
+    SearchLimits limits;
+  };
+
+  void acceptClients();
+
+  // False if the client got closed
+  bool readClient(uint64_t clientId);
+  void flushClient(uint64_t clientId);
+  void closeClient(uint64_t clientId);
+
+  // Response to one request line, empty if it comes later from a search
+  std::string handleRequest(uint64_t clientId, std::string_view line);
+
+  void endGame(uint64_t gameId);
+
+  // Hands results from the workers to their clients
+  void deliverResults();
+
+  // Worker thread body
+  void work();
+  std::string search(SearchJob &job, Board &board);
+
+  int m_listenFd = -1;
+  int m_epollFd = -1;
+
+  // Wakes the loop for stop() and finished searches
+  int m_wakeFd = -1;
+
+  std::string m_socketPath = "";
+  std::atomic<bool> m_stopRequested = false;
+
+  const Tablebase *m_tablebase = nullptr;
+  const OpeningBook *m_book = nullptr;
+  size_t m_maxBookDepth = 0;
+
+  // Only touched by the loop
+  std::unordered_map<uint64_t, Client> m_clients;
+  uint64_t m_nextClientId;
+  std::unordered_map<uint64_t, std::shared_ptr<Game>> m_games;
+  uint64_t m_nextGameId = 1;
+
+  // For playing moves on, loaded from the game each time
+  Board m_board;
+
+  // Shared with the workers
+  std::mutex m_mutex;
+  std::condition_variable m_jobCondition;
+  std::deque<SearchJob> m_jobs;
+  std::vector<std::pair<uint64_t, std::string>> m_results;
+  bool m_isShuttingDown = false;
+
+  std::vector<std::thread> m_workers;
+};
+
+#endif // ENGINE_SERVER_H
@@ -0,0 +1,51 @@
+#ifndef EPD_TEST_H
+#define EPD_TEST_H
+
+#include "AI.h"
+
+#include <string_view>
+
+// Test suite runner for EPD files, e.g. Win At Chess
+//
+// Usage: chess epdtest <suite.epd> [--time <ms>] [--depth <n>] [--nodes <n>]
+//                       [--threads <n>]
+//
+// Every position with a bm (best move) or am (avoid move) operation is
+// searched for --time ms (or up to --nodes nodes if given instead), several
+// at once, and counts as solved if the computer ends up on one of the best
+// moves and none of the avoided ones. Time to solution is when the search
+// settled on a right move for good
+
+// One test position
+// The operands point into the line it was read from
+struct EpdPosition {
+  LumpedBoardAndGameState state;
+  std::string_view id = {};
+  std::vector<std::string_view> bestMoves = {};
+  std::vector<std::string_view> avoidMoves = {};
+};
+
+// Parses an EPD record and its id, bm and am operations, other operations are
+// skipped. Returns false if the position is malformed
+bool readEpd(std::string_view line, EpdPosition &position);
+
+struct EpdResult {
+  // False if the position has no moves to check against, or ones that
+  // aren't legal there
+  bool isValid = false;
+  bool solved = false;
+
+  // SAN, empty if there was no move to play
+  std::string move = "";
+
+  std::optional<std::chrono::milliseconds> timeToSolution = std::nullopt;
+  size_t nodes = 0;
+  int depth = 0;
+};
+
+EpdResult solveEpd(const EpdPosition &position, const SearchLimits &limits);
+
+// Entry point for "chess epdtest", argv[0] being "epdtest"
+int runEpdTest(int argc, char **argv);
+
+#endif // EPD_TEST_H
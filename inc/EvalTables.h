@@ -0,0 +1,104 @@
+#ifndef EVALTABLES_H
+#define EVALTABLES_H
+
+#include "Defs.h"
+
+// Piece values and piece-square tables used by AI::getAdvantage
+// Tables are laid out from white's point of view, with row 0 being white's
+// back rank, and are flipped vertically for black
+// tools/TuneEval.cpp can regenerate this file from a labelled corpus
+
+constexpr int k_pawnValue = 100;
+constexpr int k_knightValue = 300;
+constexpr int k_bishopValue = 300;
+constexpr int k_rookValue = 500;
+constexpr int k_queenValue = 900;
+constexpr int k_kingValue = 9000;
+
+// clang-format off
+
+// Credits to https://www.chessprogramming.org/Simplified_Evaluation_Function
+using EvalTable = int[k_totalSquares / 8][k_totalSquares / 8];
+// Made last row 90 as that made more sense to me (guaranteed queen)
+constexpr EvalTable k_pawnEvalTable = {
+    {0,  0,  0,   0,   0,   0,   0,  0},
+    {5,  10, 10,  -20, -20, 10,  10, 5},
+    {5,  -5, -10, 0,   0,  -10, -5,  5},
+    {0,  0,  0,   20,   20,  0,  0,  0},
+    {5,  5,  10,  25,  25,  10,  5,  5},
+    {10, 10, 20,  30,  30,  20,  10, 10},
+    {50, 50, 50,  50,  50,  50,  50, 50},
+    {90, 90, 90,  90,  90,  90,  90, 90}
+};
+
+constexpr EvalTable k_knightEvalTable = {
+    {-50, -40, -30, -30, -30, -30, -40, -50},
+    {-40, -20, 0,   5,   5,   0,   -20, -40},
+    {-30, 5,   10,  15,  15,  10,  5,   -30},
+    {-30, 0,   15,  20,  20,  15,  0,   -30},
+    {-30, 5,   15,  20,  20,  15,  5,   -30},
+    {-30, 0,   10,  15,  15,  10,  0,   -30},
+    {-40, -20, 0,   0,   0,   0,   -20, -40},
+    {-50, -40, -30, -30, -30, -30, -40, -50}
+};
+
+constexpr EvalTable k_bishopEvalTable = {
+    {-20, -10, -10, -10, -10, -10, -10, -20},
+    {-10, 5,   0,   0,   0,   0,   5,   -10},
+    {-10, 10,  10,  10,  10,  10,  10,  -10},
+    {-10, 0,   10,  10,  10,  10,  0,   -10},
+    {-10, 5,   5,   10,  10,  5,   5,   -10},
+    {-10, 0,   5,   10,  10,  5,   0,   -10},
+    {-10, 0,   0,   0,   0,   0,   0,   -10},
+    {-20, -10, -10, -10, -10, -10, -10, -20}
+};
+
+constexpr EvalTable k_rookEvalTable = {
+    {0,  0,  0,  5,  5,  0,  0,  0},
+    {-5, 0,  0,  0,  0,  0,  0,  -5},
+    {-5, 0,  0,  0,  0,  0,  0,  -5},
+    {-5, 0,  0,  0,  0,  0,  0,  -5},
+    {-5, 0,  0,  0,  0,  0,  0,  -5},
+    {-5, 0,  0,  0,  0,  0,  0,  -5},
+    {5,  10, 10, 10, 10, 10, 10, 5},
+    {0,  0,  0,  0,  0,  0,  0,  0}
+};
+
+// Changed this one a bit from the original
+// to make it more symmetrical
+constexpr EvalTable k_queenEvalTable = {
+    {-20, -10, -10, -5, -5, -10, -10, -20},
+    {-10, 0,   0,   0,  0,  0,   0,   -10},
+    {-10, 0,   5,   5,  5,  5,   0,   -10},
+    {-5,  0,   5,   5,  5,  5,   0,   -5},
+    {-5,  0,   5,   5,  5,  5,   0,   -5},
+    {-10, 0,   5,   5,  5,  5,   0,   -10},
+    {-10, 0,   0,   0,  0,  0,   0,   -10},
+    {-20, -10, -10, -5, -5, -10, -10, -20}
+};
+
+constexpr EvalTable k_kingOpeningEvalTable = {
+    {20,  30,  10,  0,   0,   10,  30,  20},
+    {20,  20,  0,   0,   0,   0,   20,  20},
+    {-10, -20, -20, -20, -20, -20, -20, -10},
+    {-20, -30, -30, -40, -40, -30, -30, -20},
+    {-30, -40, -40, -50, -50, -40, -40, -30},
+    {-30, -40, -40, -50, -50, -40, -40, -30},
+    {-30, -40, -40, -50, -50, -40, -40, -30},
+    {-30, -40, -40, -50, -50, -40, -40, -30}
+};
+
+constexpr EvalTable k_kingEndgameEvalTable = {
+    {-50, -40, -30, -20, -20, -30,  -40, -50},
+    {-30, -20, -10, 0,   0,   -10,  -20, -30},
+    {-30, -10, 20,  30,  30,   20,  -10, -30},
+    {-30, -10, 30,  40,  40,   30,  -10, -30},
+    {-30, -10, 30,  40,  40,   30,  -10, -30},
+    {-30, -10, 20,  30,  30,   20,  -10, -30},
+    {-30, -30, 0,   0,   0,    0,   -30, -30},
+    {-50, -30, -30, -30, -30,  -30, -30, -50}
+};
+
+// clang-format on
+
+#endif // EVALTABLES_H
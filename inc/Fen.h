@@ -0,0 +1,77 @@
+#ifndef FEN_H
+#define FEN_H
+
+#include "Defs.h"
+
+#include <string_view>
+
+// Parses a FEN record, or the first four fields of an EPD record, into state.
+// Anything after the move counters (EPD operations, result labels, etc.) is
+// ignored, as are counters that aren't plain numbers. The containers in state
+// are cleared rather than reallocated, so reusing one state across many calls
+// doesn't allocate. Returns false if the record is malformed
+bool readFen(std::string_view fen, LumpedBoardAndGameState &state);
+
+// Longest FEN writeFen can produce, null terminator included
+constexpr size_t k_maxFenLength = 128;
+
+// Piece letters as they appear in FEN, indexed by rank * 8 + file, with 0 for
+// empty squares
+using FenBoard = std::array<char, k_totalSquares>;
+
+// Writes a null-terminated FEN into buffer without allocating. Returns its
+// length, or 0 if it didn't fit
+size_t writeFen(const FenBoard &board, Color whoseTurn,
+                const CastleStatus &castleStatus,
+                const EnPassantStatus &enPassantStatus, size_t halfMoveClock,
+                size_t moveNumber, char *buffer, size_t size);
+
+size_t writeFen(const LumpedBoardAndGameState &state, char *buffer,
+                size_t size);
+
+// Class for reading FEN and EPD files, one position per line
+// The file is memory-mapped and the start of every line indexed up front, so
+// any line can be fetched without reading the ones before it
+class FenFile {
+public:
+  FenFile() = default;
+  ~FenFile();
+
+  // Disallow copy and assign
+  FenFile(const FenFile &) = delete;
+  void operator=(const FenFile &) = delete;
+
+  bool open(const std::string &filename);
+  void close();
+
+  inline bool isOpen() const { return m_isOpen; }
+
+  // True if the file has been written to or resized since it was opened,
+  // e.g. by the recorder appending to it, or can't be found anymore
+  bool hasChanged() const;
+
+  // Number of lines, blank ones included
+  inline size_t size() const { return m_lineStarts.size(); }
+
+  // Line without its line ending, empty if index is out of range. Points into
+  // the mapping, so it's only valid until the file is closed
+  std::string_view getLine(size_t index) const;
+
+  inline bool getPosition(size_t index, LumpedBoardAndGameState &state) const {
+    return index < size() && readFen(getLine(index), state);
+  }
+
+private:
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  bool m_isOpen = false;
+
+  // To tell if it's changed since
+  std::string m_filename = "";
+  int64_t m_modifiedTime = 0;
+
+  // Offset of the first character of each line
+  std::vector<size_t> m_lineStarts = {};
+};
+
+#endif // FEN_H
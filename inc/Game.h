@@ -2,6 +2,9 @@
 #define GAME_H
 
 #include "Defs.h"
+#include "Fen.h"
+
+#include <string_view>
 
 // Class to define the game state
 // Handles turns and game completion, and is
@@ -11,6 +14,10 @@ public:
   Game() {}
   ~Game() {}
 
+  // Disallow copy and assign
+  Game(const Game &) = delete;
+  void operator=(const Game &) = delete;
+
   void reset();
 
   inline bool isInProgress() const { return m_inProgress; }
@@ -60,11 +67,13 @@ public:
 
   void outputKingInCheck() const;
 
+  // The file is kept open and indexed until a different one is asked for or
+  // it changes on disk, so fetching more lines from it costs no more than
+  // parsing them
   LumpedBoardAndGameState parseFen(const std::string filename,
                                    const int lineNumber);
 
-  void writeToFen(const std::string filename,
-                  const LumpedBoardAndGameState &boardAndGameState);
+  LumpedBoardAndGameState parseFenLine(std::string_view line);
 
   inline void setTurn(Color color) {
     if (color == Color::black) {
@@ -75,15 +84,6 @@ public:
   }
 
 private:
-  struct PiecesForFenStorage {
-    Color color;
-    PieceType type;
-    Position position;
-
-    PiecesForFenStorage(Color color, PieceType type, Position position)
-        : color(color), type(type), position(position) {}
-  };
-
   // True if there is a game in progress
   bool m_inProgress = true;
 
@@ -105,6 +105,10 @@ private:
 
   // Turn number
   size_t m_turnNum = 1;
+
+  // Last file parseFen() opened, empty if none is
+  FenFile m_fenFile;
+  std::string m_fenFilename = "";
 };
 
 #endif // GAME_H
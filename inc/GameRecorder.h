@@ -0,0 +1,43 @@
+#ifndef GAME_RECORDER_H
+#define GAME_RECORDER_H
+
+#include "Board.h"
+
+#include <cstdio>
+
+// Class that appends one FEN line per move to a game record file
+// Records are formatted straight into an in-memory buffer, and the file only
+// gets written when the buffer fills up or on flush(), i.e. at the end of a
+// game, on reset and on exit, instead of being opened and closed every move
+class GameRecorder {
+public:
+  GameRecorder() { m_buffer.resize(k_bufferSize); }
+  ~GameRecorder() { close(); }
+
+  // Disallow copy and assign
+  GameRecorder(const GameRecorder &) = delete;
+  void operator=(const GameRecorder &) = delete;
+
+  // Closes the current file, if any, and starts appending to filename
+  bool open(const std::string &filename);
+  void close();
+
+  inline bool isOpen() const { return m_file != nullptr; }
+
+  inline const std::string &getFilename() const { return m_filename; }
+
+  void record(const Board &board, Color whoseTurn, size_t moveNumber);
+
+  void flush();
+
+private:
+  static constexpr size_t k_bufferSize = 64 * 1024;
+
+  std::FILE *m_file = nullptr;
+  std::string m_filename = "";
+
+  std::vector<char> m_buffer = {};
+  size_t m_bufferUsed = 0;
+};
+
+#endif // GAME_RECORDER_H
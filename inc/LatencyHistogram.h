@@ -0,0 +1,45 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Histogram of latencies with HDR style buckets, for the tail percentiles
+//
+// Each power of two is split into k_subBuckets linear buckets, so any value
+// from a nanosecond up to centuries lands in a bucket within about 3% of it,
+// and recording one is a few shifts and an increment. Percentiles are
+// reported as the top of the bucket they fall in, never more than the max
+class LatencyHistogram {
+public:
+  void record(std::chrono::nanoseconds latency);
+
+  void reset();
+
+  inline uint64_t getCount() const { return m_count; }
+  inline std::chrono::nanoseconds getMax() const {
+    return std::chrono::nanoseconds(m_max);
+  }
+
+  // percentile from 0 to 100, 0 if nothing has been recorded
+  std::chrono::nanoseconds getPercentile(double percentile) const;
+
+  // One line with the count, p50, p99 and max in ms
+  void print(const std::string &name) const;
+
+private:
+  static constexpr int k_subBucketBits = 5;
+  static constexpr int64_t k_subBuckets = int64_t(1) << k_subBucketBits;
+  static constexpr size_t k_numBuckets = (64 - k_subBucketBits) * k_subBuckets;
+
+  static size_t getBucket(int64_t value);
+  static int64_t getBucketTop(size_t bucket);
+
+  std::array<uint64_t, k_numBuckets> m_buckets = {};
+  uint64_t m_count = 0;
+  int64_t m_max = 0;
+};
+
+#endif // LATENCY_HISTOGRAM_H
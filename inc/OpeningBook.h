@@ -0,0 +1,73 @@
+#ifndef OPENING_BOOK_H
+#define OPENING_BOOK_H
+
+#include "Zobrist.h"
+
+#include <random>
+
+// A single Polyglot book entry, as stored on disk (big-endian, 16 bytes)
+struct BookEntry {
+  uint64_t key;
+  uint16_t move;
+  uint16_t weight;
+  uint32_t learn;
+};
+
+// A book move in board terms. Castling is stored by Polyglot as the king
+// taking its own rook, but is converted to the usual two-square king move
+struct BookMove {
+  Position start;
+  Position end;
+  PieceType promotion;
+  uint16_t weight;
+};
+
+uint16_t encodeBookMove(const FullMove &move,
+                        PieceType promotion = PieceType::none);
+
+// state is the position the move is played from, needed to spot castling
+BookMove decodeBookMove(uint16_t move, uint16_t weight,
+                        const LumpedBoardAndGameState &state);
+
+// Sorts entries by key and writes them out as a Polyglot .bin book
+bool writeOpeningBook(const std::string &filename,
+                      std::vector<BookEntry> &entries);
+
+// Class for probing Polyglot .bin opening books
+// The book is memory-mapped and binary-searched by key, so it costs nothing
+// to load and books of any size can be used. See Zobrist.h about the keys
+class OpeningBook {
+public:
+  OpeningBook() = default;
+  ~OpeningBook() { close(); }
+
+  // Disallow copy and assign
+  OpeningBook(const OpeningBook &) = delete;
+  void operator=(const OpeningBook &) = delete;
+
+  bool open(const std::string &filename);
+  void close();
+
+  inline bool isOpen() const { return m_data != nullptr; }
+
+  // Number of entries
+  inline size_t size() const { return m_size / sizeof(BookEntry); }
+
+  // Every move stored for state, most popular first
+  void getMoves(const LumpedBoardAndGameState &state,
+                std::vector<BookMove> &moves) const;
+
+  // Picks one of the moves for state with probability proportional to its
+  // weight, or the heaviest one if bestMoveOnly is set
+  std::optional<BookMove> pickMove(const LumpedBoardAndGameState &state,
+                                   bool bestMoveOnly,
+                                   std::mt19937 &generator) const;
+
+private:
+  BookEntry getEntry(size_t index) const;
+
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+};
+
+#endif // OPENING_BOOK_H
@@ -0,0 +1,145 @@
+#ifndef PACKED_POSITION_H
+#define PACKED_POSITION_H
+
+#include "Defs.h"
+
+#include <cstdio>
+
+// Compact binary formats for storing large numbers of positions and games,
+// e.g. for training data. Positions take 32 bytes instead of a ~60 byte FEN
+// line, games take 2 bytes per move, and neither needs any parsing. Files are
+// written in the machine's byte order, little-endian on everything we run on
+
+enum class PackedResult : uint8_t { unknown, whiteWin, draw, blackWin };
+
+// For positions without a score
+constexpr int16_t k_noPackedScore = INT16_MIN;
+
+// For positions without an en passant square
+constexpr uint8_t k_noPackedEnPassant = 0xff;
+
+// A position in 32 bytes. occupancy has a bit set for every occupied square
+// (rank * 8 + file), and pieces holds one nibble per set bit, in the same
+// order: the piece type, plus 8 for black pieces
+struct PackedPosition {
+  uint64_t occupancy = 0;
+  std::array<uint8_t, k_totalPieces / 2> pieces = {};
+  // Bit 0 is set when black is to move, bits 1-4 hold the castle status
+  uint8_t flags = 0;
+  // File of the en passant square, the rank follows from whose turn it is
+  uint8_t enPassantFile = k_noPackedEnPassant;
+  // Both counters are clamped to what fits
+  uint8_t halfMoveClock = 0;
+  PackedResult result = PackedResult::unknown;
+  uint16_t moveNumber = 1;
+  // Centipawns from white's point of view
+  int16_t score = k_noPackedScore;
+};
+
+static_assert(sizeof(PackedPosition) == 32);
+
+// Returns false if there are more than 32 pieces or any are off the board
+bool packPosition(const LumpedBoardAndGameState &state, PackedPosition &packed);
+
+// Like readFen(), the containers in state are cleared rather than reallocated
+void unpackPosition(const PackedPosition &packed,
+                    LumpedBoardAndGameState &state);
+
+// A move in 16 bits: start square, end square and promotion piece type
+using PackedMove = uint16_t;
+
+PackedMove packMove(const Position &start, const Position &end,
+                    PieceType promotion = PieceType::none);
+
+void unpackMove(PackedMove move, Position &start, Position &end,
+                PieceType &promotion);
+
+// A game stored as its moves. Each one only makes sense applied to the
+// position the ones before it led to
+struct PackedGame {
+  // Left empty for games from the usual starting position
+  std::optional<PackedPosition> start = std::nullopt;
+  std::vector<PackedMove> moves = {};
+  PackedResult result = PackedResult::unknown;
+
+  void clear();
+};
+
+// Games can't be longer than this
+constexpr size_t k_maxPackedGameMoves = UINT16_MAX;
+
+enum class PackedFileType : uint32_t { positions = 1, games = 2 };
+
+// Class for writing positions or games to a packed file
+// Records are collected in a buffer and written out in large blocks. Opening
+// an existing file of the same type appends to it
+class PackedWriter {
+public:
+  PackedWriter() { m_buffer.reserve(k_bufferSize); }
+  ~PackedWriter() { close(); }
+
+  // Disallow copy and assign
+  PackedWriter(const PackedWriter &) = delete;
+  void operator=(const PackedWriter &) = delete;
+
+  bool open(const std::string &filename, PackedFileType type);
+  void close();
+
+  inline bool isOpen() const { return m_file != nullptr; }
+
+  // Each returns false if the record doesn't match the file type
+  bool write(const PackedPosition &position);
+  bool write(const PackedGame &game);
+
+  void flush();
+
+private:
+  static constexpr size_t k_bufferSize = 1 << 20;
+
+  void append(const void *data, size_t size);
+
+  std::FILE *m_file = nullptr;
+  std::string m_filename = "";
+  PackedFileType m_type = PackedFileType::positions;
+
+  std::vector<char> m_buffer = {};
+};
+
+// Class for reading packed files
+// The file is memory-mapped, so positions can be fetched by index straight
+// out of it and games streamed through without reading the whole file
+class PackedReader {
+public:
+  PackedReader() = default;
+  ~PackedReader() { close(); }
+
+  // Disallow copy and assign
+  PackedReader(const PackedReader &) = delete;
+  void operator=(const PackedReader &) = delete;
+
+  bool open(const std::string &filename);
+  void close();
+
+  inline bool isOpen() const { return m_data != nullptr; }
+
+  inline PackedFileType getType() const { return m_type; }
+
+  // Number of positions, 0 for a games file
+  size_t size() const;
+
+  bool getPosition(size_t index, PackedPosition &position) const;
+
+  // Reads the next game, returns false once there are none left
+  bool nextGame(PackedGame &game);
+
+  // Back to the first game
+  void rewind();
+
+private:
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  size_t m_offset = 0;
+  PackedFileType m_type = PackedFileType::positions;
+};
+
+#endif // PACKED_POSITION_H
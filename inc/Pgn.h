@@ -0,0 +1,94 @@
+#ifndef PGN_H
+#define PGN_H
+
+#include "Board.h"
+
+#include <string_view>
+
+// SAN for move, which has to be one of board's valid moves, before it is
+// played. Disambiguation comes from the other valid moves, so they have to be
+// up to date. There's no check suffix as that needs the move to be played
+std::string toSan(Board &board, const FullMove &move,
+                  PieceType promotion = PieceType::queen);
+
+// Plays move on board and returns its SAN with the check or mate suffix, or an
+// empty string if the move isn't legal
+std::string playSanMove(Board &board, const FullMove &move,
+                        PieceType promotion = PieceType::queen);
+
+// Finds the valid move for color that san describes. Check suffixes and
+// annotations (!, ?) are ignored, and long algebraic like e2-e4 is accepted.
+// promotion is set to the promoted piece, or none
+std::optional<FullMove> fromSan(Board &board, Color color, std::string_view san,
+                                PieceType &promotion);
+
+struct PgnTag {
+  std::string_view name;
+  std::string_view value;
+};
+
+// One game from a PGN database
+// Everything points into the reader's mapping (or whatever the writer's caller
+// owns), so reusing one game across many nextGame() calls doesn't allocate
+struct PgnGame {
+  std::vector<PgnTag> tags = {};
+
+  // SAN as written, annotations included
+  std::vector<std::string_view> moves = {};
+
+  std::string_view result = "*";
+
+  // Empty if the tag isn't there. Escapes in the value aren't undone
+  std::string_view getTag(std::string_view name) const;
+
+  void clear();
+};
+
+// Appends game to out as export format PGN: the Seven Tag Roster first (with
+// the usual placeholders for missing ones), then any other tags, then the
+// movetext wrapped at 80 columns
+void writePgn(const PgnGame &game, std::string &out);
+
+// Class for streaming games out of a PGN database
+// The file is memory-mapped and tokenised in a single pass, so databases of
+// any size can be read without holding more than the current game. Comments,
+// variations, NAGs and escaped lines are skipped
+class PgnReader {
+public:
+  PgnReader() = default;
+  ~PgnReader();
+
+  // Disallow copy and assign
+  PgnReader(const PgnReader &) = delete;
+  void operator=(const PgnReader &) = delete;
+
+  bool open(const std::string &filename);
+  void close();
+
+  inline bool isOpen() const { return m_isOpen; }
+
+  // Reads the next game into game, returns false once there are none left.
+  // The views are only valid until the reader is closed
+  bool nextGame(PgnGame &game);
+
+  // Where the last game read starts in the file
+  inline size_t getGameOffset() const { return m_gameOffset; }
+
+  // Continues reading from offset, e.g. one from getGameOffset()
+  bool seek(size_t offset);
+
+private:
+  void skipWhitespace();
+  void skipLine();
+  void skipPast(char letter);
+
+  bool readTag(PgnGame &game);
+
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  size_t m_offset = 0;
+  size_t m_gameOffset = 0;
+  bool m_isOpen = false;
+};
+
+#endif // PGN_H
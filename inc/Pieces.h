@@ -37,10 +37,46 @@ public:
 
   inline char getLetter() const { return m_letter; }
 
+  inline PieceType getType() const {
+    switch (std::tolower(m_letter)) {
+    case 'p':
+      return PieceType::pawn;
+    case 'n':
+      return PieceType::knight;
+    case 'b':
+      return PieceType::bishop;
+    case 'r':
+      return PieceType::rook;
+    case 'q':
+      return PieceType::queen;
+    case 'k':
+      return PieceType::king;
+    default:
+      return PieceType::none;
+    }
+  }
+
   inline bool hasMoved() const { return m_hasMoved; }
 
   inline void setHasMoved(const bool hasMoved) { m_hasMoved = hasMoved; }
 
+  // Back to how a new piece standing on position would be
+  inline void reset(const Position &position) {
+    m_position = position;
+    m_startingPosition = position;
+    m_validMoves.clear();
+    m_hasMoved = false;
+  }
+
+  // Takes on everything from other, which must have the same letter
+  inline void copyState(const Piece &other) {
+    m_position = other.m_position;
+    m_startingPosition = other.m_startingPosition;
+    m_validMoves = other.m_validMoves;
+    m_color = other.m_color;
+    m_hasMoved = other.m_hasMoved;
+  }
+
 protected:
   // Where the piece is
   Position m_position;
@@ -0,0 +1,113 @@
+#ifndef POSITION_DATABASE_H
+#define POSITION_DATABASE_H
+
+#include "Pgn.h"
+#include "Zobrist.h"
+
+// Index from positions to the PGN games that reached them
+//
+// The index file holds one 16-byte record per position per game, sorted by
+// Zobrist key, so lookups are a binary search over the memory-mapped file.
+// Each record points at the game's offset in its PGN file and the ply the
+// position came up at, which is also the index of the move played next
+
+// Where a position came up in a game
+struct PositionMatch {
+  size_t fileIndex;
+  uint64_t offset;
+  size_t ply;
+};
+
+// Class for building an index out of PGN files in bounded memory
+// Records are collected until the memory limit is reached, then sorted and
+// written out as a run next to the output file. finish() merges the runs into
+// the index, so only one buffer per run is held at a time
+class PositionDatabaseBuilder {
+public:
+  // Positions past maxPly into a game aren't indexed
+  PositionDatabaseBuilder(const std::string &filename, size_t memoryLimit,
+                          size_t maxPly);
+  ~PositionDatabaseBuilder();
+
+  // Disallow copy and assign
+  PositionDatabaseBuilder(const PositionDatabaseBuilder &) = delete;
+  void operator=(const PositionDatabaseBuilder &) = delete;
+
+  bool addPgnFile(const std::string &filename);
+
+  // Writes the index and removes the runs
+  bool finish();
+
+  inline size_t getNumGames() const { return m_numGames; }
+  inline size_t getNumPositions() const { return m_numPositions; }
+
+private:
+  struct Record {
+    uint64_t key;
+    uint64_t location;
+  };
+
+  bool writeRun();
+  void removeRuns();
+
+  std::string m_filename;
+  size_t m_maxRecords;
+  size_t m_maxPly;
+
+  std::vector<std::string> m_gameFilenames = {};
+  std::vector<std::string> m_runFilenames = {};
+  std::vector<Record> m_records = {};
+
+  size_t m_numGames = 0;
+  size_t m_numPositions = 0;
+};
+
+// Class for querying an index made by PositionDatabaseBuilder
+class PositionDatabase {
+public:
+  PositionDatabase() = default;
+  ~PositionDatabase() { close(); }
+
+  // Disallow copy and assign
+  PositionDatabase(const PositionDatabase &) = delete;
+  void operator=(const PositionDatabase &) = delete;
+
+  // The PGN files are opened as well, from the absolute paths they were
+  // indexed with
+  bool open(const std::string &filename);
+  void close();
+
+  inline bool isOpen() const { return m_data != nullptr; }
+
+  // Number of indexed positions
+  size_t size() const;
+
+  // Appends up to maxMatches games that reached state, first indexed first.
+  // Each game is listed once, at the first ply it reached the position
+  void findGames(const LumpedBoardAndGameState &state,
+                 std::vector<PositionMatch> &matches,
+                 size_t maxMatches = SIZE_MAX) const;
+
+  // Reads the game a match points at. The views in game are valid until the
+  // database is closed
+  bool getGame(const PositionMatch &match, PgnGame &game);
+
+  // Sets board to the position a match points at by replaying its game up to
+  // the match's ply, and whoseTurn to the side to move there
+  bool getPosition(const PositionMatch &match, Board &board, Color &whoseTurn);
+
+  inline const std::string &getFilename(size_t fileIndex) const {
+    return m_gameFilenames[fileIndex];
+  }
+
+private:
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  const char *m_records = nullptr;
+  size_t m_numRecords = 0;
+
+  std::vector<std::string> m_gameFilenames = {};
+  std::vector<std::unique_ptr<PgnReader>> m_readers = {};
+};
+
+#endif // POSITION_DATABASE_H
@@ -0,0 +1,107 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include "Defs.h"
+
+// Endgame tablebases for every material signature with up to four pieces,
+// kings included. Each table stores one byte per position holding the
+// win/draw/loss result and distance to mate in plies, from the point of view
+// of the side to move. All tables live in a single file that is memory-mapped
+// on load, see tools/GenTablebase.cpp for the generator
+//
+// Castling and en passant rights are ignored, which only matters for a
+// handful of positions that can't come up in a real four-piece endgame
+
+constexpr int k_maxTablebasePieces = 4;
+
+// Encoding of a single table entry
+constexpr uint8_t k_tablebaseDraw = 0;
+// Wins are stored as the distance to mate, 1 to 127
+constexpr uint8_t k_tablebaseMaxWin = 127;
+// Losses are stored as this plus the distance to mate, 0 meaning checkmated
+constexpr uint8_t k_tablebaseLossBase = 128;
+// Only used while generating, unresolved entries end up as draws
+constexpr uint8_t k_tablebaseUnknown = 254;
+constexpr uint8_t k_tablebaseIllegal = 255;
+
+enum class TablebaseOutcome { loss, draw, win };
+
+struct TablebaseResult {
+  TablebaseOutcome outcome;
+  // In plies
+  int distanceToMate;
+};
+
+// A piece as the tablebase sees it, square being rank * 8 + file
+struct TablebasePiece {
+  PieceType type;
+  Color color;
+  int square;
+};
+
+using TablebaseSquares = std::array<int, k_maxTablebasePieces>;
+
+// Shape of a single table, e.g. KQvKR. The stronger side is always stored as
+// white, so the pieces are white's king, white's other pieces, black's king
+// and black's other pieces, in that order
+struct TablebaseTable {
+  std::string name;
+  std::vector<std::pair<PieceType, Color>> pieces;
+  bool hasPawns = false;
+
+  size_t size() const;
+
+  // Symmetric positions share an index, so this also canonicalizes squares
+  size_t getIndex(const TablebaseSquares &squares, Color toMove) const;
+
+  void getSquares(size_t index, TablebaseSquares &squares,
+                  Color &toMove) const;
+};
+
+// Class that owns a memory-mapped tablebase file and answers probes
+class Tablebase {
+public:
+  Tablebase() = default;
+  ~Tablebase();
+
+  // Disallow copy and assign
+  Tablebase(const Tablebase &) = delete;
+  void operator=(const Tablebase &) = delete;
+
+  bool load(const std::string &filename);
+
+  inline bool isLoaded() const { return m_data != nullptr; }
+
+  std::optional<TablebaseResult>
+  probe(const LumpedBoardAndGameState &state) const;
+
+  std::optional<TablebaseResult>
+  probe(const std::vector<TablebasePiece> &pieces, Color toMove) const;
+
+  // Every table with up to maxPieces pieces, ordered so that each table only
+  // depends on tables earlier in the list
+  static std::vector<TablebaseTable> getAllTables(int maxPieces);
+
+  // Finds the table covering the given material and the index of the
+  // position within it. Returns false for a bare king ending or material the
+  // tablebase doesn't cover
+  static bool locate(const std::vector<TablebasePiece> &pieces, Color toMove,
+                     std::string &tableName, size_t &index);
+
+  static TablebaseResult decode(uint8_t value);
+
+  // Writes a complete tablebase file
+  static bool write(const std::string &filename,
+                    const std::vector<TablebaseTable> &tables,
+                    const std::vector<std::vector<uint8_t>> &data);
+
+private:
+  const uint8_t *m_data = nullptr;
+  size_t m_size = 0;
+
+  // Table name to start of its entries and how many there are
+  std::unordered_map<std::string, std::pair<const uint8_t *, size_t>>
+      m_tables = {};
+};
+
+#endif // TABLEBASE_H
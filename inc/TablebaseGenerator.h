@@ -0,0 +1,35 @@
+#ifndef TABLEBASE_GENERATOR_H
+#define TABLEBASE_GENERATOR_H
+
+#include "Tablebase.h"
+
+// Builds tablebases by retrograde analysis. Positions are resolved one ply at
+// a time: every predecessor of a lost position is won, and a predecessor of a
+// won position is lost once all of its moves lead to won positions. Captures
+// and promotions are scored from the smaller tables, so those have to be
+// generated first (getAllTables() already orders them that way)
+class TablebaseGenerator {
+public:
+  TablebaseGenerator(int numThreads) : m_numThreads(std::max(numThreads, 1)) {}
+  ~TablebaseGenerator() {}
+
+  // Returns one entry per index of the table
+  std::vector<uint8_t> generate(const TablebaseTable &table);
+
+  // Generates every table up to maxPieces and writes them to a single file
+  bool generateAll(int maxPieces, const std::string &filename);
+
+private:
+  // Value of the position after a capture or promotion, from the point of view
+  // of the side to move in it
+  uint8_t probeConversion(const TablebaseTable &table,
+                          const TablebaseSquares &squares, int movedPiece,
+                          PieceType promotion, Color toMove) const;
+
+  int m_numThreads = 1;
+
+  // Finished tables, by name
+  std::unordered_map<std::string, std::vector<uint8_t>> m_generated = {};
+};
+
+#endif // TABLEBASE_GENERATOR_H
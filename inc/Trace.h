@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+
+// Optional tracing of where the time goes, in Chrome's trace event format
+//
+// Only built in with cmake -DCHESS_TRACE=ON. Otherwise TRACE_SCOPE() expands
+// to nothing and writeTrace() does nothing, so it costs nothing at all. When
+// it is built in, every TRACE_SCOPE() records a span from where it is to the
+// end of its scope into its thread's own ring buffer, without locking. Once a
+// buffer fills up, its oldest spans get overwritten. writeTrace() dumps every
+// thread's spans as JSON that chrome://tracing or Perfetto can open
+
+#ifdef CHESS_TRACE
+
+#include <chrono>
+#include <cstdint>
+
+// Nanoseconds on the steady clock
+inline int64_t getTraceTime() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// name has to outlive the trace, string literals are what it's meant for
+void recordTraceSpan(const char *name, int64_t start, int64_t end);
+
+// Records a span over its own lifetime
+class TraceScope {
+public:
+  explicit TraceScope(const char *name)
+      : m_name(name), m_start(getTraceTime()) {}
+  ~TraceScope() { recordTraceSpan(m_name, m_start, getTraceTime()); }
+
+  // Disallow copy and assign
+  TraceScope(const TraceScope &) = delete;
+  void operator=(const TraceScope &) = delete;
+
+private:
+  const char *m_name;
+  int64_t m_start;
+};
+
+// Writes every span recorded so far. Safe to call while other threads are
+// still recording: their newest spans may be left out, and so may any of their
+// oldest that get overwritten while they're being copied, but none come out
+// torn
+bool writeTrace(const std::string &filename);
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#else
+
+#define TRACE_SCOPE(name)
+
+inline bool writeTrace(const std::string &) { return false; }
+
+#endif // CHESS_TRACE
+
+#endif // TRACE_H
@@ -0,0 +1,99 @@
+#ifndef UCI_H
+#define UCI_H
+
+#include "AI.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+
+// Long algebraic for a move on board, e.g. e2e4 or e7e8q. Castling is the
+// king's move, and pawns are always promoted to queens like the computer does
+std::string toUciMove(Board &board, const std::pair<Position, Position> &move);
+
+// Every move of a principal variation from the position on board, which is
+// stepped through it the way the search does and put back afterwards
+std::vector<std::string>
+toUciPv(Board &board, const std::vector<std::pair<Position, Position>> &pv);
+
+// Plays a long algebraic move for color on board with applyMove(), promoting
+// to whatever piece its fifth letter names. False if it isn't legal
+bool playUciMove(Board &board, Color color, std::string_view move);
+
+// Class for running the engine over UCI, as started by "chess --uci"
+// Commands are handled on the calling thread while searches run on their own,
+// so stop and isready get answered mid-search. No window is ever opened
+class UciEngine {
+public:
+  explicit UciEngine(std::ostream &output = std::cout);
+  ~UciEngine();
+
+  // Disallow copy and assign
+  UciEngine(const UciEngine &) = delete;
+  void operator=(const UciEngine &) = delete;
+
+  // Handles commands until quit or the end of input
+  int run(std::istream &input = std::cin);
+
+  // Returns false for quit
+  bool handleCommand(const std::string &line);
+
+  // Lets the running search, if any, finish on its own. go infinite and go
+  // ponder never do, so those get stopped
+  void waitForSearch();
+
+private:
+  void sendId();
+  void setPosition(std::istringstream &tokens);
+  void setOption(std::istringstream &tokens);
+  void startSearch(std::istringstream &tokens);
+
+  // The opponent played the move being pondered on, so the search carries on
+  // under the limits go ponder came with
+  void ponderHit();
+
+  // Stops the running search, if any, once it has sent its best move
+  void stopSearch();
+
+  // The info line for the index-th best root move
+  void sendLine(const SearchInfo &info, size_t index);
+
+  // Counters for tuning the search, as an info string once it's done
+  void sendStats(const SearchStats &stats);
+
+  // Whole lines only, searches send info from their own thread
+  void send(const std::string &line);
+
+  std::ostream &m_output;
+  std::mutex m_outputMutex;
+
+  Board m_board = Board();
+  AI m_computer = AI(m_board);
+  Color m_color = Color::white;
+
+  // Half-moves since the start of the game, for the book depth
+  size_t m_ply = 0;
+
+  Tablebase m_tablebase;
+  OpeningBook m_book;
+  size_t m_bookDepth;
+
+  // Root moves reported per depth
+  size_t m_multiPv = 1;
+
+  // Book moves are picked with this again every new game, if set
+  std::optional<uint32_t> m_seed = std::nullopt;
+
+  std::thread m_searchThread;
+  std::atomic<bool> m_stopSearch = false;
+  bool m_isInfinite = false;
+
+  // Cleared by ponderhit
+  std::atomic<bool> m_isPondering = false;
+
+  // go infinite and go ponder hold the best move back until stop or ponderhit
+  std::mutex m_stopMutex;
+  std::condition_variable m_stopCondition;
+};
+
+#endif // UCI_H
@@ -3,7 +3,13 @@
 
 #include "AI.h"
 #include "Board.h"
+#include "BoardRenderer.h"
 #include "Game.h"
+#include "GameRecorder.h"
+#include "LatencyHistogram.h"
+#include "OpeningBook.h"
+#include "PositionDatabase.h"
+#include "Tablebase.h"
 
 // Class that represents the window in which the game is being played
 // Handles user input and both owns and updates the board and game states
@@ -17,6 +23,11 @@ public:
 
   void render();
 
+  // When render() last put a frame on screen
+  inline std::chrono::steady_clock::time_point getPresentTime() const {
+    return m_presentTime;
+  }
+
   void handleMouseInput(const SDL_MouseButtonEvent &mbe);
   void handleKeyboardInput(const SDL_KeyboardEvent &kbe);
 
@@ -25,6 +36,30 @@ public:
     m_board.loadFromState(m_game.parseFen(filename, lineNumber));
   }
 
+  inline bool loadTablebase(const std::string &filename) {
+    if (!m_tablebase.load(filename)) {
+      return false;
+    }
+    m_computer.setTablebase(&m_tablebase);
+    m_ponderComputer.setTablebase(&m_tablebase);
+    return true;
+  }
+
+  inline bool loadOpeningBook(const std::string &filename, size_t maxDepth,
+                              bool bestMoveOnly) {
+    if (!m_book.open(filename)) {
+      return false;
+    }
+    m_computer.setOpeningBook(&m_book, maxDepth, bestMoveOnly);
+    return true;
+  }
+
+  inline void setSeed(uint32_t seed) { m_computer.setSeed(seed); }
+
+  inline bool loadPositionDatabase(const std::string &filename) {
+    return m_positionDatabase.open(filename);
+  }
+
   inline bool isGameInProgress() { return m_game.isInProgress(); }
 
   void stepGame();
@@ -43,14 +78,27 @@ public:
 
   inline void setComputerColor(Color color) { m_computer.setColor(color); }
 
-  inline std::string getActiveFilename() const { return m_activeFilename; }
+  inline std::string getActiveFilename() const {
+    return m_recorder.getFilename();
+  }
 
+  // Finishes writing the previous game, if any
   inline void setActiveFilename(const std::string &filename) {
-    m_activeFilename = filename;
+    m_recorder.open(filename);
   }
 
   inline void setSaveGames(const bool saveGames) { m_saveGames = saveGames; }
 
+  // Lets the computer think about its next move while the player is choosing
+  // theirs
+  inline void setPondering(const bool ponder) { m_ponder = ponder; }
+
+  // From the computer's turn starting to its move being made, book moves and
+  // ponder hits included
+  inline const LatencyHistogram &getComputerMoveLatency() const {
+    return m_computerMoveLatency;
+  }
+
 private:
   void stepSdlGame();
   void stepLegacyGame();
@@ -58,8 +106,36 @@ private:
   bool makePlayerMove();
   bool makeComputerMove();
 
+  // Searches the position after reply, the move the player is expected to
+  // make, in the background
+  void startPondering(Color computerColor,
+                      const std::pair<Position, Position> &reply);
+
+  // The ponder search's move if the player made the expected reply, waiting
+  // for it to finish if need be. Anything else cancels it
+  std::optional<std::pair<Position, Position>>
+  takePonderMove(Color computerColor);
+
+  void stopPondering();
+
+  // Prints the games in the position database that reached the current
+  // position, with the move played next in each
+  void printDatabaseGames();
+
+  // Replaces the game with the index-th game printDatabaseGames() listed, at
+  // the position that was looked up
+  void loadDatabaseGame(size_t index);
+
+  // Searches the current position for the side to move, then prints the best
+  // few moves with their scores and highlights them on the board
+  void showAnalysis();
+
   Board m_board = Board();
   Game m_game = Game();
+  Tablebase m_tablebase;
+  OpeningBook m_book;
+  PositionDatabase m_positionDatabase;
+  std::vector<PositionMatch> m_databaseMatches = {};
   AI m_computer = AI(m_board);
 
   // True if legacy mode is enabled
@@ -68,11 +144,28 @@ private:
   // True if the computer is a player
   bool m_isComputerPlaying = false;
 
+  LatencyHistogram m_computerMoveLatency;
+
+  // -------------- Pondering, on a board of its own --------------
+  bool m_ponder = false;
+  Board m_ponderBoard = Board();
+  AI m_ponderComputer = AI(m_ponderBoard);
+  std::thread m_ponderThread;
+  std::atomic<bool> m_stopPonder = false;
+
+  // Key of the position being pondered on, and the search's answer to it
+  uint64_t m_ponderKey = 0;
+  std::optional<std::pair<Position, Position>> m_ponderMove = std::nullopt;
+
   // -------------- Parameters exclusive to graphical mode --------------
+  BoardRenderer m_boardRenderer{m_board};
+
   SDL_Renderer *m_sdlRenderer;
   SDL_Window *m_sdlWindow;
   SDL_Surface *m_sdlSurface;
 
+  std::chrono::steady_clock::time_point m_presentTime = {};
+
   //
   std::queue<Position> m_clickedPositionQueue = {};
 
@@ -91,7 +184,8 @@ private:
   // Parsed promotion choice to be applied
   PieceType m_promotionOutput = PieceType::none;
 
-  std::string m_activeFilename = "";
+  // Writes the game record when saving games
+  GameRecorder m_recorder;
 
   bool m_saveGames = false;
 };
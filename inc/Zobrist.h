@@ -0,0 +1,22 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include "Defs.h"
+
+// Zobrist hashing of positions with Polyglot's Random64 table: 768
+// piece-square keys, 4 castling keys, 8 en passant file keys and 1 side to
+// move key. Hashes match Polyglot's own, so books made by any Polyglot tool
+// work as they are. loadZobristKeys() can swap in a different table, but
+// hashes are only comparable between programs using the same one
+
+constexpr size_t k_numZobristKeys = 781;
+
+// Replaces the table with one read from a text file containing 781 keys as hex
+// numbers, for books keyed with something other than Polyglot's. Anything that
+// isn't a 0x-prefixed number is ignored. Not thread-safe, meant to be called
+// once before hashing anything
+bool loadZobristKeys(const std::string &filename);
+
+uint64_t getZobristKey(const LumpedBoardAndGameState &state);
+
+#endif // ZOBRIST_H
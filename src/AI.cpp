@@ -1,107 +1,34 @@
 #include "AI.h"
 #include "Board.h"
+#include "EvalTables.h"
+#include "Trace.h"
 
 #include <iterator>
 #include <random>
 
 namespace {
 
-constexpr int k_pawnValue = 100;
-constexpr int k_knightValue = 300;
-constexpr int k_bishopValue = 300;
-constexpr int k_rookValue = 500;
-constexpr int k_queenValue = 900;
-constexpr int k_kingValue = 9000;
-
 constexpr int k_maxSquareIndex = 7;
 
 constexpr size_t k_mobilityMultiplier = 3;
 
-// clang-format off
-
-// Credits to https://www.chessprogramming.org/Simplified_Evaluation_Function
-using EvalTable = int[k_totalSquares / 8][k_totalSquares / 8];
-// Made last row 90 as that made more sense to me (guaranteed queen)
-constexpr EvalTable k_pawnEvalTable = {
-    {0,  0,  0,   0,   0,   0,   0,  0},
-    {5,  10, 10,  -20, -20, 10,  10, 5},
-    {5,  -5, -10, 0,   0,  -10, -5,  5},
-    {0,  0,  0,   20,   20,  0,  0,  0},
-    {5,  5,  10,  25,  25,  10,  5,  5},
-    {10, 10, 20,  30,  30,  20,  10, 10},
-    {50, 50, 50,  50,  50,  50,  50, 50},
-    {90, 90, 90,  90,  90,  90,  90, 90}
-};
-
-constexpr EvalTable k_knightEvalTable = {
-    {-50, -40, -30, -30, -30, -30, -40, -50},
-    {-40, -20, 0,   5,   5,   0,   -20, -40},
-    {-30, 5,   10,  15,  15,  10,  5,   -30},
-    {-30, 0,   15,  20,  20,  15,  0,   -30},
-    {-30, 5,   15,  20,  20,  15,  5,   -30},
-    {-30, 0,   10,  15,  15,  10,  0,   -30},
-    {-40, -20, 0,   0,   0,   0,   -20, -40},
-    {-50, -40, -30, -30, -30, -30, -40, -50}
-};
-
-constexpr EvalTable k_bishopEvalTable = {
-    {-20, -10, -10, -10, -10, -10, -10, -20},
-    {-10, 5,   0,   0,   0,   0,   5,   -10},
-    {-10, 10,  10,  10,  10,  10,  10,  -10},
-    {-10, 0,   10,  10,  10,  10,  0,   -10},
-    {-10, 5,   5,   10,  10,  5,   5,   -10},
-    {-10, 0,   5,   10,  10,  5,   0,   -10},
-    {-10, 0,   0,   0,   0,   0,   0,   -10},
-    {-20, -10, -10, -10, -10, -10, -10, -20}
-};
-
-constexpr EvalTable k_rookEvalTable = {
-    {0,  0,  0,  5,  5,  0,  0,  0},
-    {-5, 0,  0,  0,  0,  0,  0,  -5},
-    {-5, 0,  0,  0,  0,  0,  0,  -5},
-    {-5, 0,  0,  0,  0,  0,  0,  -5},
-    {-5, 0,  0,  0,  0,  0,  0,  -5},
-    {-5, 0,  0,  0,  0,  0,  0,  -5},
-    {5,  10, 10, 10, 10, 10, 10, 5},
-    {0,  0,  0,  0,  0,  0,  0,  0}
-};
+// Move ordering buckets: winning and even captures, then quiet moves, then
+// captures that lose material (which score below the quiet moves)
+constexpr int k_goodCaptureScore = 20000;
+constexpr int k_quietMoveScore = 10000;
 
-// Changed this one a bit from the original
-// to make it more symmetrical
-constexpr EvalTable k_queenEvalTable = {
-    {-20, -10, -10, -5, -5, -10, -10, -20},
-    {-10, 0,   0,   0,  0,  0,   0,   -10},
-    {-10, 0,   5,   5,  5,  5,   0,   -10},
-    {-5,  0,   5,   5,  5,  5,   0,   -5},
-    {-5,  0,   5,   5,  5,  5,   0,   -5},
-    {-10, 0,   5,   5,  5,  5,   0,   -10},
-    {-10, 0,   0,   0,  0,  0,   0,   -10},
-    {-20, -10, -10, -5, -5, -10, -10, -20}
-};
+// Quiet moves that lose material on the spot are skipped this close to the
+// leaves
+constexpr int k_seePruningDepth = 1;
 
-constexpr EvalTable k_kingOpeningEvalTable = {
-    {20,  30,  10,  0,   0,   10,  30,  20},
-    {20,  20,  0,   0,   0,   0,   20,  20},
-    {-10, -20, -20, -20, -20, -20, -20, -10},
-    {-20, -30, -30, -40, -40, -30, -30, -20},
-    {-30, -40, -40, -50, -50, -40, -40, -30},
-    {-30, -40, -40, -50, -50, -40, -40, -30},
-    {-30, -40, -40, -50, -50, -40, -40, -30},
-    {-30, -40, -40, -50, -50, -40, -40, -30}
-};
+// Without a time control to reach, assume the game lasts this many more moves
+constexpr int k_defaultMovesToGo = 30;
 
-constexpr EvalTable k_kingEndgameEvalTable = {
-    {-50, -40, -30, -20, -20, -30,  -40, -50},
-    {-30, -20, -10, 0,   0,   -10,  -20, -30},
-    {-30, -10, 20,  30,  30,   20,  -10, -30},
-    {-30, -10, 30,  40,  40,   30,  -10, -30},
-    {-30, -10, 30,  40,  40,   30,  -10, -30},
-    {-30, -10, 20,  30,  30,   20,  -10, -30},
-    {-30, -30, 0,   0,   0,    0,   -30, -30},
-    {-50, -30, -30, -30, -30,  -30, -30, -50}
-};
+// Kept back from the clock for I/O
+constexpr std::chrono::milliseconds k_moveOverhead(50);
 
-// clang-format on
+// Tablebase wins score below checkmate, and sooner is better
+constexpr int k_tablebaseWinScore = 9000;
 
 // Credits to first answer:
 // https://stackoverflow.com/questions/6942273/how-to-get-a-random-element-from-a-c-container
@@ -112,10 +39,14 @@ it selectRandomly(it start, it end, RandomGenerator &g) {
   return start;
 }
 
-template <typename it> it selectRandomly(it start, it end) {
-  static std::random_device rd;
-  static std::mt19937 gen(rd());
-  return selectRandomly(start, end, gen);
+// Only the search writes the counters, so they don't need a locked add
+inline void increment(std::atomic<size_t> &counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+}
+
+inline int64_t getTicks() {
+  return std::chrono::steady_clock::now().time_since_epoch().count();
 }
 
 auto addToAdvantage = [](const PieceContainer &container, int pieceValue,
@@ -145,6 +76,16 @@ auto addToAdvantage = [](const PieceContainer &container, int pieceValue,
 
 } // namespace
 
+std::chrono::milliseconds getMoveTime(std::chrono::milliseconds remaining,
+                                      std::chrono::milliseconds increment,
+                                      int movesToGo) {
+  // An even share of what's left, never running the clock out
+  auto time = remaining / ((movesToGo > 0) ? movesToGo : k_defaultMovesToGo) +
+              increment / 2;
+  time = std::min(time, remaining - k_moveOverhead);
+  return std::max(time, std::chrono::milliseconds(1));
+}
+
 void AI::reset() { m_color = Color::black; }
 
 int AI::getAdvantage() {
@@ -173,21 +114,212 @@ int AI::getAdvantage() {
 
 std::pair<Position, Position> AI::getRandomMove() {
   const auto &moves = m_board.getValidMovesFor(m_color.value());
-  auto result = selectRandomly(moves.cbegin(), moves.cend());
+  auto result = selectRandomly(moves.cbegin(), moves.cend(), m_generator);
   return {result->start, result->end};
 }
 
+std::optional<std::pair<Position, Position>> AI::getBookMove(Color color,
+                                                             size_t ply) {
+  // Book depth is in moves
+  if (!m_book || ply >= 2 * m_maxBookDepth) {
+    return std::nullopt;
+  }
+
+  const auto bookMove = m_book->pickMove(m_board.getBoardAndGameState(color),
+                                         m_bestBookMoveOnly, m_generator);
+  if (!bookMove.has_value()) {
+    return std::nullopt;
+  }
+
+  // Guards against key collisions and books made with different keys
+  const auto &moves = m_board.getAllValidMoves();
+  const bool isValid =
+      std::any_of(moves.begin(), moves.end(), [&](const FullMove &move) {
+        return move.color == color && move.start == bookMove->start &&
+               move.end == bookMove->end;
+      });
+  if (!isValid) {
+    return std::nullopt;
+  }
+
+  if (k_verbose) {
+    std::cout << "Book move with weight " << bookMove->weight << std::endl;
+  }
+
+  return std::make_pair(bookMove->start, bookMove->end);
+}
+
 std::pair<Position, Position> AI::minimaxRoot(Color max) {
-  std::pair<Position, Position> bestMove;
+  TRACE_SCOPE("AI::minimaxRoot");
+  resetStats();
+  m_stopped = false;
+  m_limits = SearchLimits();
+
+  int score = 0;
+  const auto move = searchRoot(max, m_difficulty, score, m_ponderMove);
+  storeLines();
+  storeNodesPerPly();
+  m_completedDepth.store(m_difficulty, std::memory_order_relaxed);
+  m_statsEnd.store(getTicks(), std::memory_order_relaxed);
+  return move;
+}
+
+SearchStats AI::getStats() const {
+  SearchStats stats;
+  stats.nodes = m_nodes.load(std::memory_order_relaxed);
+  stats.leafNodes = m_leafNodes.load(std::memory_order_relaxed);
+  stats.tablebaseHits = m_tablebaseHits.load(std::memory_order_relaxed);
+  stats.prunedMoves = m_prunedMoves.load(std::memory_order_relaxed);
+  stats.cutoffs = m_cutoffs.load(std::memory_order_relaxed);
+  stats.firstMoveCutoffs = m_firstMoveCutoffs.load(std::memory_order_relaxed);
+  stats.depth = m_completedDepth.load(std::memory_order_relaxed);
+  stats.selDepth = m_selDepth.load(std::memory_order_relaxed);
+
+  const int64_t end = m_statsEnd.load(std::memory_order_relaxed);
+  stats.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::duration(
+          (end ? end : getTicks()) -
+          m_statsStart.load(std::memory_order_relaxed)));
+
+  // Up to the deepest ply reached
+  for (const auto &count : m_completedNodesPerPly) {
+    const size_t nodes = count.load(std::memory_order_relaxed);
+    if (nodes == 0) {
+      break;
+    }
+    stats.nodesPerPly.push_back(nodes);
+  }
+
+  return stats;
+}
+
+void AI::storeNodesPerPly() {
+  for (size_t ply = 0; ply < m_nodesPerPly.size(); ++ply) {
+    m_completedNodesPerPly[ply].store(
+        m_nodesPerPly[ply].load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+  }
+}
+
+void AI::resetStats() {
+  for (auto *counter : {&m_nodes, &m_leafNodes, &m_tablebaseHits,
+                        &m_prunedMoves, &m_cutoffs, &m_firstMoveCutoffs}) {
+    counter->store(0, std::memory_order_relaxed);
+  }
+  for (auto &count : m_nodesPerPly) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  for (auto &count : m_completedNodesPerPly) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  m_completedDepth.store(0, std::memory_order_relaxed);
+  m_selDepth.store(0, std::memory_order_relaxed);
+  m_statsStart.store(getTicks(), std::memory_order_relaxed);
+  m_statsEnd.store(0, std::memory_order_relaxed);
+}
+
+std::optional<std::pair<Position, Position>>
+AI::search(Color max, const SearchLimits &limits,
+           const SearchCallback &callback) {
+  resetStats();
+  m_stopped = false;
+  m_searchStart = std::chrono::steady_clock::now();
+  m_clockStart = m_searchStart;
+  m_limits = limits;
+  m_isPondering = limits.ponder != nullptr;
+  m_ponderMove.reset();
+  m_lines.clear();
+
+  m_board.refreshValidMoves();
+  if (m_board.getValidMovesFor(max).empty()) {
+    m_statsEnd.store(getTicks(), std::memory_order_relaxed);
+    return std::nullopt;
+  }
+
+  std::optional<std::pair<Position, Position>> bestMove;
+  for (int depth = 1; depth <= limits.depth; ++depth) {
+    TRACE_SCOPE("AI::search depth");
+    // The last depth leaves the moves of some leaf behind
+    m_board.refreshValidMoves();
+
+    int score = 0;
+    std::optional<std::pair<Position, Position>> reply;
+    const auto move = searchRoot(max, depth, score, reply);
+
+    // An unfinished depth is only better than nothing
+    if (m_stopped) {
+      if (!bestMove.has_value()) {
+        bestMove = move;
+      }
+      break;
+    }
+
+    bestMove = move;
+    m_ponderMove = reply;
+    storeNodesPerPly();
+    m_completedDepth.store(depth, std::memory_order_relaxed);
+    storeLines();
+    if (callback) {
+      const size_t numLines =
+          std::clamp<size_t>(limits.multiPv, 1, m_lines.size());
+      callback({depth, score, move, reply, getNodes(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - m_searchStart),
+                std::vector<SearchLine>(m_lines.begin(),
+                                        m_lines.begin() + numLines),
+                getStats()});
+    }
+
+    // Searching deeper won't find anything better than a forced mate
+    if (std::abs(score) >= k_checkmateScore) {
+      break;
+    }
+  }
+
+  m_board.refreshValidMoves();
+  m_limits = SearchLimits();
+  m_statsEnd.store(getTicks(), std::memory_order_relaxed);
+  return bestMove;
+}
+
+std::pair<Position, Position>
+AI::searchRoot(Color max, int depth, int &score,
+               std::optional<std::pair<Position, Position>> &reply) {
+  m_rootDepth = depth;
+  reply.reset();
+  m_rootLines.clear();
+
+  // Each depth is a tree of its own
+  for (auto &count : m_nodesPerPly) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  increment(m_nodesPerPly[0]);
+
   int bestAdvantage = -9999;
   const auto &startingMoves = m_board.getValidMovesFor(max);
+  std::pair<Position, Position> bestMove;
+  if (!startingMoves.empty()) {
+    bestMove = std::make_pair(startingMoves[0].start, startingMoves[0].end);
+  }
 
   for (size_t i = 0; i < startingMoves.size(); ++i) {
+    TRACE_SCOPE("AI::searchRoot move");
     const auto &moveToMake = startingMoves[i];
-    m_board.testMove(moveToMake.start, moveToMake.end, m_difficulty);
-    int advantage =
-        minimax(getOtherColor(max), m_difficulty - 1, -10000, 10000);
-    m_board.undoMove(moveToMake.start, moveToMake.end, m_difficulty);
+    m_board.testMove(moveToMake.start, moveToMake.end, depth);
+    int advantage = minimax(getOtherColor(max), depth - 1, -10000, 10000);
+    m_board.undoMove(moveToMake.start, moveToMake.end, depth);
+    if (m_stopped) {
+      break;
+    }
+
+    // The root is searched with a full window, so this is the actual line
+    SearchLine line = {std::make_pair(moveToMake.start, moveToMake.end),
+                       advantage,
+                       {std::make_pair(moveToMake.start, moveToMake.end)}};
+    line.pv.insert(line.pv.end(), m_pv[1].begin() + 1,
+                   m_pv[1].begin() + m_pvLength[1]);
+    m_rootLines.push_back(std::move(line));
+    const auto &pv = m_rootLines.back().pv;
 
     if (advantage >= bestAdvantage) {
       bestAdvantage = advantage;
@@ -195,6 +327,7 @@ std::pair<Position, Position> AI::minimaxRoot(Color max) {
         std::cout << advantage << std::endl;
       }
       bestMove = std::make_pair(startingMoves[i].start, startingMoves[i].end);
+      reply = (pv.size() > 1) ? std::optional(pv[1]) : std::nullopt;
     }
   }
 
@@ -202,21 +335,97 @@ std::pair<Position, Position> AI::minimaxRoot(Color max) {
     std::cout << "The best move advantage was: " << bestAdvantage << std::endl;
   }
 
+  score = bestAdvantage;
   return bestMove;
 }
 
+void AI::updatePv(int ply, const FullMove &move) {
+  auto &pv = m_pv[ply];
+  const auto &childPv = m_pv[ply + 1];
+  pv[ply] = std::make_pair(move.start, move.end);
+  std::copy(childPv.begin() + ply + 1, childPv.begin() + m_pvLength[ply + 1],
+            pv.begin() + ply + 1);
+  m_pvLength[ply] = m_pvLength[ply + 1];
+}
+
+void AI::storeLines() {
+  // Ties go to the later move, like they do in searchRoot()
+  m_lines.assign(m_rootLines.rbegin(), m_rootLines.rend());
+  std::stable_sort(m_lines.begin(), m_lines.end(),
+                   [](const SearchLine &a, const SearchLine &b) {
+                     return a.score > b.score;
+                   });
+}
+
+bool AI::isOverLimits() {
+  if (m_limits.stop && m_limits.stop->load(std::memory_order_relaxed)) {
+    return true;
+  }
+
+  if (m_isPondering) {
+    if (m_limits.ponder->load(std::memory_order_relaxed)) {
+      // Nothing but stop ends a search on the opponent's time
+      return false;
+    }
+
+    // Ponder hit, the clock starts now
+    m_isPondering = false;
+    m_clockStart = std::chrono::steady_clock::now();
+  }
+
+  if (m_limits.nodes.has_value() && getNodes() >= *m_limits.nodes) {
+    return true;
+  }
+  return m_limits.time.has_value() &&
+         std::chrono::steady_clock::now() - m_clockStart >= *m_limits.time;
+}
+
 int AI::minimax(Color color, int depth, int alpha, int beta) {
+  increment(m_nodes);
+  const int ply = m_rootDepth - depth;
+  m_pvLength[ply] = ply;
+  increment(m_nodesPerPly[ply]);
+  if (ply > m_selDepth.load(std::memory_order_relaxed)) {
+    m_selDepth.store(ply, std::memory_order_relaxed);
+  }
+  if (m_stopped || isOverLimits()) {
+    // Whatever is returned now gets thrown away
+    m_stopped = true;
+    return 0;
+  }
+
+  if (m_tablebase && m_board.getPieceCount() <= k_maxTablebasePieces) {
+    const auto result =
+        m_tablebase->probe(m_board.getBoardAndGameState(color));
+    if (result.has_value()) {
+      increment(m_tablebaseHits);
+      int score = 0;
+      if (result->outcome == TablebaseOutcome::win) {
+        score = k_tablebaseWinScore - result->distanceToMate;
+      } else if (result->outcome == TablebaseOutcome::loss) {
+        score = result->distanceToMate - k_tablebaseWinScore;
+      }
+      // Scores are always from the computer's point of view
+      return (color == m_color.value()) ? score : -score;
+    }
+  }
+
   if (depth == 0) {
-    int colorMultiplier = (color == Color::white) ? -1 : 1;
-    int difficultyMultiplier = (m_difficulty % 2 == 0) ? -1 : 1;
-    return getAdvantage() * colorMultiplier * difficultyMultiplier;
+    increment(m_leafNodes);
+    // From the computer's point of view, whatever depth the search started at
+    const int advantage = getAdvantage();
+    return (m_color.value() == Color::white) ? advantage : -advantage;
   }
 
   m_board.refreshValidMoves();
-  const auto &moves = m_board.getValidMovesFor(color);
+  auto moves = m_board.getValidMovesFor(color);
   const auto &opponentMoves = m_board.getValidMovesFor(getOtherColor(color));
   int bestAdvantage = 0;
 
+  orderMoves(moves);
+  const bool inCheck =
+      (depth <= k_seePruningDepth) && m_board.isKingInCheck(color);
+
   if (color == m_color.value()) {
     bestAdvantage = -9999;
 
@@ -240,12 +449,24 @@ int AI::minimax(Color color, int depth, int alpha, int beta) {
 
     for (size_t i = 0; i < moves.size(); ++i) {
       const auto &moveToMake = moves[i];
+      if (i > 0 && isLosingQuietMove(moveToMake, depth, inCheck)) {
+        increment(m_prunedMoves);
+        continue;
+      }
       m_board.testMove(moveToMake.start, moveToMake.end, depth);
-      bestAdvantage = std::max(
-          bestAdvantage, minimax(getOtherColor(color), depth - 1, alpha, beta));
+      const int advantage =
+          minimax(getOtherColor(color), depth - 1, alpha, beta);
       m_board.undoMove(moveToMake.start, moveToMake.end, depth);
+      if (advantage > bestAdvantage || i == 0) {
+        updatePv(ply, moveToMake);
+      }
+      bestAdvantage = std::max(bestAdvantage, advantage);
       alpha = std::max(alpha, bestAdvantage);
       if (beta <= alpha) {
+        increment(m_cutoffs);
+        if (i == 0) {
+          increment(m_firstMoveCutoffs);
+        }
         return bestAdvantage;
       }
     }
@@ -269,12 +490,24 @@ int AI::minimax(Color color, int depth, int alpha, int beta) {
 
     for (size_t i = 0; i < moves.size(); ++i) {
       const auto &moveToMake = moves[i];
+      if (i > 0 && isLosingQuietMove(moveToMake, depth, inCheck)) {
+        increment(m_prunedMoves);
+        continue;
+      }
       m_board.testMove(moveToMake.start, moveToMake.end, depth);
-      bestAdvantage = std::min(
-          bestAdvantage, minimax(getOtherColor(color), depth - 1, alpha, beta));
+      const int advantage =
+          minimax(getOtherColor(color), depth - 1, alpha, beta);
       m_board.undoMove(moveToMake.start, moveToMake.end, depth);
+      if (advantage < bestAdvantage || i == 0) {
+        updatePv(ply, moveToMake);
+      }
+      bestAdvantage = std::min(bestAdvantage, advantage);
       beta = std::min(beta, bestAdvantage);
       if (beta <= alpha) {
+        increment(m_cutoffs);
+        if (i == 0) {
+          increment(m_firstMoveCutoffs);
+        }
         return bestAdvantage;
       }
     }
@@ -282,3 +515,44 @@ int AI::minimax(Color color, int depth, int alpha, int beta) {
 
   return bestAdvantage;
 }
+
+bool AI::isCapture(const FullMove &move) {
+  if (m_board.getPieceAt(move.end)) {
+    return true;
+  }
+
+  // En passant
+  return move.pieceType == PieceType::pawn &&
+         move.start.first != move.end.first;
+}
+
+void AI::orderMoves(std::vector<FullMove> &moves) {
+  std::vector<std::pair<int, FullMove>> scoredMoves;
+  scoredMoves.reserve(moves.size());
+
+  for (const auto &move : moves) {
+    int score = k_quietMoveScore;
+    if (isCapture(move)) {
+      const int exchange = m_board.see(move.start, move.end);
+      score = (exchange >= 0) ? k_goodCaptureScore + exchange
+                              : k_quietMoveScore + exchange;
+    }
+    scoredMoves.emplace_back(score, move);
+  }
+
+  std::stable_sort(
+      scoredMoves.begin(), scoredMoves.end(),
+      [](const auto &a, const auto &b) { return a.first > b.first; });
+
+  for (size_t i = 0; i < moves.size(); ++i) {
+    moves[i] = scoredMoves[i].second;
+  }
+}
+
+bool AI::isLosingQuietMove(const FullMove &move, int depth, bool inCheck) {
+  if (depth > k_seePruningDepth || inCheck || isCapture(move)) {
+    return false;
+  }
+
+  return m_board.see(move.start, move.end) < 0;
+}
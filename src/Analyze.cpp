@@ -0,0 +1,256 @@
+#include "Analyze.h"
+#include "CommandLine.h"
+#include "Fen.h"
+#include "Pgn.h"
+#include "Uci.h"
+
+#include <cstdio>
+#include <mutex>
+
+namespace {
+
+const std::string k_defaultOutputFilename = "analysis.jsonl";
+constexpr int k_defaultDepth = 3;
+
+// Each job collects this much output before taking the file lock
+constexpr size_t k_outputBufferSize = 1 << 16;
+
+constexpr size_t k_progressInterval = 10000;
+
+void appendString(std::string_view value, std::string &out) {
+  if (value.empty()) {
+    out += "null";
+    return;
+  }
+
+  // Moves and FEN never need escaping
+  out += '"';
+  out += value;
+  out += '"';
+}
+
+std::string getSan(Board &board, Color color,
+                   const std::pair<Position, Position> &move) {
+  for (const auto &validMove : board.getValidMovesFor(color)) {
+    if (validMove.start == move.first && validMove.end == move.second) {
+      return toSan(board, validMove);
+    }
+  }
+
+  return "";
+}
+
+void appendPv(const std::vector<std::string> &pv, std::string &out) {
+  out += '[';
+  for (size_t i = 0; i < pv.size(); ++i) {
+    if (i > 0) {
+      out += ',';
+    }
+    appendString(pv[i], out);
+  }
+  out += ']';
+}
+
+} // namespace
+
+AnalysisResult analyzePosition(Board &board, AI &computer,
+                               const LumpedBoardAndGameState &state,
+                               const SearchLimits &limits) {
+  AnalysisResult result;
+
+  board.loadFromState(state);
+  computer.setColor(state.whoseTurn);
+
+  std::vector<SearchLine> lines;
+  const auto start = std::chrono::steady_clock::now();
+  const auto move = computer.search(
+      state.whoseTurn, limits, [&result, &lines](const SearchInfo &info) {
+        result.depth = info.depth;
+        result.score = info.score;
+        result.mateMoves = getMateMoves(info);
+        lines = info.lines;
+      });
+  result.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  result.nodes = computer.getNodes();
+
+  if (!move.has_value()) {
+    return result;
+  }
+
+  result.bestMove = toUciMove(board, move.value());
+  if (!lines.empty()) {
+    result.pv = toUciPv(board, lines.front().pv);
+  } else {
+    // Stopped before the first depth was done
+    result.pv = {result.bestMove};
+  }
+  result.san = getSan(board, state.whoseTurn, move.value());
+
+  if (limits.multiPv < 2) {
+    return result;
+  }
+
+  for (const auto &line : lines) {
+    AnalysisLine &analysisLine = result.lines.emplace_back();
+    analysisLine.move = toUciMove(board, line.move);
+    analysisLine.san = getSan(board, state.whoseTurn, line.move);
+    analysisLine.pv = toUciPv(board, line.pv);
+    analysisLine.score = line.score;
+    analysisLine.mateMoves = getMateMoves(line.score, result.depth);
+  }
+
+  return result;
+}
+
+void writeAnalysis(size_t line, const LumpedBoardAndGameState &state,
+                   const AnalysisResult &result, std::string &out) {
+  char fen[k_maxFenLength];
+  writeFen(state, fen, sizeof(fen));
+
+  out += "{\"line\":" + std::to_string(line) + ",\"fen\":";
+  appendString(fen, out);
+  out += ",\"bestmove\":";
+  appendString(result.bestMove, out);
+  out += ",\"san\":";
+  appendString(result.san, out);
+  out += ",\"score\":" + std::to_string(result.score) + ",\"mate\":";
+  out += result.mateMoves.has_value() ? std::to_string(*result.mateMoves)
+                                      : "null";
+  out += ",\"depth\":" + std::to_string(result.depth) +
+         ",\"nodes\":" + std::to_string(result.nodes) +
+         ",\"time\":" + std::to_string(result.time.count()) + ",\"pv\":";
+
+  appendPv(result.pv, out);
+
+  if (!result.lines.empty()) {
+    out += ",\"lines\":[";
+    for (size_t i = 0; i < result.lines.size(); ++i) {
+      const auto &line = result.lines[i];
+      out += (i > 0) ? ",{\"move\":" : "{\"move\":";
+      appendString(line.move, out);
+      out += ",\"san\":";
+      appendString(line.san, out);
+      out += ",\"score\":" + std::to_string(line.score) + ",\"mate\":";
+      out += line.mateMoves.has_value() ? std::to_string(*line.mateMoves)
+                                        : "null";
+      out += ",\"pv\":";
+      appendPv(line.pv, out);
+      out += '}';
+    }
+    out += ']';
+  }
+  out += "}\n";
+}
+
+int runAnalyze(int argc, char **argv) {
+  const auto inputFilename = getArgumentValue(argv, argv + argc, "--in");
+  if (!inputFilename.has_value() || argumentPassed(argv, argv + argc, "-h")) {
+    std::cout << "Usage: chess analyze --in <positions.fen> "
+                 "[--out <results.jsonl>] [--depth <n>] [--movetime <ms>] "
+                 "[--nodes <n>] [--multipv <k>] [--jobs <n>]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string outputFilename =
+      getArgumentValue(argv, argv + argc, "--out")
+          .value_or(k_defaultOutputFilename);
+
+  SearchLimits limits;
+  if (auto movetime = getArgumentValue(argv, argv + argc, "--movetime")) {
+    limits.time = std::chrono::milliseconds(std::max(1, std::stoi(*movetime)));
+  }
+  if (auto nodes = getArgumentValue(argv, argv + argc, "--nodes")) {
+    limits.nodes = std::max<size_t>(1, std::stoull(*nodes));
+  }
+  if (auto depth = getArgumentValue(argv, argv + argc, "--depth")) {
+    limits.depth = std::clamp(std::stoi(*depth), 1, k_maxSearchDepth);
+  } else if (!limits.time.has_value() && !limits.nodes.has_value()) {
+    limits.depth = k_defaultDepth;
+  }
+
+  if (auto multiPv = getArgumentValue(argv, argv + argc, "--multipv")) {
+    limits.multiPv = std::max(1, std::stoi(*multiPv));
+  }
+
+  const unsigned int defaultJobs =
+      std::max(1u, std::thread::hardware_concurrency());
+  const int numJobs =
+      std::max(1, std::stoi(getArgumentValue(argv, argv + argc, "--jobs")
+                                .value_or(std::to_string(defaultJobs))));
+
+  FenFile file;
+  if (!file.open(inputFilename.value())) {
+    return 1;
+  }
+
+  std::FILE *output = std::fopen(outputFilename.c_str(), "wb");
+  if (!output) {
+    std::cout << "Error: could not open " << outputFilename << " for writing"
+              << std::endl;
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  std::atomic<size_t> next = 0;
+  std::atomic<size_t> numPositions = 0;
+  std::atomic<size_t> numNodes = 0;
+  std::mutex outputMutex;
+
+  auto flush = [&](std::string &buffer) {
+    std::lock_guard<std::mutex> lock(outputMutex);
+    std::fwrite(buffer.data(), 1, buffer.size(), output);
+    buffer.clear();
+  };
+
+  // Lines are handed out one at a time, so a slow position only holds up
+  // its own job
+  std::vector<std::thread> jobs;
+  for (int i = 0; i < numJobs; ++i) {
+    jobs.emplace_back([&]() {
+      Board board;
+      AI computer(board);
+      LumpedBoardAndGameState state;
+      std::string buffer;
+
+      for (size_t index = next++; index < file.size(); index = next++) {
+        if (!file.getPosition(index, state)) {
+          continue;
+        }
+
+        const auto result = analyzePosition(board, computer, state, limits);
+        writeAnalysis(index + 1, state, result, buffer);
+        numNodes += result.nodes;
+        if (buffer.size() >= k_outputBufferSize) {
+          flush(buffer);
+        }
+
+        if (++numPositions % k_progressInterval == 0) {
+          std::lock_guard<std::mutex> lock(outputMutex);
+          std::cout << numPositions << " positions" << std::endl;
+        }
+      }
+
+      flush(buffer);
+    });
+  }
+  for (auto &job : jobs) {
+    job.join();
+  }
+
+  const bool succeeded = std::fclose(output) == 0;
+  if (!succeeded) {
+    std::cout << "Error: failed to write " << outputFilename << std::endl;
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("Analysed %zu positions in %.1f s (%d jobs), %zu nodes, %.0f "
+         "nodes/s\n",
+         numPositions.load(), elapsed.count(), numJobs, numNodes.load(),
+         numNodes / std::max(elapsed.count(), 1e-9));
+
+  return succeeded ? 0 : 1;
+}
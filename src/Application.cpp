@@ -1,21 +1,19 @@
 #include "Application.h"
+#include "CommandLine.h"
+#include "Trace.h"
 
 #include <chrono>
 #include <iomanip>
 
 namespace {
 
-constexpr long k_counterMod = 10;
-
 const std::string k_fenFilename = "../chesscpp/inc/load.fen";
 constexpr int k_firstFenIndex = 0;
 
 const std::string k_writeFenPrefix = "game";
 
-// Parse CLI arguments
-bool argumentPassed(char **start, char **end, const std::string &toFind) {
-  return std::find(start, end, toFind) != end;
-}
+// In moves
+constexpr size_t k_defaultBookDepth = 12;
 
 } // namespace
 
@@ -61,13 +59,21 @@ Application::Application(int argc, char **argv)
     }
   }
 
+  // Passing "--seed <n>" fixes every random choice, the colors picked by "-r"
+  // and the computer player's book moves, so games can be replayed
+  const auto seed = getArgumentValue(argv, argv + argc, "--seed");
+  if (seed.has_value()) {
+    m_window->setSeed(std::strtoul(seed->c_str(), nullptr, 10));
+  }
+
   // Passing "-r" as an additional argument randomizes player and computer
   // player's colors
   if (argumentPassed(argv, argv + argc, "-r")) {
     m_window->setTurn(Color::white);
     if (m_window->isComputerPlaying()) {
       // Make rand() call pseudo-nondeterministic
-      srand(time(NULL));
+      srand(seed.has_value() ? std::strtoul(seed->c_str(), nullptr, 10)
+                             : time(NULL));
       (rand() % 2) ? m_window->setComputerColor(Color::white)
                    : m_window->setComputerColor(Color::black);
     }
@@ -80,6 +86,44 @@ Application::Application(int argc, char **argv)
     m_window->setSaveGames(true);
   }
 
+  // Passing "--ponder" lets the computer player think on the player's time
+  if (argumentPassed(argv, argv + argc, "--ponder")) {
+    m_window->setPondering(true);
+  }
+
+  // Passing "--tb <file>" loads an endgame tablebase for the computer player,
+  // see tools/GenTablebase.cpp
+  if (auto tablebase = getArgumentValue(argv, argv + argc, "--tb")) {
+    m_window->loadTablebase(tablebase.value());
+  }
+
+  // Passing "--book-keys <file>" replaces Polyglot's hash keys with another
+  // table, for books that weren't keyed with them, see Zobrist.h
+  if (auto keys = getArgumentValue(argv, argv + argc, "--book-keys")) {
+    if (!loadZobristKeys(keys.value())) {
+      std::cout << "Using Polyglot's keys, book moves may not be found"
+                << std::endl;
+    }
+  }
+
+  // Passing "--book <file>" loads a Polyglot opening book for the computer
+  // player, used for the first "--book-depth <n>" moves. Book moves are picked
+  // at random by weight, or "--book-best" always picks the most popular one
+  if (auto book = getArgumentValue(argv, argv + argc, "--book")) {
+    size_t depth = k_defaultBookDepth;
+    if (auto value = getArgumentValue(argv, argv + argc, "--book-depth")) {
+      depth = std::strtoul(value->c_str(), nullptr, 10);
+    }
+    m_window->loadOpeningBook(book.value(), depth,
+                              argumentPassed(argv, argv + argc, "--book-best"));
+  }
+
+  // Passing "--posdb <file>" loads a position database made by build_posdb,
+  // pressing g then lists games that reached the position on the board
+  if (auto database = getArgumentValue(argv, argv + argc, "--posdb")) {
+    m_window->loadPositionDatabase(database.value());
+  }
+
   m_appState = AppState::GAME_IN_PROGRESS;
 }
 
@@ -90,9 +134,10 @@ int Application::run() {
   // Initialize tracking variables
   bool quit = false;
   bool gameComplete = false;
-  std::chrono::duration<double> diff;
-  std::chrono::_V2::system_clock::time_point runStart;
-  std::chrono::_V2::system_clock::time_point runEnd;
+
+  // When the oldest input not yet shown on screen was polled
+  std::chrono::steady_clock::time_point inputTime;
+  bool hasPendingInput = false;
 
   int resetCount = 0;
 
@@ -108,10 +153,17 @@ int Application::run() {
   }
 
   while (!quit) {
-    runStart = std::chrono::system_clock::now();
+    TRACE_SCOPE("Application::run");
+    const auto runStart = std::chrono::steady_clock::now();
     // All SDL tasks are exclusive to new mode
     if (!m_legacyMode) {
       while (SDL_PollEvent(&e)) {
+        if (!hasPendingInput &&
+            (e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_KEYDOWN)) {
+          inputTime = runStart;
+          hasPendingInput = true;
+        }
+
         // User closes window
         switch (e.type) {
         case SDL_QUIT:
@@ -122,6 +174,13 @@ int Application::run() {
           break;
         case SDL_KEYDOWN:
           m_window->handleKeyboardInput(e.key);
+          if (e.key.keysym.sym == SDLK_l) {
+            printLatencies();
+          }
+          // Loading a game from the position database restarts it too
+          if (m_window->isGameInProgress()) {
+            m_appState = AppState::GAME_IN_PROGRESS;
+          }
           // TODO: Come up with a better way to do this
           if (e.key.keysym.sym == SDLK_r) {
             ++resetCount;
@@ -167,15 +226,28 @@ int Application::run() {
 
     if (!m_legacyMode) {
       m_window->render();
-    }
 
-    runEnd = std::chrono::system_clock::now();
-    diff = runEnd - runStart;
-    if (k_verbose && (k_counter % k_counterMod == 0)) {
-      printf("Time to complete run() was %.2f ms.\n", diff.count() * 1000);
+      const auto presentTime = m_window->getPresentTime();
+      if (hasPendingInput && presentTime >= inputTime) {
+        m_inputLatency.record(presentTime - inputTime);
+        hasPendingInput = false;
+      }
     }
-    ++k_counter;
+
+    m_frameLatency.record(std::chrono::steady_clock::now() - runStart);
   }
 
+  printLatencies();
+
   return 0;
 }
+
+void Application::printLatencies() const {
+  m_frameLatency.print("Frame time");
+  if (!m_legacyMode) {
+    m_inputLatency.print("Input to render");
+  }
+  if (m_window->isComputerPlaying()) {
+    m_window->getComputerMoveLatency().print("Computer move");
+  }
+}
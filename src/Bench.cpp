@@ -0,0 +1,112 @@
+#include "Bench.h"
+#include "CommandLine.h"
+#include "Fen.h"
+#include "Uci.h"
+
+namespace {
+
+constexpr int k_defaultDepth = 3;
+
+// Openings, middlegames and endgames, so a change to any part of the search
+// shows up in the total. Don't change these, or old signatures stop matching
+const std::vector<std::string> k_benchPositions = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+    "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1"};
+
+} // namespace
+
+const std::vector<std::string> &getBenchPositions() {
+  return k_benchPositions;
+}
+
+std::vector<BenchResult> runBenchSearches(const SearchLimits &limits,
+                                          int numThreads) {
+  std::vector<BenchResult> results(k_benchPositions.size());
+  std::atomic<size_t> next = 0;
+
+  // Every thread has its own board and computer, so the positions it happens
+  // to get don't change how any of them are searched
+  std::vector<std::thread> workers;
+  for (int i = 0; i < std::max(numThreads, 1); ++i) {
+    workers.emplace_back([&]() {
+      Board board;
+      AI computer(board);
+      LumpedBoardAndGameState state;
+
+      for (size_t index = next++; index < k_benchPositions.size();
+           index = next++) {
+        if (!readFen(k_benchPositions[index], state)) {
+          continue;
+        }
+
+        board.loadFromState(state);
+        computer.setColor(state.whoseTurn);
+        const auto move = computer.search(state.whoseTurn, limits);
+
+        auto &result = results[index];
+        result.nodes = computer.getNodes();
+        if (move.has_value()) {
+          result.bestMove = toUciMove(board, move.value());
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  return results;
+}
+
+int runBench(int argc, char **argv) {
+  if (argumentPassed(argv, argv + argc, "-h")) {
+    std::cout << "Usage: chess bench [--depth <n>] [--nodes <n>] "
+                 "[--threads <n>]"
+              << std::endl;
+    return 1;
+  }
+
+  SearchLimits limits;
+  if (auto nodes = getArgumentValue(argv, argv + argc, "--nodes")) {
+    limits.nodes = std::max<size_t>(1, std::stoull(*nodes));
+  }
+  if (auto depth = getArgumentValue(argv, argv + argc, "--depth")) {
+    limits.depth = std::clamp(std::stoi(*depth), 1, k_maxSearchDepth);
+  } else if (!limits.nodes.has_value()) {
+    limits.depth = k_defaultDepth;
+  }
+
+  const int numThreads = std::max(
+      1, std::stoi(getArgumentValue(argv, argv + argc, "--threads")
+                       .value_or("1")));
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto results = runBenchSearches(limits, numThreads);
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  size_t totalNodes = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    totalNodes += results[i].nodes;
+    printf("Position %2zu/%zu  %-6s %12zu nodes\n", i + 1, results.size(),
+           results[i].bestMove.c_str(), results[i].nodes);
+  }
+
+  printf("Nodes searched  %zu\n", totalNodes);
+  printf("Time            %.0f ms (%d threads)\n", elapsed.count() * 1000,
+         numThreads);
+  printf("Nodes/second    %.0f\n",
+         totalNodes / std::max(elapsed.count(), 1e-9));
+
+  return 0;
+}
@@ -1,42 +1,12 @@
 #include "Board.h"
+#include "EvalTables.h"
+#include "Fen.h"
+#include "Trace.h"
 
 namespace {
 
-const std::string k_pieceImageFilepath = "../chesscpp/inc/pieces.png";
-
 constexpr int k_pawnsPerSide = k_totalPieces / 4;
 
-// Dark green
-constexpr SDL_Color k_evenColor = SDL_Color({118, 150, 86, SDL_ALPHA_OPAQUE});
-// Beige-ish
-constexpr SDL_Color k_oddColor = SDL_Color({238, 238, 210, SDL_ALPHA_OPAQUE});
-// Green
-constexpr SDL_Color k_movementOptionColor = SDL_Color({0, 255, 0, 128});
-// Red
-constexpr SDL_Color k_checkColor = SDL_Color({255, 0, 0, 128});
-// Yellow
-constexpr SDL_Color k_selectedPieceColor = SDL_Color({255, 255, 0, 128});
-// Purple
-constexpr SDL_Color k_blackLastMoveColor = SDL_Color({86, 29, 94, 100});
-// Orange
-constexpr SDL_Color k_whiteLastMoveColor = SDL_Color({244, 128, 55, 100});
-
-constexpr int k_pieceWidth = 105;
-constexpr int k_pieceHeight = 105;
-
-constexpr int k_screenBoxSize = 100;
-constexpr int k_screenBoxOffset = 5;
-
-constexpr int k_xPawnOffset = 529;
-constexpr int k_xRookOffset = 425;
-constexpr int k_xKnightOffset = 317;
-constexpr int k_xBishopOffset = 211;
-constexpr int k_xQueenOffset = 105;
-constexpr int k_xKingOffset = 0;
-constexpr int k_xKingAdditionalOffset = 2;
-
-constexpr int k_xPromotionOffset = 2;
-
 constexpr std::array<Position, 8> k_potentialKnightPositions = {
     {{2, 1}, {2, -1}, {-2, -1}, {-2, 1}, {1, 2}, {1, -2}, {-1, -2}, {-1, 2}}};
 
@@ -45,6 +15,26 @@ std::unique_ptr<T> makePiece(Color color, const Position &position) {
   return std::move(std::make_unique<T>(position, color));
 }
 
+std::unique_ptr<Piece> makePiece(char letter, const Position &position) {
+  const Color color = std::islower(letter) ? Color::black : Color::white;
+  switch (std::tolower(letter)) {
+  case 'p':
+    return makePiece<Pawn>(color, position);
+  case 'n':
+    return makePiece<Knight>(color, position);
+  case 'b':
+    return makePiece<Bishop>(color, position);
+  case 'r':
+    return makePiece<Rook>(color, position);
+  case 'q':
+    return makePiece<Queen>(color, position);
+  case 'k':
+    return makePiece<King>(color, position);
+  default:
+    return nullptr;
+  }
+}
+
 Position getDirectionVector(const Position &start, const Position &end) {
   return {end.first - start.first, end.second - start.second};
 }
@@ -53,21 +43,125 @@ Position getDirectionVector(const Position &start, const Position &end) {
 // https://stackoverflow.com/questions/1903954/is-there-a-standard-sign-function-signum-sgn-in-c-c
 template <typename T> int sign(T val) { return (T(0) < val) - (val < T(0)); }
 
-} // namespace
+// Compact snapshot of the board used for static exchange evaluation
+struct SeeSquare {
+  PieceType type = PieceType::none;
+  Color color = Color::white;
+};
+using SeeBoard = std::array<SeeSquare, k_totalSquares>;
+
+constexpr std::array<Position, 4> k_diagonalDirections = {
+    {{1, 1}, {-1, 1}, {1, -1}, {-1, -1}}};
+constexpr std::array<Position, 4> k_orthogonalDirections = {
+    {{1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
+
+// Indexed by PieceType
+constexpr std::array<int, 7> k_seeValues = {
+    0, k_pawnValue, k_knightValue, k_bishopValue, k_rookValue, k_queenValue,
+    k_kingValue};
+
+inline bool isOnBoard(const Position &position) {
+  return position.first >= 0 && position.first < 8 && position.second >= 0 &&
+         position.second < 8;
+}
 
-Board::~Board() {
-  SDL_DestroyTexture(m_pieceImageTexture);
-  m_pieceImageTexture = NULL;
+inline int toIndex(const Position &position) {
+  return position.second * 8 + position.first;
 }
 
-void Board::loadTextures() {
-  // Load piece image as surface and convert to texture
-  SDL_Surface *pieceImageSurface = IMG_Load(k_pieceImageFilepath.c_str());
-  m_pieceImageTexture =
-      SDL_CreateTextureFromSurface(m_renderer, pieceImageSurface);
-  SDL_FreeSurface(pieceImageSurface);
+int8_t toCompactSquare(const std::optional<Position> &position) {
+  if (!position.has_value() || !isOnBoard(position.value())) {
+    return k_noCompactSquare;
+  }
+  return static_cast<int8_t>(toIndex(position.value()));
+}
+
+std::optional<Position> fromCompactSquare(int8_t square) {
+  if (square < 0 || square >= k_totalSquares) {
+    return std::nullopt;
+  }
+  return Position(square % 8, square / 8);
 }
 
+// Finds the least valuable piece of the given color attacking target. Sliders
+// are found by walking each ray to the first occupied square, so removing a
+// piece from the snapshot uncovers whatever was x-raying through it
+std::optional<Position> getLeastValuableAttacker(const SeeBoard &board,
+                                                 Color color,
+                                                 const Position &target) {
+  std::optional<Position> attacker = std::nullopt;
+  int attackerValue = std::numeric_limits<int>::max();
+
+  auto consider = [&](const Position &position, PieceType type) {
+    if (k_seeValues[static_cast<int>(type)] < attackerValue) {
+      attackerValue = k_seeValues[static_cast<int>(type)];
+      attacker = position;
+    }
+  };
+
+  auto isPiece = [&board](const Position &position, Color color,
+                          PieceType type) {
+    if (!isOnBoard(position)) {
+      return false;
+    }
+    const auto &square = board[toIndex(position)];
+    return square.type == type && square.color == color;
+  };
+
+  // Pawns attack diagonally forwards, so look diagonally backwards
+  const int pawnRow = (color == Color::white) ? -1 : 1;
+  for (int i = -1; i < 2; i += 2) {
+    const Position position = {target.first + i, target.second + pawnRow};
+    if (isPiece(position, color, PieceType::pawn)) {
+      consider(position, PieceType::pawn);
+    }
+  }
+
+  for (const auto &offset : k_potentialKnightPositions) {
+    const Position position = {target.first + offset.first,
+                               target.second + offset.second};
+    if (isPiece(position, color, PieceType::knight)) {
+      consider(position, PieceType::knight);
+    }
+  }
+
+  auto walkRays = [&](const std::array<Position, 4> &directions,
+                      PieceType slider) {
+    for (const auto &direction : directions) {
+      Position position = {target.first + direction.first,
+                           target.second + direction.second};
+      while (isOnBoard(position)) {
+        const auto &square = board[toIndex(position)];
+        if (square.type != PieceType::none) {
+          if (square.color == color &&
+              (square.type == slider || square.type == PieceType::queen)) {
+            consider(position, square.type);
+          }
+          break;
+        }
+        position = {position.first + direction.first,
+                    position.second + direction.second};
+      }
+    }
+  };
+
+  walkRays(k_diagonalDirections, PieceType::bishop);
+  walkRays(k_orthogonalDirections, PieceType::rook);
+
+  for (int i = -1; i < 2; ++i) {
+    for (int j = -1; j < 2; ++j) {
+      const Position position = {target.first + i, target.second + j};
+      if ((i != 0 || j != 0) && isPiece(position, color, PieceType::king)) {
+        consider(position, PieceType::king);
+      }
+    }
+  }
+
+  return attacker;
+}
+
+} // namespace
+
 void Board::loadGame() {
   m_pieces.clear();
   m_pieces.resize(2);
@@ -104,6 +198,9 @@ void Board::loadGame() {
   m_pawnMovedOrPieceCaptured = false;
   m_fiftyMoveRuleCount = 0;
   m_castleStatus.set();
+  m_enPassantStatus.reset();
+  m_pawnToPromote.reset();
+  m_lastMoves = {};
 }
 
 void Board::loadFromState(const LumpedBoardAndGameState &state) {
@@ -140,210 +237,126 @@ void Board::loadFromState(const LumpedBoardAndGameState &state) {
 
   m_castleStatus = state.castleStatus;
   m_enPassantStatus = state.enPassantStatus;
+  m_pawnToPromote.reset();
+  m_lastMoves = {};
 
   m_fiftyMoveRuleCount = state.halfMoveNum;
 
   refreshValidMoves();
 }
 
-void Board::cliDisplay(Color color) {
-  auto innerLoop = [this](int i) {
-    for (int j = 0; j < 8; ++j) {
-      const auto *piece = getPieceAt({j, i});
-      if (!piece) {
-        std::cout << ".";
-      } else {
-        std::cout << piece->getLetter();
-      }
-
-      if (j == 7) {
-        std::cout << std::endl;
-      }
-    }
-  };
+Board::Board(const Board &other) { *this = other; }
 
-  if (color == Color::white) {
-    for (int i = 7; i >= 0; --i) {
-      innerLoop(i);
-    }
-  } else {
-    for (int i = 0; i < 8; ++i) {
-      innerLoop(i);
-    }
+Board &Board::operator=(const Board &other) {
+  if (this == &other) {
+    return *this;
   }
-}
 
-void Board::sdlDisplay(Color color) {
-  // Handle displaying the board from the active player's perspective
-  int verticalOffset = 0;
-
-  if (color == Color::white) {
-    verticalOffset = 7;
-  }
+  m_pieces.resize(other.m_pieces.size());
+  for (size_t i = 0; i < m_pieces.size(); ++i) {
+    auto &pieces = m_pieces[i];
+    const auto &otherPieces = other.m_pieces[i];
+    pieces.resize(otherPieces.size());
+
+    for (size_t j = 0; j < pieces.size(); ++j) {
+      const auto *otherPiece = otherPieces[j].get();
+      if (!otherPiece) {
+        pieces[j].reset();
+        continue;
+      }
 
-  // Render board squares
-  for (int i = 0; i < 8; ++i) {
-    for (int j = 0; j < 8; ++j) {
-      ((i + j) % 2 == 0)
-          ? sdlDrawSquare({std::abs(verticalOffset - j), i}, k_evenColor)
-          : sdlDrawSquare({std::abs(verticalOffset - j), i}, k_oddColor);
+      if (!pieces[j] || pieces[j]->getLetter() != otherPiece->getLetter()) {
+        pieces[j] =
+            makePiece(otherPiece->getLetter(), otherPiece->getPosition());
+      }
+      pieces[j]->copyState(*otherPiece);
     }
   }
 
-  // Highlight piece that was clicked, if any
-  if (m_pieceToHighlight.has_value()) {
-    const auto &position = m_pieceToHighlight.value();
-    sdlDrawSquare({position.first, std::abs(verticalOffset - position.second)},
-                  k_selectedPieceColor);
-  }
-
-  // Highlight last black piece that moved
-  if (m_blackLastMoveHighlight.has_value()) {
-    const auto &position = m_blackLastMoveHighlight.value();
-    sdlDrawSquare({position.first, std::abs(verticalOffset - position.second)},
-                  k_blackLastMoveColor);
-  }
+  m_boardAndGameState = other.m_boardAndGameState;
+  m_allValidMoves = other.m_allValidMoves;
+  m_lastMoves = other.m_lastMoves;
+  m_castleStatus = other.m_castleStatus;
+  m_enPassantStatus = other.m_enPassantStatus;
+  m_pawnToPromote = other.m_pawnToPromote;
+  m_isComputerPlaying = other.m_isComputerPlaying;
+  m_pawnMovedOrPieceCaptured = other.m_pawnMovedOrPieceCaptured;
+  m_fiftyMoveRuleCount = other.m_fiftyMoveRuleCount;
 
-  // Highlight last white piece that moved
-  if (m_whiteLastMoveHighlight.has_value()) {
-    const auto &position = m_whiteLastMoveHighlight.value();
-    sdlDrawSquare({position.first, std::abs(verticalOffset - position.second)},
-                  k_whiteLastMoveColor);
-  }
+  return *this;
+}
 
-  // Highlight valid moves for piece that was clicked, if any
-  for (size_t i = 0; i < m_movesToHighlight.size(); ++i) {
-    const auto &position = m_movesToHighlight[i];
-    sdlDrawSquare({position.first, std::abs(verticalOffset - position.second)},
-                  k_movementOptionColor);
-  }
+void Board::loadFromCompactState(const CompactBoardState &state) {
+  m_pieces.resize(2);
+  std::array<size_t, 2> counts = {};
 
-  // Highlights king's square with a warning color if in check
-  if (m_kingToHighlight.has_value()) {
-    const auto &position = m_kingToHighlight.value();
-    sdlDrawSquare({position.first, std::abs(verticalOffset - position.second)},
-                  k_checkColor);
-  }
+  // Same order as loadFromState(), so searches come out the same either way
+  for (const char letter : {'p', 'r', 'n', 'b', 'q', 'k'}) {
+    for (int i = 0; i < k_totalSquares; ++i) {
+      const char square = state.squares[i];
+      if (std::tolower(square) != letter) {
+        continue;
+      }
 
-  // Render all pieces
-  for (auto &side : m_pieces) {
-    for (auto &piece : side) {
-      sdlDrawPiece(color, piece.get(), verticalOffset);
+      const Position position = {i % 8, i / 8};
+      const Color color = std::islower(square) ? Color::black : Color::white;
+      const auto side = static_cast<size_t>(color);
+      auto &pieces = m_pieces[side];
+      const size_t slot = counts[side]++;
+      if (slot == pieces.size()) {
+        pieces.emplace_back(makePiece(square, position));
+      } else if (pieces[slot] && pieces[slot]->getLetter() == square) {
+        pieces[slot]->reset(position);
+      } else {
+        pieces[slot] = makePiece(square, position);
+      }
     }
   }
-}
+  m_pieces[0].resize(counts[0]);
+  m_pieces[1].resize(counts[1]);
 
-void Board::sdlDrawSquare(const Position &position,
-                          const SDL_Color &sdlColor) const {
-  SDL_Rect square;
-  square.w = k_squareWidth;
-  square.h = k_squareHeight;
-  SDL_SetRenderDrawColor(m_renderer, sdlColor.r, sdlColor.g, sdlColor.b,
-                         sdlColor.a);
-
-  square.x = position.first * k_squareWidth;
-  square.y = position.second * k_squareHeight;
-  SDL_RenderFillRect(m_renderer, &square);
-}
+  m_castleStatus = CastleStatus(state.castleStatus);
 
-void Board::sdlDrawPiece(Color color, const Piece *piece,
-                         int verticalOffset) const {
-  RETURN_IF_NULL(piece);
-
-  int pieceXOffset = 0;
-  int pieceYOffset = 0;
-  int screenXOffset = 0;
-
-  if (piece->getColor() == Color::black) {
-    // Black is in top half of image
-    pieceYOffset += k_pieceHeight;
-  }
-
-  if (dynamic_cast<const Pawn *>(piece)) {
-    pieceXOffset += k_xPawnOffset;
-  } else if (dynamic_cast<const Knight *>(piece)) {
-    pieceXOffset += k_xKnightOffset;
-  } else if (dynamic_cast<const Bishop *>(piece)) {
-    pieceXOffset += k_xBishopOffset;
-  } else if (dynamic_cast<const Rook *>(piece)) {
-    pieceXOffset += k_xRookOffset;
-  } else if (dynamic_cast<const Queen *>(piece)) {
-    pieceXOffset += k_xQueenOffset;
-  } else if (dynamic_cast<const King *>(piece)) {
-    pieceXOffset += k_xKingOffset;
-    screenXOffset += k_xKingAdditionalOffset;
-  } else {
-    // Type ???
-    return;
+  m_enPassantStatus.reset();
+  if (const auto square = fromCompactSquare(state.enPassantSquare)) {
+    // White pawns leave it on the third rank
+    const Color color = (square->second == 2) ? Color::white : Color::black;
+    m_enPassantStatus = {color, square.value()};
   }
 
-  const Position position = piece->getPosition();
+  m_pawnToPromote = fromCompactSquare(state.pawnToPromote);
+  m_lastMoves = {fromCompactSquare(state.lastMoves[0]),
+                 fromCompactSquare(state.lastMoves[1])};
 
-  SDL_Rect pieceBox = {.x = pieceXOffset,
-                       .y = pieceYOffset,
-                       .w = k_pieceWidth,
-                       .h = k_pieceHeight};
-
-  SDL_Rect screenBox = {
-      .x = (position.first * k_screenBoxSize) - k_screenBoxOffset +
-           screenXOffset,
-      .y = (std::abs(verticalOffset - position.second) * k_screenBoxSize) -
-           k_screenBoxOffset,
-      .w = k_pieceWidth,
-      .h = k_pieceHeight};
+  m_fiftyMoveRuleCount = state.halfMoveNum;
 
-  SDL_RenderCopy(m_renderer, m_pieceImageTexture, &pieceBox, &screenBox);
+  m_allValidMoves.clear();
 }
 
-void Board::sdlDisplayPromotionOptions(Color color) const {
-  int verticalOffset = 0;
-
-  if (color == Color::white) {
-    verticalOffset = 7;
-  }
-
-  // Draw board
-  for (int i = 0; i < 8; ++i) {
+void Board::cliDisplay(Color color) {
+  auto innerLoop = [this](int i) {
     for (int j = 0; j < 8; ++j) {
-      ((i + j) % 2 == 0)
-          ? sdlDrawSquare({std::abs(verticalOffset - j), i}, k_evenColor)
-          : sdlDrawSquare({std::abs(verticalOffset - j), i}, k_oddColor);
+      const auto *piece = getPieceAt({j, i});
+      if (!piece) {
+        std::cout << ".";
+      } else {
+        std::cout << piece->getLetter();
+      }
+
+      if (j == 7) {
+        std::cout << std::endl;
+      }
     }
-  }
+  };
 
-  int allPiecesYOffset = 0;
-
-  if (color == Color::black) {
-    // Black is in top half of image
-    allPiecesYOffset += k_pieceHeight;
-  }
-
-  std::array<SDL_Rect, 4> pieceBoxes = {SDL_Rect({.x = k_xKnightOffset,
-                                                  .y = allPiecesYOffset,
-                                                  .w = k_pieceWidth,
-                                                  .h = k_pieceHeight}),
-                                        SDL_Rect({.x = k_xBishopOffset,
-                                                  .y = allPiecesYOffset,
-                                                  .w = k_pieceWidth,
-                                                  .h = k_pieceHeight}),
-                                        SDL_Rect({.x = k_xRookOffset,
-                                                  .y = allPiecesYOffset,
-                                                  .w = k_pieceWidth,
-                                                  .h = k_pieceHeight}),
-                                        SDL_Rect({.x = k_xQueenOffset,
-                                                  .y = allPiecesYOffset,
-                                                  .w = k_pieceWidth,
-                                                  .h = k_pieceHeight})};
-
-  for (size_t i = 0; i < pieceBoxes.size(); ++i) {
-    SDL_Rect screenBox = {
-        .x = (static_cast<int>(k_xPromotionOffset + i) * k_screenBoxSize) -
-             k_screenBoxOffset,
-        .y = -k_screenBoxOffset,
-        .w = k_pieceWidth,
-        .h = k_pieceHeight};
-
-    SDL_RenderCopy(m_renderer, m_pieceImageTexture, &pieceBoxes[i], &screenBox);
+  if (color == Color::white) {
+    for (int i = 7; i >= 0; --i) {
+      innerLoop(i);
+    }
+  } else {
+    for (int i = 0; i < 8; ++i) {
+      innerLoop(i);
+    }
   }
 }
 
@@ -361,6 +374,22 @@ Piece *Board::getPieceAt(const Position &position) {
   return nullptr;
 }
 
+int Board::getPieceCount() const {
+  int count = 0;
+  for (const auto &side : m_pieces) {
+    for (const auto &piece : side) {
+      CONTINUE_IF_NULL(piece);
+      // Pieces captured during search are parked off the board
+      if (piece->getPosition().first >= 0 &&
+          piece->getPosition().second >= 0) {
+        ++count;
+      }
+    }
+  }
+
+  return count;
+}
+
 std::pair<size_t, size_t> Board::getIndexOfPiece(const Piece *piece) {
   for (size_t i = 0; i < m_pieces.size(); ++i) {
     for (size_t j = 0; j < m_pieces[i].size(); ++j) {
@@ -1132,8 +1161,6 @@ bool Board::isKingCheckmated(Color color) {
   if (isKingInCheck(color)) {
     if (std::find_if(m_allValidMoves.begin(), m_allValidMoves.end(),
                      checkForColor) == m_allValidMoves.end()) {
-      // Highlight now because render stops being called after game over
-      highlightKingInCheck(color);
       return true;
     }
   }
@@ -1250,12 +1277,8 @@ void Board::updateBoardState(const Position &start, const Position &end) {
 
   Color color = pieceThatMoved->getColor();
 
-  // Clear last move highlight for that color and set to the piece's new position
-  if (color == Color::black) {
-    m_blackLastMoveHighlight = pieceThatMoved->getPosition();
-  } else {
-    m_whiteLastMoveHighlight = pieceThatMoved->getPosition();
-  }
+  // Remembered for the renderer
+  m_lastMoves[static_cast<size_t>(color)] = pieceThatMoved->getPosition();
 
   // Handle special events
   if (dynamic_cast<const Pawn *>(pieceThatMoved)) {
@@ -1285,17 +1308,32 @@ void Board::updateBoardState(const Position &start, const Position &end) {
     if (color == Color::white && start == Position({0, 0})) {
       m_castleStatus[k_whiteQueensideIndex] = 0;
     } else if (color == Color::white && start == Position({7, 0})) {
-      m_castleStatus[k_whiteQueensideIndex] = 0;
+      m_castleStatus[k_whiteKingsideIndex] = 0;
     } else if (color == Color::black && start == Position({0, 7})) {
       m_castleStatus[k_blackQueensideIndex] = 0;
     } else if (color == Color::black && start == Position({7, 7})) {
       m_castleStatus[k_blackKingsideIndex] = 0;
     }
   }
+}
+
+bool Board::applyMove(Color color, const Position &start, const Position &end,
+                      PieceType promotion) {
+  // Castling and en passant are carried out in here
+  if (!isValidMove(color, start, end, false)) {
+    return false;
+  }
+
+  movePiece(start, end);
+  updateBoardState(start, end);
+
+  if (pawnToPromote()) {
+    promotePawn(promotion == PieceType::none ? PieceType::queen : promotion);
+  }
+
+  refreshValidMoves();
 
-  // Clear storage for moves to highlight
-  clearOldPieceHighlight();
-  clearOldKingHighlight();
+  return true;
 }
 
 bool Board::isInputValid(Color color, const std::queue<Position> &positions) {
@@ -1319,39 +1357,6 @@ bool Board::isInputValid(Color color, const std::queue<Position> &positions) {
   return true;
 }
 
-void Board::highlightPotentialMoves(const Position &position) {
-  // Clear storage containers first
-  clearOldPieceHighlight();
-
-  const auto *pieceToHighlight = getPieceAt(position);
-
-  RETURN_IF_NULL(pieceToHighlight);
-
-  m_pieceToHighlight = pieceToHighlight->getPosition();
-
-  const auto &validMoves = pieceToHighlight->getValidMoves();
-
-  if (validMoves.size() < 1) {
-    // No possible moves
-    return;
-  }
-
-  for (size_t i = 0; i < validMoves.size(); ++i) {
-    m_movesToHighlight.emplace_back(validMoves[i]);
-  }
-}
-
-void Board::highlightKingInCheck(Color color) {
-  const auto *king = getKingFromColor(color);
-
-  if (!king) {
-    // Should never happen
-    return;
-  }
-
-  m_kingToHighlight = king->getPosition();
-}
-
 const std::vector<FullMove> Board::getValidMovesFor(Color color) const {
   std::vector<FullMove> toReturn = {};
   for (const auto &move : m_allValidMoves) {
@@ -1364,6 +1369,7 @@ const std::vector<FullMove> Board::getValidMovesFor(Color color) const {
 }
 
 void Board::refreshValidMoves() {
+  TRACE_SCOPE("Board::refreshValidMoves");
   m_allValidMoves.clear();
   for (auto &side : m_pieces) {
     for (auto &piece : side) {
@@ -1414,6 +1420,52 @@ Board::getBoardAndGameState(Color color, size_t halfMoveNum, size_t turnNum) {
   return m_boardAndGameState;
 }
 
+CompactBoardState Board::getCompactState(Color color, size_t turnNum) const {
+  CompactBoardState state;
+  for (const auto &side : m_pieces) {
+    for (const auto &piece : side) {
+      CONTINUE_IF_NULL(piece);
+      const auto &position = piece->getPosition();
+      // Pieces captured during search are parked off the board
+      if (isOnBoard(position)) {
+        state.squares[toIndex(position)] = piece->getLetter();
+      }
+    }
+  }
+
+  state.castleStatus = static_cast<uint8_t>(m_castleStatus.to_ulong());
+  if (m_enPassantStatus.has_value()) {
+    state.enPassantSquare = toCompactSquare(m_enPassantStatus->second);
+  }
+  state.pawnToPromote = toCompactSquare(m_pawnToPromote);
+  state.lastMoves = {toCompactSquare(m_lastMoves[0]),
+                     toCompactSquare(m_lastMoves[1])};
+
+  state.whoseTurn = color;
+  state.halfMoveNum = static_cast<uint16_t>(
+      std::min<size_t>(m_fiftyMoveRuleCount, UINT16_MAX));
+  state.turnNum = static_cast<uint16_t>(std::min<size_t>(turnNum, UINT16_MAX));
+  return state;
+}
+
+size_t Board::toFen(Color whoseTurn, size_t moveNumber, char *buffer,
+                    size_t size) const {
+  FenBoard board = {};
+  for (const auto &side : m_pieces) {
+    for (const auto &piece : side) {
+      CONTINUE_IF_NULL(piece);
+      const auto &position = piece->getPosition();
+      // Pieces captured during search are parked off the board
+      if (position.first >= 0 && position.second >= 0) {
+        board[position.second * 8 + position.first] = piece->getLetter();
+      }
+    }
+  }
+
+  return writeFen(board, whoseTurn, m_castleStatus, m_enPassantStatus,
+                  m_fiftyMoveRuleCount, moveNumber, buffer, size);
+}
+
 const Piece *Board::getKingFromColor(Color color) const {
   Piece *king = nullptr;
 
@@ -1464,6 +1516,63 @@ void Board::undoMove(const Position &start, const Position &end, int depth) {
   pieceToMove->setPosition(start);
 }
 
+int Board::see(const Position &start, const Position &end) {
+  const auto *pieceToMove = getPieceAt(start);
+  if (!pieceToMove || !isOnBoard(end)) {
+    return 0;
+  }
+
+  SeeBoard board = {};
+  for (const auto &side : m_pieces) {
+    for (const auto &piece : side) {
+      CONTINUE_IF_NULL(piece);
+      if (isOnBoard(piece->getPosition())) {
+        board[toIndex(piece->getPosition())] = {piece->getType(),
+                                                piece->getColor()};
+      }
+    }
+  }
+
+  // gain[i] is the best the side making the i-th capture can hope for
+  std::array<int, k_totalPieces + 1> gain = {};
+  int depth = 0;
+
+  PieceType attackerType = pieceToMove->getType();
+  Color color = pieceToMove->getColor();
+  gain[0] = k_seeValues[static_cast<int>(board[toIndex(end)].type)];
+
+  // En passant captures a pawn that isn't on the target square
+  if (attackerType == PieceType::pawn && start.first != end.first &&
+      board[toIndex(end)].type == PieceType::none) {
+    gain[0] = k_pawnValue;
+    board[toIndex({end.first, start.second})] = {};
+  }
+
+  board[toIndex(start)] = {};
+
+  while (true) {
+    ++depth;
+    color = getOtherColor(color);
+    // Speculatively assume the last piece to move gets taken
+    gain[depth] = k_seeValues[static_cast<int>(attackerType)] - gain[depth - 1];
+
+    const auto attacker = getLeastValuableAttacker(board, color, end);
+    if (!attacker.has_value()) {
+      break;
+    }
+
+    attackerType = board[toIndex(attacker.value())].type;
+    board[toIndex(attacker.value())] = {};
+  }
+
+  // Each side can decline to recapture, so roll the sequence back up
+  while (--depth) {
+    gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+  }
+
+  return gain[0];
+}
+
 bool Board::checkForDeadPosition() const {
   auto onlyKingLeft = [this](Color color) {
     int sideIndex = 0;
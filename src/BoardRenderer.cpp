@@ -0,0 +1,283 @@
+#include "BoardRenderer.h"
+
+namespace {
+
+const std::string k_pieceImageFilepath = "../chesscpp/inc/pieces.png";
+
+// Dark green
+constexpr SDL_Color k_evenColor = SDL_Color({118, 150, 86, SDL_ALPHA_OPAQUE});
+// Beige-ish
+constexpr SDL_Color k_oddColor = SDL_Color({238, 238, 210, SDL_ALPHA_OPAQUE});
+// Green
+constexpr SDL_Color k_movementOptionColor = SDL_Color({0, 255, 0, 128});
+// Red
+constexpr SDL_Color k_checkColor = SDL_Color({255, 0, 0, 128});
+// Yellow
+constexpr SDL_Color k_selectedPieceColor = SDL_Color({255, 255, 0, 128});
+// Purple
+constexpr SDL_Color k_blackLastMoveColor = SDL_Color({86, 29, 94, 100});
+// Orange
+constexpr SDL_Color k_whiteLastMoveColor = SDL_Color({244, 128, 55, 100});
+// Blue, for the best analysis line. Later lines are fainter
+constexpr SDL_Color k_analysisColor = SDL_Color({30, 144, 255, 160});
+
+constexpr int k_pieceWidth = 105;
+constexpr int k_pieceHeight = 105;
+
+constexpr int k_screenBoxSize = 100;
+constexpr int k_screenBoxOffset = 5;
+
+constexpr int k_xPawnOffset = 529;
+constexpr int k_xRookOffset = 425;
+constexpr int k_xKnightOffset = 317;
+constexpr int k_xBishopOffset = 211;
+constexpr int k_xQueenOffset = 105;
+constexpr int k_xKingOffset = 0;
+constexpr int k_xKingAdditionalOffset = 2;
+
+constexpr int k_xPromotionOffset = 2;
+
+// Board::getPieceAt() without needing the board to be mutable
+const Piece *findPiece(const Board &board, const Position &position) {
+  for (const auto &side : board.getPieces()) {
+    for (const auto &piece : side) {
+      if (piece && piece->getPosition() == position) {
+        return piece.get();
+      }
+    }
+  }
+
+  return nullptr;
+}
+
+} // namespace
+
+BoardRenderer::~BoardRenderer() {
+  SDL_DestroyTexture(m_pieceImageTexture);
+  m_pieceImageTexture = NULL;
+}
+
+void BoardRenderer::loadTextures() {
+  // Load piece image as surface and convert to texture
+  SDL_Surface *pieceImageSurface = IMG_Load(k_pieceImageFilepath.c_str());
+  m_pieceImageTexture =
+      SDL_CreateTextureFromSurface(m_renderer, pieceImageSurface);
+  SDL_FreeSurface(pieceImageSurface);
+}
+
+void BoardRenderer::display(Color color) {
+  // Handle displaying the board from the active player's perspective
+  int verticalOffset = 0;
+
+  if (color == Color::white) {
+    verticalOffset = 7;
+  }
+
+  // Render board squares
+  for (int i = 0; i < 8; ++i) {
+    for (int j = 0; j < 8; ++j) {
+      ((i + j) % 2 == 0)
+          ? drawSquare({std::abs(verticalOffset - j), i}, k_evenColor)
+          : drawSquare({std::abs(verticalOffset - j), i}, k_oddColor);
+    }
+  }
+
+  // Highlight piece that was clicked, if any
+  if (m_pieceToHighlight.has_value()) {
+    const auto &position = m_pieceToHighlight.value();
+    drawSquare({position.first, std::abs(verticalOffset - position.second)},
+               k_selectedPieceColor);
+  }
+
+  // Highlight last black piece that moved
+  if (const auto position = m_board.getLastMove(Color::black)) {
+    drawSquare({position->first, std::abs(verticalOffset - position->second)},
+               k_blackLastMoveColor);
+  }
+
+  // Highlight last white piece that moved
+  if (const auto position = m_board.getLastMove(Color::white)) {
+    drawSquare({position->first, std::abs(verticalOffset - position->second)},
+               k_whiteLastMoveColor);
+  }
+
+  // Highlight the best moves from analysis, if any
+  for (size_t i = 0; i < m_analysisMovesToHighlight.size(); ++i) {
+    SDL_Color analysisColor = k_analysisColor;
+    analysisColor.a /= (i + 1);
+
+    for (const auto &position : {m_analysisMovesToHighlight[i].first,
+                                 m_analysisMovesToHighlight[i].second}) {
+      drawSquare({position.first, std::abs(verticalOffset - position.second)},
+                 analysisColor);
+    }
+  }
+
+  // Highlight valid moves for piece that was clicked, if any
+  for (size_t i = 0; i < m_movesToHighlight.size(); ++i) {
+    const auto &position = m_movesToHighlight[i];
+    drawSquare({position.first, std::abs(verticalOffset - position.second)},
+               k_movementOptionColor);
+  }
+
+  // Highlights king's square with a warning color if in check
+  if (m_kingToHighlight.has_value()) {
+    const auto &position = m_kingToHighlight.value();
+    drawSquare({position.first, std::abs(verticalOffset - position.second)},
+               k_checkColor);
+  }
+
+  // Render all pieces
+  for (const auto &side : m_board.getPieces()) {
+    for (const auto &piece : side) {
+      drawPiece(color, piece.get(), verticalOffset);
+    }
+  }
+}
+
+void BoardRenderer::drawSquare(const Position &position,
+                               const SDL_Color &sdlColor) const {
+  SDL_Rect square;
+  square.w = k_squareWidth;
+  square.h = k_squareHeight;
+  SDL_SetRenderDrawColor(m_renderer, sdlColor.r, sdlColor.g, sdlColor.b,
+                         sdlColor.a);
+
+  square.x = position.first * k_squareWidth;
+  square.y = position.second * k_squareHeight;
+  SDL_RenderFillRect(m_renderer, &square);
+}
+
+void BoardRenderer::drawPiece(Color color, const Piece *piece,
+                              int verticalOffset) const {
+  RETURN_IF_NULL(piece);
+
+  int pieceXOffset = 0;
+  int pieceYOffset = 0;
+  int screenXOffset = 0;
+
+  if (piece->getColor() == Color::black) {
+    // Black is in top half of image
+    pieceYOffset += k_pieceHeight;
+  }
+
+  if (dynamic_cast<const Pawn *>(piece)) {
+    pieceXOffset += k_xPawnOffset;
+  } else if (dynamic_cast<const Knight *>(piece)) {
+    pieceXOffset += k_xKnightOffset;
+  } else if (dynamic_cast<const Bishop *>(piece)) {
+    pieceXOffset += k_xBishopOffset;
+  } else if (dynamic_cast<const Rook *>(piece)) {
+    pieceXOffset += k_xRookOffset;
+  } else if (dynamic_cast<const Queen *>(piece)) {
+    pieceXOffset += k_xQueenOffset;
+  } else if (dynamic_cast<const King *>(piece)) {
+    pieceXOffset += k_xKingOffset;
+    screenXOffset += k_xKingAdditionalOffset;
+  } else {
+    // Type ???
+    return;
+  }
+
+  const Position position = piece->getPosition();
+
+  SDL_Rect pieceBox = {.x = pieceXOffset,
+                       .y = pieceYOffset,
+                       .w = k_pieceWidth,
+                       .h = k_pieceHeight};
+
+  SDL_Rect screenBox = {
+      .x = (position.first * k_screenBoxSize) - k_screenBoxOffset +
+           screenXOffset,
+      .y = (std::abs(verticalOffset - position.second) * k_screenBoxSize) -
+           k_screenBoxOffset,
+      .w = k_pieceWidth,
+      .h = k_pieceHeight};
+
+  SDL_RenderCopy(m_renderer, m_pieceImageTexture, &pieceBox, &screenBox);
+}
+
+void BoardRenderer::displayPromotionOptions(Color color) const {
+  int verticalOffset = 0;
+
+  if (color == Color::white) {
+    verticalOffset = 7;
+  }
+
+  // Draw board
+  for (int i = 0; i < 8; ++i) {
+    for (int j = 0; j < 8; ++j) {
+      ((i + j) % 2 == 0)
+          ? drawSquare({std::abs(verticalOffset - j), i}, k_evenColor)
+          : drawSquare({std::abs(verticalOffset - j), i}, k_oddColor);
+    }
+  }
+
+  int allPiecesYOffset = 0;
+
+  if (color == Color::black) {
+    // Black is in top half of image
+    allPiecesYOffset += k_pieceHeight;
+  }
+
+  std::array<SDL_Rect, 4> pieceBoxes = {SDL_Rect({.x = k_xKnightOffset,
+                                                  .y = allPiecesYOffset,
+                                                  .w = k_pieceWidth,
+                                                  .h = k_pieceHeight}),
+                                        SDL_Rect({.x = k_xBishopOffset,
+                                                  .y = allPiecesYOffset,
+                                                  .w = k_pieceWidth,
+                                                  .h = k_pieceHeight}),
+                                        SDL_Rect({.x = k_xRookOffset,
+                                                  .y = allPiecesYOffset,
+                                                  .w = k_pieceWidth,
+                                                  .h = k_pieceHeight}),
+                                        SDL_Rect({.x = k_xQueenOffset,
+                                                  .y = allPiecesYOffset,
+                                                  .w = k_pieceWidth,
+                                                  .h = k_pieceHeight})};
+
+  for (size_t i = 0; i < pieceBoxes.size(); ++i) {
+    SDL_Rect screenBox = {
+        .x = (static_cast<int>(k_xPromotionOffset + i) * k_screenBoxSize) -
+             k_screenBoxOffset,
+        .y = -k_screenBoxOffset,
+        .w = k_pieceWidth,
+        .h = k_pieceHeight};
+
+    SDL_RenderCopy(m_renderer, m_pieceImageTexture, &pieceBoxes[i], &screenBox);
+  }
+}
+
+void BoardRenderer::highlightPotentialMoves(const Position &position) {
+  // Clear storage containers first
+  clearOldPieceHighlight();
+
+  const auto *pieceToHighlight = findPiece(m_board, position);
+
+  RETURN_IF_NULL(pieceToHighlight);
+
+  m_pieceToHighlight = pieceToHighlight->getPosition();
+
+  const auto &validMoves = pieceToHighlight->getValidMoves();
+
+  if (validMoves.size() < 1) {
+    // No possible moves
+    return;
+  }
+
+  for (size_t i = 0; i < validMoves.size(); ++i) {
+    m_movesToHighlight.emplace_back(validMoves[i]);
+  }
+}
+
+void BoardRenderer::highlightKingInCheck(Color color) {
+  const auto *king = m_board.getKingFromColor(color);
+
+  if (!king) {
+    // Should never happen
+    return;
+  }
+
+  m_kingToHighlight = king->getPosition();
+}
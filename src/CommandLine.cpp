@@ -0,0 +1,43 @@
+#include "CommandLine.h"
+
+#include <charconv>
+
+bool argumentPassed(char **start, char **end, const std::string &toFind) {
+  return std::find(start, end, toFind) != end;
+}
+
+std::optional<std::string> getArgumentValue(char **start, char **end,
+                                            const std::string &toFind) {
+  char **it = std::find(start, end, toFind);
+  if (it == end || it + 1 == end) {
+    return std::nullopt;
+  }
+
+  return std::string(*(it + 1));
+}
+
+std::optional<long long> parseNumber(const std::string &value) {
+  long long number = 0;
+  const char *end = value.data() + value.size();
+  const auto [last, error] = std::from_chars(value.data(), end, number);
+  if (error != std::errc() || last != end) {
+    return std::nullopt;
+  }
+  return number;
+}
+
+std::vector<std::string>
+getInputFilenames(int argc, char **argv,
+                  const std::vector<std::string> &valueOptions) {
+  std::vector<std::string> filenames;
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+    if (std::find(valueOptions.begin(), valueOptions.end(), argument) !=
+        valueOptions.end()) {
+      ++i;
+    } else if (argument.rfind("--", 0) != 0) {
+      filenames.push_back(argument);
+    }
+  }
+  return filenames;
+}
@@ -0,0 +1,662 @@
+#include "EngineServer.h"
+#include "Fen.h"
+#include "Uci.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// epoll ids, clients are numbered after these
+constexpr uint64_t k_listenId = 0;
+constexpr uint64_t k_wakeId = 1;
+constexpr uint64_t k_firstClientId = 2;
+
+constexpr int k_maxEvents = 256;
+constexpr size_t k_readSize = 1 << 14;
+
+// Anything longer isn't a request, so the client gets dropped
+constexpr size_t k_maxLineLength = 1 << 16;
+
+// Searches that don't say how long they can take
+constexpr int k_defaultDepth = 3;
+
+using Request = std::unordered_map<std::string, std::string>;
+
+// Flat objects of strings, numbers, booleans and null, which is all the
+// protocol needs. Values other than strings are kept as they were written
+bool parseRequest(std::string_view line, Request &request) {
+  request.clear();
+  size_t i = 0;
+
+  auto skipSpace = [&]() {
+    while (i < line.size() && std::isspace(static_cast<uint8_t>(line[i]))) {
+      ++i;
+    }
+  };
+
+  auto parseString = [&](std::string &out) {
+    if (i >= line.size() || line[i] != '"') {
+      return false;
+    }
+
+    for (++i; i < line.size(); ++i) {
+      char c = line[i];
+      if (c == '"') {
+        ++i;
+        return true;
+      }
+      if (c == '\\') {
+        if (++i >= line.size()) {
+          return false;
+        }
+        c = line[i];
+        if (c == 'n') {
+          c = '\n';
+        } else if (c == 't') {
+          c = '\t';
+        } else if (c != '"' && c != '\\' && c != '/') {
+          return false;
+        }
+      }
+      out += c;
+    }
+    return false;
+  };
+
+  skipSpace();
+  if (i >= line.size() || line[i] != '{') {
+    return false;
+  }
+  ++i;
+  skipSpace();
+
+  if (i < line.size() && line[i] == '}') {
+    ++i;
+  } else {
+    while (true) {
+      std::string key;
+      std::string value;
+
+      skipSpace();
+      if (!parseString(key)) {
+        return false;
+      }
+      skipSpace();
+      if (i >= line.size() || line[i] != ':') {
+        return false;
+      }
+      ++i;
+      skipSpace();
+
+      if (i < line.size() && line[i] == '"') {
+        if (!parseString(value)) {
+          return false;
+        }
+      } else {
+        const size_t start = i;
+        while (i < line.size() && line[i] != ',' && line[i] != '}' &&
+               !std::isspace(static_cast<uint8_t>(line[i]))) {
+          ++i;
+        }
+        value = line.substr(start, i - start);
+        if (value.empty()) {
+          return false;
+        }
+      }
+      request[key] = value;
+
+      skipSpace();
+      if (i < line.size() && line[i] == ',') {
+        ++i;
+      } else if (i < line.size() && line[i] == '}') {
+        ++i;
+        break;
+      } else {
+        return false;
+      }
+    }
+  }
+
+  skipSpace();
+  return i == line.size();
+}
+
+std::optional<long long> getNumber(const Request &request,
+                                   const std::string &key) {
+  const auto it = request.find(key);
+  if (it == request.end() || it->second.empty()) {
+    return std::nullopt;
+  }
+
+  char *end = nullptr;
+  const long long value = std::strtoll(it->second.c_str(), &end, 10);
+  if (*end != '\0') {
+    return std::nullopt;
+  }
+  return value;
+}
+
+void appendString(std::string_view value, std::string &out) {
+  out += '"';
+  for (const char c : value) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      // Control characters aren't allowed in JSON strings as they are
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x",
+                    static_cast<unsigned char>(c));
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+std::string getFen(Board &board, Color color, size_t ply) {
+  char fen[k_maxFenLength];
+  board.toFen(color, ply / 2 + 1, fen, sizeof(fen));
+  return fen;
+}
+
+std::string getStatus(Board &board, Color color) {
+  if (!board.getValidMovesFor(color).empty()) {
+    return "playing";
+  }
+  return board.isKingInCheck(color) ? "checkmate" : "stalemate";
+}
+
+} // namespace
+
+EngineServer::EngineServer(size_t numWorkers)
+    : m_nextClientId(k_firstClientId) {
+  m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+  m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = k_wakeId;
+  epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event);
+
+  for (size_t i = 0; i < std::max<size_t>(numWorkers, 1); ++i) {
+    m_workers.emplace_back(&EngineServer::work, this);
+  }
+}
+
+EngineServer::~EngineServer() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_isShuttingDown = true;
+    for (auto &[id, game] : m_games) {
+      game->stop = true;
+    }
+  }
+  m_jobCondition.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+
+  for (auto &[id, client] : m_clients) {
+    close(client.fd);
+  }
+  if (m_listenFd >= 0) {
+    close(m_listenFd);
+    unlink(m_socketPath.c_str());
+  }
+  close(m_wakeFd);
+  close(m_epollFd);
+}
+
+bool EngineServer::listen(const std::string &socketPath) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path)) {
+    std::cout << "Error: socket path " << socketPath << " is too long"
+              << std::endl;
+    return false;
+  }
+  std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+  m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  unlink(socketPath.c_str());
+  if (m_listenFd < 0 ||
+      bind(m_listenFd, reinterpret_cast<const sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      ::listen(m_listenFd, SOMAXCONN) < 0) {
+    std::cout << "Error: could not listen on " << socketPath << ": "
+              << std::strerror(errno) << std::endl;
+    if (m_listenFd >= 0) {
+      close(m_listenFd);
+      m_listenFd = -1;
+    }
+    return false;
+  }
+  m_socketPath = socketPath;
+
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = k_listenId;
+  epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &event);
+  return true;
+}
+
+int EngineServer::run() {
+  if (m_listenFd < 0) {
+    return 1;
+  }
+
+  std::array<epoll_event, k_maxEvents> events;
+  while (!m_stopRequested) {
+    const int count = epoll_wait(m_epollFd, events.data(), k_maxEvents, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cout << "Error: epoll_wait failed: " << std::strerror(errno)
+                << std::endl;
+      return 1;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      const uint64_t id = events[i].data.u64;
+      if (id == k_listenId) {
+        acceptClients();
+      } else if (id == k_wakeId) {
+        uint64_t value = 0;
+        while (read(m_wakeFd, &value, sizeof(value)) > 0) {
+        }
+        deliverResults();
+      } else if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ||
+                 readClient(id)) {
+        // Both skip clients that have been closed already
+        flushClient(id);
+      }
+    }
+  }
+
+  return 0;
+}
+
+void EngineServer::stop() {
+  m_stopRequested = true;
+  const uint64_t value = 1;
+  [[maybe_unused]] const auto written =
+      write(m_wakeFd, &value, sizeof(value));
+}
+
+void EngineServer::acceptClients() {
+  while (true) {
+    const int fd = accept4(m_listenFd, nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      // EAGAIN once there's nobody else waiting
+      return;
+    }
+
+    const uint64_t clientId = m_nextClientId++;
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = clientId;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      close(fd);
+      continue;
+    }
+    m_clients[clientId].fd = fd;
+  }
+}
+
+bool EngineServer::readClient(uint64_t clientId) {
+  const auto it = m_clients.find(clientId);
+  if (it == m_clients.end()) {
+    return false;
+  }
+  Client &client = it->second;
+
+  // Handles every complete line, leaving a partial one behind
+  auto handleLines = [this, clientId, &client]() {
+    size_t start = 0;
+    for (size_t end = client.input.find('\n'); end != std::string::npos;
+         end = client.input.find('\n', start)) {
+      std::string_view line(client.input.data() + start, end - start);
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+      }
+      if (!line.empty()) {
+        client.output += handleRequest(clientId, line);
+      }
+      start = end + 1;
+    }
+    client.input.erase(0, start);
+  };
+
+  std::array<char, k_readSize> buffer;
+  while (true) {
+    const ssize_t count = recv(client.fd, buffer.data(), buffer.size(), 0);
+    if (count > 0) {
+      client.input.append(buffer.data(), count);
+      handleLines();
+
+      // Checked as it comes in, so a client that never sends a newline
+      // can't keep the buffer growing for as long as it keeps sending
+      if (client.input.size() > k_maxLineLength) {
+        closeClient(clientId);
+        return false;
+      }
+      continue;
+    }
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+
+    // Hung up or broken
+    closeClient(clientId);
+    return false;
+  }
+
+  return true;
+}
+
+void EngineServer::flushClient(uint64_t clientId) {
+  const auto it = m_clients.find(clientId);
+  if (it == m_clients.end()) {
+    return;
+  }
+  Client &client = it->second;
+
+  size_t sent = 0;
+  while (sent < client.output.size()) {
+    const ssize_t count = send(client.fd, client.output.data() + sent,
+                               client.output.size() - sent, MSG_NOSIGNAL);
+    if (count >= 0) {
+      sent += count;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    } else if (errno != EINTR) {
+      closeClient(clientId);
+      return;
+    }
+  }
+  client.output.erase(0, sent);
+
+  // Only ask to hear about space to write while there's something to write
+  const bool isWriting = !client.output.empty();
+  if (isWriting != client.isWriting) {
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    if (isWriting) {
+      event.events |= EPOLLOUT;
+    }
+    event.data.u64 = clientId;
+    epoll_ctl(m_epollFd, EPOLL_CTL_MOD, client.fd, &event);
+    client.isWriting = isWriting;
+  }
+}
+
+void EngineServer::closeClient(uint64_t clientId) {
+  const auto it = m_clients.find(clientId);
+  if (it == m_clients.end()) {
+    return;
+  }
+
+  for (const uint64_t gameId : it->second.games) {
+    endGame(gameId);
+  }
+  epoll_ctl(m_epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+  close(it->second.fd);
+  m_clients.erase(it);
+}
+
+std::string EngineServer::handleRequest(uint64_t clientId,
+                                        std::string_view line) {
+  Request request;
+  if (!parseRequest(line, request)) {
+    return "{\"error\":\"bad request\"}\n";
+  }
+
+  std::string response = "{";
+  if (const auto id = getNumber(request, "id")) {
+    response += "\"id\":" + std::to_string(id.value());
+  }
+
+  // For the first field after the id, if any
+  auto separator = [&response]() { return (response.size() > 1) ? "," : ""; };
+
+  auto error = [&](const std::string &reason) {
+    return response + separator() + "\"error\":\"" + reason + "\"}\n";
+  };
+
+  const std::string &op = request["op"];
+  if (op == "new") {
+    auto game = std::make_shared<Game>();
+    game->client = clientId;
+
+    Color color = Color::white;
+    const auto fen = request.find("fen");
+    if (fen == request.end()) {
+      m_board.loadGame();
+    } else {
+      LumpedBoardAndGameState state;
+      if (!readFen(fen->second, state)) {
+        return error("invalid fen");
+      }
+      m_board.loadFromState(state);
+      color = state.whoseTurn;
+      game->ply = 2 * (std::max<size_t>(state.turnNum, 1) - 1) +
+                  (color == Color::black ? 1 : 0);
+    }
+    game->position = m_board.getCompactState(color);
+    if (const auto seed = getNumber(request, "seed")) {
+      game->seed = static_cast<uint32_t>(seed.value());
+    }
+
+    const uint64_t gameId = m_nextGameId++;
+    m_clients[clientId].games.push_back(gameId);
+    m_games[gameId] = game;
+
+    response += separator();
+    response += "\"game\":" + std::to_string(gameId) + ",\"fen\":";
+    appendString(getFen(m_board, color, game->ply), response);
+    return response + "}\n";
+  }
+
+  // Everything else is about a game of this client's
+  const auto gameId = getNumber(request, "game");
+  const auto it = gameId.has_value() ? m_games.find(gameId.value())
+                                     : m_games.end();
+  if (it == m_games.end() || it->second->client != clientId) {
+    return error(op.empty() ? "bad request" : "unknown game");
+  }
+  const std::shared_ptr<Game> game = it->second;
+  response += separator();
+  response += "\"game\":" + std::to_string(gameId.value());
+
+  if (op == "cancel") {
+    game->stop = true;
+    return response + "}\n";
+  }
+  if (op == "end") {
+    endGame(gameId.value());
+    auto &games = m_clients[clientId].games;
+    games.erase(std::find(games.begin(), games.end(), gameId.value()));
+    return response + "}\n";
+  }
+
+  {
+    // The search has the board to itself until it's done
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (game->isSearching) {
+      return error("searching");
+    }
+    if (op == "search") {
+      game->isSearching = true;
+    }
+  }
+
+  if (op == "move") {
+    m_board.loadFromCompactState(game->position);
+    const Color color = game->position.whoseTurn;
+    if (!playUciMove(m_board, color, request["move"])) {
+      return error("illegal move");
+    }
+    ++game->ply;
+    game->position = m_board.getCompactState(getOtherColor(color));
+
+    response += ",\"fen\":";
+    appendString(getFen(m_board, getOtherColor(color), game->ply), response);
+    response += ",\"status\":";
+    appendString(getStatus(m_board, getOtherColor(color)), response);
+    return response + "}\n";
+  }
+
+  if (op == "search") {
+    SearchJob job = {game, static_cast<uint64_t>(gameId.value()),
+                     game->position, response, SearchLimits()};
+    if (const auto depth = getNumber(request, "depth")) {
+      job.limits.depth =
+          std::clamp(static_cast<int>(depth.value()), 1, k_maxSearchDepth);
+    }
+    if (const auto movetime = getNumber(request, "movetime")) {
+      job.limits.time = std::chrono::milliseconds(
+          std::max<long long>(movetime.value(), 1));
+    }
+    if (const auto nodes = getNumber(request, "nodes")) {
+      job.limits.nodes = std::max<long long>(nodes.value(), 1);
+    }
+    if (!request.count("depth") && !job.limits.time.has_value() &&
+        !job.limits.nodes.has_value()) {
+      job.limits.depth = k_defaultDepth;
+    }
+
+    game->stop = false;
+    job.limits.stop = &game->stop;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_jobs.push_back(std::move(job));
+    }
+    m_jobCondition.notify_one();
+    return "";
+  }
+
+  return error("unknown op");
+}
+
+void EngineServer::endGame(uint64_t gameId) {
+  const auto it = m_games.find(gameId);
+  if (it == m_games.end()) {
+    return;
+  }
+
+  // A search still running finishes on its own copy of the game
+  it->second->stop = true;
+  m_games.erase(it);
+}
+
+void EngineServer::deliverResults() {
+  std::vector<std::pair<uint64_t, std::string>> results;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    results.swap(m_results);
+  }
+
+  for (auto &[clientId, result] : results) {
+    const auto it = m_clients.find(clientId);
+    if (it == m_clients.end()) {
+      // Nobody left to tell
+      continue;
+    }
+    it->second.output += result;
+    flushClient(clientId);
+  }
+}
+
+void EngineServer::work() {
+  // Reused for every search this worker runs
+  Board board;
+
+  while (true) {
+    SearchJob job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_jobCondition.wait(
+          lock, [this] { return m_isShuttingDown || !m_jobs.empty(); });
+      if (m_isShuttingDown) {
+        return;
+      }
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+
+    std::string result = search(job, board);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      job.game->isSearching = false;
+      m_results.emplace_back(job.game->client, std::move(result));
+    }
+
+    const uint64_t value = 1;
+    [[maybe_unused]] const auto written =
+        write(m_wakeFd, &value, sizeof(value));
+  }
+}
+
+std::string EngineServer::search(SearchJob &job, Board &board) {
+  board.loadFromCompactState(job.position);
+  const Color color = job.position.whoseTurn;
+
+  AI computer(board);
+  computer.setColor(color);
+  computer.setTablebase(m_tablebase);
+  computer.setOpeningBook(m_book, m_maxBookDepth, false);
+  if (job.game->seed.has_value()) {
+    computer.setSeed(job.game->seed.value() + job.game->ply);
+  }
+
+  // Book moves are checked against the valid moves, which the search
+  // generates for itself
+  if (m_book) {
+    board.refreshValidMoves();
+  }
+
+  int score = 0;
+  std::optional<int> mateMoves;
+  int depth = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+  auto move = computer.getBookMove(color, job.game->ply);
+  if (!move.has_value()) {
+    move = computer.search(color, job.limits,
+                           [&](const SearchInfo &info) {
+                             score = info.score;
+                             mateMoves = getMateMoves(info);
+                             depth = info.depth;
+                           });
+  }
+  const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  std::string &response = job.response;
+  response += ",\"bestmove\":";
+  if (move.has_value()) {
+    appendString(toUciMove(board, move.value()), response);
+  } else {
+    response += "null";
+  }
+  response += ",\"score\":" + std::to_string(score) + ",\"mate\":";
+  response += mateMoves.has_value() ? std::to_string(*mateMoves) : "null";
+  response += ",\"depth\":" + std::to_string(depth) +
+              ",\"nodes\":" + std::to_string(computer.getNodes()) +
+              ",\"time\":" + std::to_string(elapsed.count()) + "}\n";
+  return response;
+}
@@ -0,0 +1,294 @@
+#include "EpdTest.h"
+#include "CommandLine.h"
+#include "Fen.h"
+#include "Pgn.h"
+
+#include <mutex>
+
+namespace {
+
+constexpr int k_defaultTimeMs = 1000;
+
+// Board placement, side to move, castling and en passant
+constexpr int k_numEpdFields = 4;
+
+// Options that are followed by a value
+const std::vector<std::string> k_valueOptions = {"--time", "--depth",
+                                                 "--nodes", "--threads"};
+
+using Move = std::pair<Position, Position>;
+
+inline bool isSpace(char letter) {
+  return letter == ' ' || letter == '\t' || letter == '\r';
+}
+
+// Splits off the next operand of an operation, which ends at a space or the
+// semicolon unless quoted. offset ends up past the operand
+std::string_view readOperand(std::string_view line, size_t &offset) {
+  if (line[offset] == '"') {
+    const size_t end = line.find('"', offset + 1);
+    const size_t length = (end == std::string_view::npos)
+                              ? line.size() - offset - 1
+                              : end - offset - 1;
+    const std::string_view operand = line.substr(offset + 1, length);
+    offset = std::min(line.size(), offset + length + 2);
+    return operand;
+  }
+
+  const size_t start = offset;
+  while (offset < line.size() && !isSpace(line[offset]) &&
+         line[offset] != ';') {
+    ++offset;
+  }
+  return line.substr(start, offset - start);
+}
+
+std::vector<Move> getMoves(Board &board, Color color,
+                           const std::vector<std::string_view> &sans) {
+  std::vector<Move> moves;
+  for (const auto san : sans) {
+    PieceType promotion;
+    if (const auto move = fromSan(board, color, san, promotion)) {
+      moves.emplace_back(move->start, move->end);
+    }
+  }
+  return moves;
+}
+
+} // namespace
+
+bool readEpd(std::string_view line, EpdPosition &position) {
+  position.id = {};
+  position.bestMoves.clear();
+  position.avoidMoves.clear();
+
+  if (!readFen(line, position.state)) {
+    return false;
+  }
+
+  size_t offset = 0;
+  for (int field = 0; field < k_numEpdFields; ++field) {
+    while (offset < line.size() && isSpace(line[offset])) {
+      ++offset;
+    }
+    while (offset < line.size() && !isSpace(line[offset])) {
+      ++offset;
+    }
+  }
+
+  // Operations are an opcode and its operands up to a semicolon
+  while (offset < line.size()) {
+    while (offset < line.size() && (isSpace(line[offset]) ||
+                                    line[offset] == ';')) {
+      ++offset;
+    }
+    if (offset == line.size()) {
+      break;
+    }
+
+    const std::string_view opcode = readOperand(line, offset);
+    std::vector<std::string_view> *moves = nullptr;
+    if (opcode == "bm") {
+      moves = &position.bestMoves;
+    } else if (opcode == "am") {
+      moves = &position.avoidMoves;
+    }
+
+    while (offset < line.size() && line[offset] != ';') {
+      if (isSpace(line[offset])) {
+        ++offset;
+        continue;
+      }
+
+      const std::string_view operand = readOperand(line, offset);
+      if (moves) {
+        moves->push_back(operand);
+      } else if (opcode == "id" && position.id.empty()) {
+        position.id = operand;
+      }
+    }
+  }
+
+  return true;
+}
+
+EpdResult solveEpd(const EpdPosition &position, const SearchLimits &limits) {
+  EpdResult result;
+
+  Board board;
+  board.loadFromState(position.state);
+  const Color color = position.state.whoseTurn;
+
+  const auto bestMoves = getMoves(board, color, position.bestMoves);
+  const auto avoidMoves = getMoves(board, color, position.avoidMoves);
+  result.isValid = bestMoves.size() == position.bestMoves.size() &&
+                   avoidMoves.size() == position.avoidMoves.size() &&
+                   (!bestMoves.empty() || !avoidMoves.empty());
+  if (!result.isValid) {
+    return result;
+  }
+
+  auto isSolution = [&](const Move &move) {
+    return (bestMoves.empty() || std::find(bestMoves.begin(), bestMoves.end(),
+                                           move) != bestMoves.end()) &&
+           std::find(avoidMoves.begin(), avoidMoves.end(), move) ==
+               avoidMoves.end();
+  };
+
+  const auto start = std::chrono::steady_clock::now();
+  AI computer(board);
+  computer.setColor(color);
+  const auto move =
+      computer.search(color, limits, [&](const SearchInfo &info) {
+        result.depth = info.depth;
+        if (!isSolution(info.bestMove)) {
+          result.timeToSolution.reset();
+        } else if (!result.timeToSolution.has_value()) {
+          result.timeToSolution = info.elapsed;
+        }
+      });
+  result.nodes = computer.getNodes();
+
+  if (!move.has_value()) {
+    result.timeToSolution.reset();
+    return result;
+  }
+
+  for (const auto &validMove : board.getValidMovesFor(color)) {
+    if (validMove.start == move->first && validMove.end == move->second) {
+      result.move = toSan(board, validMove);
+      break;
+    }
+  }
+
+  result.solved = isSolution(move.value());
+  if (!result.solved) {
+    result.timeToSolution.reset();
+  } else if (!result.timeToSolution.has_value()) {
+    // Found by a depth that didn't get to finish
+    result.timeToSolution =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+  }
+
+  return result;
+}
+
+int runEpdTest(int argc, char **argv) {
+  const auto filenames = getInputFilenames(argc, argv, k_valueOptions);
+  if (filenames.empty() || argumentPassed(argv, argv + argc, "-h")) {
+    std::cout << "Usage: chess epdtest <suite.epd> [--time <ms>] "
+                 "[--depth <n>] [--nodes <n>] [--threads <n>]"
+              << std::endl;
+    return 1;
+  }
+
+  SearchLimits limits;
+  const auto time = getArgumentValue(argv, argv + argc, "--time");
+  if (auto nodes = getArgumentValue(argv, argv + argc, "--nodes")) {
+    limits.nodes = std::max<size_t>(1, std::stoull(*nodes));
+  }
+  // A node limit on its own makes every run search exactly the same
+  if (time.has_value() || !limits.nodes.has_value()) {
+    limits.time = std::chrono::milliseconds(std::max(
+        1, std::stoi(time.value_or(std::to_string(k_defaultTimeMs)))));
+  }
+  limits.depth = std::clamp(
+      std::stoi(getArgumentValue(argv, argv + argc, "--depth")
+                    .value_or(std::to_string(k_maxSearchDepth))),
+      1, k_maxSearchDepth);
+  const unsigned int defaultThreads =
+      std::max(1u, std::thread::hardware_concurrency());
+  const int numThreads =
+      std::max(1, std::stoi(getArgumentValue(argv, argv + argc, "--threads")
+                                .value_or(std::to_string(defaultThreads))));
+
+  FenFile file;
+  if (!file.open(filenames.front())) {
+    return 1;
+  }
+
+  std::vector<EpdPosition> positions;
+  std::vector<size_t> lineNumbers;
+  for (size_t i = 0; i < file.size(); ++i) {
+    const std::string_view line = file.getLine(i);
+    if (line.find_first_not_of(" \t\r") == std::string_view::npos) {
+      continue;
+    }
+
+    EpdPosition position;
+    if (!readEpd(line, position)) {
+      std::cout << "Skipping malformed line " << i + 1 << std::endl;
+      continue;
+    }
+    positions.push_back(std::move(position));
+    lineNumbers.push_back(i + 1);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  // Positions are handed out one at a time, so long searches don't hold up
+  // the rest of a thread's share
+  std::vector<EpdResult> results(positions.size());
+  std::atomic<size_t> next = 0;
+  std::mutex outputMutex;
+  std::vector<std::thread> workers;
+  for (int i = 0; i < numThreads; ++i) {
+    workers.emplace_back([&]() {
+      for (size_t index = next++; index < positions.size(); index = next++) {
+        results[index] = solveEpd(positions[index], limits);
+
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << "." << std::flush;
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  std::cout << std::endl;
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  size_t numValid = 0;
+  size_t numSolved = 0;
+  size_t totalNodes = 0;
+  std::chrono::milliseconds totalTimeToSolution(0);
+  for (size_t i = 0; i < positions.size(); ++i) {
+    const auto &position = positions[i];
+    const auto &result = results[i];
+    const std::string id = position.id.empty()
+                               ? "line " + std::to_string(lineNumbers[i])
+                               : std::string(position.id);
+
+    if (!result.isValid) {
+      printf("%-24s no usable bm or am\n", id.c_str());
+      continue;
+    }
+
+    ++numValid;
+    totalNodes += result.nodes;
+    if (result.solved) {
+      ++numSolved;
+      totalTimeToSolution += result.timeToSolution.value();
+      printf("%-24s solved  %-8s %7lld ms %12zu nodes  depth %d\n", id.c_str(),
+             result.move.c_str(),
+             static_cast<long long>(result.timeToSolution->count()),
+             result.nodes, result.depth);
+    } else {
+      printf("%-24s failed  %-8s %10s %12zu nodes  depth %d\n", id.c_str(),
+             result.move.c_str(), "", result.nodes, result.depth);
+    }
+  }
+
+  printf("Solved %zu of %zu in %.1f s (%d threads), %zu nodes, %.0f nodes/s\n",
+         numSolved, numValid, elapsed.count(), numThreads, totalNodes,
+         totalNodes / std::max(elapsed.count(), 1e-9));
+  if (numSolved > 0) {
+    printf("Average time to solution %.0f ms\n",
+           static_cast<double>(totalTimeToSolution.count()) / numSolved);
+  }
+
+  return 0;
+}
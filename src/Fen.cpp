@@ -0,0 +1,428 @@
+#include "Fen.h"
+#include "Trace.h"
+
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr std::string_view k_whitespace = " \t\r\n";
+
+// Rank of the en passant target square after each side's double push
+constexpr char k_whiteEnPassantRank = '3';
+constexpr char k_blackEnPassantRank = '6';
+
+// In ns
+int64_t getModifiedTime(const struct stat &fileStat) {
+  return static_cast<int64_t>(fileStat.st_mtim.tv_sec) * 1000000000 +
+         fileStat.st_mtim.tv_nsec;
+}
+
+// Removes the next whitespace-separated field from the front of fen
+std::string_view nextField(std::string_view &fen) {
+  const size_t start = fen.find_first_not_of(k_whitespace);
+  if (start == std::string_view::npos) {
+    fen = {};
+    return {};
+  }
+  fen.remove_prefix(start);
+
+  const size_t end = std::min(fen.find_first_of(k_whitespace), fen.size());
+  const std::string_view field = fen.substr(0, end);
+  fen.remove_prefix(end);
+  return field;
+}
+
+PieceContainer *getContainer(LumpedBoardAndGameState &state, char letter) {
+  switch (std::tolower(letter)) {
+  case 'p':
+    return &state.pawns;
+  case 'n':
+    return &state.knights;
+  case 'b':
+    return &state.bishops;
+  case 'r':
+    return &state.rooks;
+  case 'q':
+    return &state.queens;
+  case 'k':
+    return &state.kings;
+  default:
+    return nullptr;
+  }
+}
+
+bool parseCounter(std::string_view field, size_t &value) {
+  const char *end = field.data() + field.size();
+  const auto result = std::from_chars(field.data(), end, value);
+  return result.ec == std::errc() && result.ptr == end;
+}
+
+bool parseBoard(std::string_view board, LumpedBoardAndGameState &state) {
+  int file = 0;
+  int rank = 7;
+
+  for (const char letter : board) {
+    if (letter == '/') {
+      if (file != 8 || rank == 0) {
+        return false;
+      }
+      file = 0;
+      --rank;
+    } else if (letter >= '1' && letter <= '8') {
+      file += letter - '0';
+      if (file > 8) {
+        return false;
+      }
+    } else {
+      auto *container = getContainer(state, letter);
+      if (!container || file > 7) {
+        return false;
+      }
+      container->emplace_back(
+          std::isupper(letter) ? Color::white : Color::black,
+          Position(file, rank));
+      ++file;
+    }
+  }
+
+  return file == 8 && rank == 0;
+}
+
+bool parseCastling(std::string_view castling, CastleStatus &status) {
+  if (castling == "-") {
+    return true;
+  }
+
+  for (const char letter : castling) {
+    switch (letter) {
+    case 'K':
+      status.set(k_whiteKingsideIndex);
+      break;
+    case 'Q':
+      status.set(k_whiteQueensideIndex);
+      break;
+    case 'k':
+      status.set(k_blackKingsideIndex);
+      break;
+    case 'q':
+      status.set(k_blackQueensideIndex);
+      break;
+    default:
+      return false;
+    }
+  }
+
+  return !castling.empty();
+}
+
+bool parseEnPassant(std::string_view enPassant, EnPassantStatus &status) {
+  if (enPassant == "-") {
+    return true;
+  }
+
+  if (enPassant.size() != 2 || enPassant[0] < 'a' || enPassant[0] > 'h' ||
+      (enPassant[1] != k_whiteEnPassantRank &&
+       enPassant[1] != k_blackEnPassantRank)) {
+    return false;
+  }
+
+  // Stored as the color of the pawn that can be taken, plus the square behind
+  // it
+  const Color color = (enPassant[1] == k_whiteEnPassantRank) ? Color::white
+                                                             : Color::black;
+  status = {color, {enPassant[0] - 'a', enPassant[1] - '1'}};
+  return true;
+}
+
+// Bounds-checked output into a caller's buffer
+class FenWriter {
+public:
+  FenWriter(char *buffer, size_t size)
+      : m_start(buffer), m_next(buffer), m_end(buffer + size) {}
+
+  inline void put(char letter) {
+    if (m_next < m_end) {
+      *m_next = letter;
+    }
+    ++m_next;
+  }
+
+  inline void putNumber(size_t number) {
+    char digits[20];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), number);
+    for (const char *digit = digits; digit != result.ptr; ++digit) {
+      put(*digit);
+    }
+  }
+
+  // Null-terminates and returns the length, 0 if it overflowed
+  size_t finish() {
+    put('\0');
+    if (m_next > m_end) {
+      if (m_end > m_start) {
+        *m_start = '\0';
+      }
+      return 0;
+    }
+    return m_next - m_start - 1;
+  }
+
+private:
+  char *m_start;
+  char *m_next;
+  char *m_end;
+};
+
+inline char getFenLetter(PieceType type, Color color) {
+  char letter = ' ';
+  switch (type) {
+  case PieceType::pawn:
+    letter = 'p';
+    break;
+  case PieceType::knight:
+    letter = 'n';
+    break;
+  case PieceType::bishop:
+    letter = 'b';
+    break;
+  case PieceType::rook:
+    letter = 'r';
+    break;
+  case PieceType::queen:
+    letter = 'q';
+    break;
+  case PieceType::king:
+    letter = 'k';
+    break;
+  default:
+    break;
+  }
+  return (color == Color::white) ? std::toupper(letter) : letter;
+}
+
+} // namespace
+
+bool readFen(std::string_view fen, LumpedBoardAndGameState &state) {
+  state.pawns.clear();
+  state.knights.clear();
+  state.bishops.clear();
+  state.rooks.clear();
+  state.queens.clear();
+  state.kings.clear();
+  state.castleStatus.reset();
+  state.enPassantStatus.reset();
+  state.whoseTurn = Color::white;
+  state.halfMoveNum = 0;
+  state.turnNum = 1;
+
+  if (!parseBoard(nextField(fen), state)) {
+    return false;
+  }
+
+  const std::string_view turn = nextField(fen);
+  if (turn != "w" && turn != "b") {
+    return false;
+  }
+  state.whoseTurn = (turn == "w") ? Color::white : Color::black;
+
+  if (!parseCastling(nextField(fen), state.castleStatus) ||
+      !parseEnPassant(nextField(fen), state.enPassantStatus)) {
+    return false;
+  }
+
+  // Counters are optional, EPD doesn't have them
+  size_t counter = 0;
+  if (parseCounter(nextField(fen), counter)) {
+    state.halfMoveNum = counter;
+    if (parseCounter(nextField(fen), counter)) {
+      state.turnNum = counter;
+    }
+  }
+
+  return true;
+}
+
+size_t writeFen(const FenBoard &board, Color whoseTurn,
+                const CastleStatus &castleStatus,
+                const EnPassantStatus &enPassantStatus, size_t halfMoveClock,
+                size_t moveNumber, char *buffer, size_t size) {
+  FenWriter writer(buffer, size);
+
+  for (int rank = 7; rank >= 0; --rank) {
+    int emptySquares = 0;
+    for (int file = 0; file < 8; ++file) {
+      const char letter = board[rank * 8 + file];
+      if (!letter) {
+        ++emptySquares;
+        continue;
+      }
+      if (emptySquares > 0) {
+        writer.put('0' + emptySquares);
+        emptySquares = 0;
+      }
+      writer.put(letter);
+    }
+    if (emptySquares > 0) {
+      writer.put('0' + emptySquares);
+    }
+    if (rank > 0) {
+      writer.put('/');
+    }
+  }
+
+  writer.put(' ');
+  writer.put((whoseTurn == Color::white) ? 'w' : 'b');
+
+  writer.put(' ');
+  if (castleStatus.none()) {
+    writer.put('-');
+  } else {
+    if (castleStatus[k_whiteKingsideIndex]) {
+      writer.put('K');
+    }
+    if (castleStatus[k_whiteQueensideIndex]) {
+      writer.put('Q');
+    }
+    if (castleStatus[k_blackKingsideIndex]) {
+      writer.put('k');
+    }
+    if (castleStatus[k_blackQueensideIndex]) {
+      writer.put('q');
+    }
+  }
+
+  writer.put(' ');
+  if (enPassantStatus.has_value()) {
+    writer.put('a' + enPassantStatus->second.first);
+    writer.put('1' + enPassantStatus->second.second);
+  } else {
+    writer.put('-');
+  }
+
+  writer.put(' ');
+  writer.putNumber(halfMoveClock);
+  writer.put(' ');
+  writer.putNumber(moveNumber);
+
+  return writer.finish();
+}
+
+size_t writeFen(const LumpedBoardAndGameState &state, char *buffer,
+                size_t size) {
+  FenBoard board = {};
+
+  auto addPieces = [&board](const PieceContainer &container, PieceType type) {
+    for (const auto &piece : container) {
+      const auto &position = piece.second;
+      if (position.first >= 0 && position.first < 8 && position.second >= 0 &&
+          position.second < 8) {
+        board[position.second * 8 + position.first] =
+            getFenLetter(type, piece.first);
+      }
+    }
+  };
+
+  addPieces(state.pawns, PieceType::pawn);
+  addPieces(state.knights, PieceType::knight);
+  addPieces(state.bishops, PieceType::bishop);
+  addPieces(state.rooks, PieceType::rook);
+  addPieces(state.queens, PieceType::queen);
+  addPieces(state.kings, PieceType::king);
+
+  return writeFen(board, state.whoseTurn, state.castleStatus,
+                  state.enPassantStatus, state.halfMoveNum, state.turnNum,
+                  buffer, size);
+}
+
+FenFile::~FenFile() { close(); }
+
+bool FenFile::open(const std::string &filename) {
+  TRACE_SCOPE("FenFile::open");
+  close();
+
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error: could not open " << filename << std::endl;
+    return false;
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  m_size = fileStat.st_size;
+  m_filename = filename;
+  m_modifiedTime = getModifiedTime(fileStat);
+  if (m_size > 0) {
+    void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      m_size = 0;
+      return false;
+    }
+    m_data = static_cast<const char *>(mapping);
+    madvise(mapping, m_size, MADV_SEQUENTIAL);
+  }
+  ::close(fd);
+
+  // memchr is about as fast as this can go
+  size_t offset = 0;
+  while (offset < m_size) {
+    m_lineStarts.push_back(offset);
+    const void *newline = std::memchr(m_data + offset, '\n', m_size - offset);
+    if (!newline) {
+      break;
+    }
+    offset = static_cast<const char *>(newline) - m_data + 1;
+  }
+
+  m_isOpen = true;
+  return true;
+}
+
+void FenFile::close() {
+  if (m_data) {
+    munmap(const_cast<char *>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_isOpen = false;
+  m_filename.clear();
+  m_modifiedTime = 0;
+  m_lineStarts.clear();
+}
+
+bool FenFile::hasChanged() const {
+  if (!m_isOpen) {
+    return false;
+  }
+
+  struct stat fileStat;
+  if (stat(m_filename.c_str(), &fileStat) != 0) {
+    return true;
+  }
+  return static_cast<size_t>(fileStat.st_size) != m_size ||
+         getModifiedTime(fileStat) != m_modifiedTime;
+}
+
+std::string_view FenFile::getLine(size_t index) const {
+  if (index >= size()) {
+    return {};
+  }
+
+  const size_t start = m_lineStarts[index];
+  size_t end = (index + 1 < size()) ? m_lineStarts[index + 1] - 1 : m_size;
+  // Windows line endings, and a last line that ends in a newline
+  while (end > start && (m_data[end - 1] == '\r' || m_data[end - 1] == '\n')) {
+    --end;
+  }
+
+  return std::string_view(m_data + start, end - start);
+}
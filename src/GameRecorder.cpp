@@ -0,0 +1,60 @@
+#include "GameRecorder.h"
+#include "Fen.h"
+#include "Trace.h"
+
+bool GameRecorder::open(const std::string &filename) {
+  close();
+
+  m_file = std::fopen(filename.c_str(), "ab");
+  if (!m_file) {
+    std::cout << "Error: could not open " << filename << " for writing"
+              << std::endl;
+    return false;
+  }
+
+  // Everything is batched here already
+  std::setvbuf(m_file, nullptr, _IONBF, 0);
+  m_filename = filename;
+  return true;
+}
+
+void GameRecorder::close() {
+  RETURN_IF_NULL(m_file);
+
+  flush();
+  std::fclose(m_file);
+  m_file = nullptr;
+  m_filename.clear();
+}
+
+void GameRecorder::record(const Board &board, Color whoseTurn,
+                          size_t moveNumber) {
+  RETURN_IF_NULL(m_file);
+
+  // Room for the longest possible line and its newline
+  if (m_buffer.size() - m_bufferUsed < k_maxFenLength + 1) {
+    flush();
+  }
+
+  const size_t length =
+      board.toFen(whoseTurn, moveNumber, m_buffer.data() + m_bufferUsed,
+                  m_buffer.size() - m_bufferUsed);
+  if (length == 0) {
+    return;
+  }
+
+  m_bufferUsed += length;
+  m_buffer[m_bufferUsed++] = '\n';
+}
+
+void GameRecorder::flush() {
+  TRACE_SCOPE("GameRecorder::flush");
+  if (!m_file || m_bufferUsed == 0) {
+    return;
+  }
+
+  if (std::fwrite(m_buffer.data(), 1, m_bufferUsed, m_file) != m_bufferUsed) {
+    std::cout << "Error: failed to write to " << m_filename << std::endl;
+  }
+  m_bufferUsed = 0;
+}
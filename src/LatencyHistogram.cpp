@@ -0,0 +1,75 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+size_t LatencyHistogram::getBucket(int64_t value) {
+  // Small values get a bucket each
+  if (value < k_subBuckets) {
+    return value;
+  }
+
+  // Otherwise the top k_subBucketBits + 1 bits pick it
+  int highestBit = 63;
+  while (!(value >> highestBit)) {
+    --highestBit;
+  }
+  const int shift = highestBit - k_subBucketBits;
+  return (shift + 1) * k_subBuckets + ((value >> shift) - k_subBuckets);
+}
+
+int64_t LatencyHistogram::getBucketTop(size_t bucket) {
+  if (bucket < static_cast<size_t>(k_subBuckets)) {
+    return bucket;
+  }
+
+  const int shift = bucket / k_subBuckets - 1;
+  const int64_t bottom = (k_subBuckets + int64_t(bucket % k_subBuckets))
+                         << shift;
+  return bottom + (int64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds latency) {
+  const int64_t value = std::max<int64_t>(latency.count(), 0);
+  ++m_buckets[getBucket(value)];
+  ++m_count;
+  m_max = std::max(m_max, value);
+}
+
+void LatencyHistogram::reset() {
+  m_buckets.fill(0);
+  m_count = 0;
+  m_max = 0;
+}
+
+std::chrono::nanoseconds
+LatencyHistogram::getPercentile(double percentile) const {
+  if (m_count == 0) {
+    return std::chrono::nanoseconds(0);
+  }
+
+  // Smallest value that at least this many of the latencies are under
+  const uint64_t rank = std::max<uint64_t>(
+      1, std::ceil(std::clamp(percentile, 0.0, 100.0) / 100 * m_count));
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < k_numBuckets; ++i) {
+    seen += m_buckets[i];
+    if (seen >= rank) {
+      return std::chrono::nanoseconds(std::min(getBucketTop(i), m_max));
+    }
+  }
+
+  return getMax();
+}
+
+void LatencyHistogram::print(const std::string &name) const {
+  const auto toMs = [](std::chrono::nanoseconds latency) {
+    return latency.count() / 1e6;
+  };
+
+  printf("%-22s %8llu  p50 %9.2f ms  p99 %9.2f ms  max %9.2f ms\n",
+         name.c_str(), static_cast<unsigned long long>(m_count),
+         toMs(getPercentile(50)), toMs(getPercentile(99)), toMs(getMax()));
+}
@@ -0,0 +1,245 @@
+#include "OpeningBook.h"
+#include "Trace.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int k_kingStartFile = 4;
+
+// Polyglot numbers promotions knight = 1 to queen = 4
+constexpr int k_promotionOffset =
+    static_cast<int>(PieceType::knight) - 1;
+
+inline bool isKingAt(const LumpedBoardAndGameState &state,
+                     const Position &position) {
+  return std::find_if(state.kings.begin(), state.kings.end(),
+                      [&position](const auto &king) {
+                        return king.second == position;
+                      }) != state.kings.end();
+}
+
+template <typename T> T toBigEndian(T value) {
+  if constexpr (sizeof(T) == 8) {
+    return __builtin_bswap64(value);
+  } else if constexpr (sizeof(T) == 4) {
+    return __builtin_bswap32(value);
+  } else {
+    return __builtin_bswap16(value);
+  }
+}
+
+} // namespace
+
+uint16_t encodeBookMove(const FullMove &move, PieceType promotion) {
+  Position end = move.end;
+
+  // Castling is king takes rook
+  if (move.pieceType == PieceType::king &&
+      std::abs(move.end.first - move.start.first) == 2) {
+    end.first = (move.end.first > move.start.first) ? 7 : 0;
+  }
+
+  uint16_t encoded = end.first | (end.second << 3) | (move.start.first << 6) |
+                     (move.start.second << 9);
+  if (promotion != PieceType::none) {
+    encoded |= (static_cast<int>(promotion) - k_promotionOffset) << 12;
+  }
+  return encoded;
+}
+
+BookMove decodeBookMove(uint16_t move, uint16_t weight,
+                        const LumpedBoardAndGameState &state) {
+  BookMove decoded;
+  decoded.end = {move & 7, (move >> 3) & 7};
+  decoded.start = {(move >> 6) & 7, (move >> 9) & 7};
+  decoded.weight = weight;
+
+  const int promotion = (move >> 12) & 7;
+  decoded.promotion = promotion ? static_cast<PieceType>(
+                                      promotion + k_promotionOffset)
+                                : PieceType::none;
+
+  // King takes rook back to the usual castling move
+  if (decoded.start.first == k_kingStartFile &&
+      decoded.start.second == decoded.end.second &&
+      (decoded.end.first == 0 || decoded.end.first == 7) &&
+      isKingAt(state, decoded.start)) {
+    decoded.end.first = (decoded.end.first == 7) ? 6 : 2;
+  }
+
+  return decoded;
+}
+
+bool writeOpeningBook(const std::string &filename,
+                      std::vector<BookEntry> &entries) {
+  std::sort(entries.begin(), entries.end(),
+            [](const BookEntry &first, const BookEntry &second) {
+              if (first.key != second.key) {
+                return first.key < second.key;
+              }
+              return first.weight > second.weight;
+            });
+
+  std::FILE *file = std::fopen(filename.c_str(), "wb");
+  if (!file) {
+    std::cout << "Error: could not open " << filename << " for writing"
+              << std::endl;
+    return false;
+  }
+
+  std::vector<char> buffer(entries.size() * sizeof(BookEntry));
+  char *next = buffer.data();
+  for (const auto &entry : entries) {
+    const uint64_t key = toBigEndian(entry.key);
+    const uint16_t move = toBigEndian(entry.move);
+    const uint16_t weight = toBigEndian(entry.weight);
+    const uint32_t learn = toBigEndian(entry.learn);
+    std::memcpy(next, &key, sizeof(key));
+    std::memcpy(next + 8, &move, sizeof(move));
+    std::memcpy(next + 10, &weight, sizeof(weight));
+    std::memcpy(next + 12, &learn, sizeof(learn));
+    next += sizeof(BookEntry);
+  }
+
+  const bool written =
+      std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+  std::fclose(file);
+  if (!written) {
+    std::cout << "Error: failed to write to " << filename << std::endl;
+  }
+  return written;
+}
+
+bool OpeningBook::open(const std::string &filename) {
+  TRACE_SCOPE("OpeningBook::open");
+  close();
+
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error: could not open opening book " << filename
+              << std::endl;
+    return false;
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0 ||
+      fileStat.st_size % sizeof(BookEntry) != 0) {
+    std::cout << "Error: " << filename << " is not a Polyglot book"
+              << std::endl;
+    ::close(fd);
+    return false;
+  }
+
+  void *mapping =
+      mmap(nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  // Probes jump around the whole file
+  madvise(mapping, fileStat.st_size, MADV_RANDOM);
+  m_data = static_cast<const char *>(mapping);
+  m_size = fileStat.st_size;
+
+  if (k_verbose) {
+    std::cout << "Loaded " << size() << " opening book entries" << std::endl;
+  }
+
+  return true;
+}
+
+void OpeningBook::close() {
+  if (m_data) {
+    munmap(const_cast<char *>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+
+BookEntry OpeningBook::getEntry(size_t index) const {
+  const char *data = m_data + index * sizeof(BookEntry);
+  BookEntry entry;
+  std::memcpy(&entry.key, data, sizeof(entry.key));
+  std::memcpy(&entry.move, data + 8, sizeof(entry.move));
+  std::memcpy(&entry.weight, data + 10, sizeof(entry.weight));
+  std::memcpy(&entry.learn, data + 12, sizeof(entry.learn));
+
+  entry.key = toBigEndian(entry.key);
+  entry.move = toBigEndian(entry.move);
+  entry.weight = toBigEndian(entry.weight);
+  entry.learn = toBigEndian(entry.learn);
+  return entry;
+}
+
+void OpeningBook::getMoves(const LumpedBoardAndGameState &state,
+                           std::vector<BookMove> &moves) const {
+  moves.clear();
+  if (!m_data) {
+    return;
+  }
+
+  const uint64_t key = getZobristKey(state);
+
+  // First entry with the key
+  size_t low = 0;
+  size_t high = size();
+  while (low < high) {
+    const size_t middle = low + (high - low) / 2;
+    if (getEntry(middle).key < key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  for (size_t i = low; i < size(); ++i) {
+    const BookEntry entry = getEntry(i);
+    if (entry.key != key) {
+      break;
+    }
+    moves.push_back(decodeBookMove(entry.move, entry.weight, state));
+  }
+
+  std::stable_sort(moves.begin(), moves.end(),
+                   [](const BookMove &first, const BookMove &second) {
+                     return first.weight > second.weight;
+                   });
+}
+
+std::optional<BookMove>
+OpeningBook::pickMove(const LumpedBoardAndGameState &state, bool bestMoveOnly,
+                      std::mt19937 &generator) const {
+  std::vector<BookMove> moves;
+  getMoves(state, moves);
+  if (moves.empty()) {
+    return std::nullopt;
+  }
+
+  uint32_t totalWeight = 0;
+  for (const auto &move : moves) {
+    totalWeight += move.weight;
+  }
+
+  // Zero weights mean "never play this" in Polyglot
+  if (bestMoveOnly || totalWeight == 0) {
+    return (moves.front().weight > 0) ? std::optional(moves.front())
+                                      : std::nullopt;
+  }
+
+  uint32_t pick =
+      std::uniform_int_distribution<uint32_t>(0, totalWeight - 1)(generator);
+  for (const auto &move : moves) {
+    if (pick < move.weight) {
+      return move;
+    }
+    pick -= move.weight;
+  }
+
+  return moves.front();
+}
@@ -0,0 +1,410 @@
+#include "PackedPosition.h"
+#include "Macros.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char k_packedMagic[8] = {'C', 'H', 'E', 'S', 'S', 'P', 'K', '\0'};
+constexpr uint32_t k_packedVersion = 1;
+
+struct PackedFileHeader {
+  char magic[8];
+  uint32_t version;
+  PackedFileType type;
+};
+
+static_assert(sizeof(PackedFileHeader) == 16);
+
+// Precedes the moves of every game
+struct PackedGameHeader {
+  uint16_t numMoves;
+  PackedResult result;
+  // Set if a PackedPosition with the starting position follows
+  uint8_t hasStart;
+};
+
+static_assert(sizeof(PackedGameHeader) == 4);
+
+constexpr uint8_t k_blackToMoveFlag = 1;
+constexpr int k_castleStatusShift = 1;
+
+constexpr uint8_t k_blackPieceFlag = 8;
+constexpr uint8_t k_pieceTypeMask = 7;
+
+constexpr int k_squareBits = 6;
+constexpr PackedMove k_squareMask = (1 << k_squareBits) - 1;
+
+inline int getSquare(const Position &position) {
+  return position.second * 8 + position.first;
+}
+
+inline Position getPosition(int square) { return {square % 8, square / 8}; }
+
+inline bool isOnBoard(const Position &position) {
+  return position.first >= 0 && position.first < 8 && position.second >= 0 &&
+         position.second < 8;
+}
+
+PieceContainer *getContainer(LumpedBoardAndGameState &state, PieceType type) {
+  switch (type) {
+  case PieceType::pawn:
+    return &state.pawns;
+  case PieceType::knight:
+    return &state.knights;
+  case PieceType::bishop:
+    return &state.bishops;
+  case PieceType::rook:
+    return &state.rooks;
+  case PieceType::queen:
+    return &state.queens;
+  case PieceType::king:
+    return &state.kings;
+  default:
+    return nullptr;
+  }
+}
+
+bool readHeader(const char *data, size_t size, PackedFileType &type) {
+  if (size < sizeof(PackedFileHeader)) {
+    return false;
+  }
+
+  PackedFileHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, k_packedMagic, sizeof(k_packedMagic)) != 0 ||
+      header.version != k_packedVersion) {
+    return false;
+  }
+
+  type = header.type;
+  return type == PackedFileType::positions || type == PackedFileType::games;
+}
+
+} // namespace
+
+bool packPosition(const LumpedBoardAndGameState &state,
+                  PackedPosition &packed) {
+  // Nibbles by square, 0 for empty ones
+  std::array<uint8_t, k_totalSquares> board = {};
+
+  auto addPieces = [&board](const PieceContainer &container, PieceType type) {
+    for (const auto &piece : container) {
+      if (!isOnBoard(piece.second)) {
+        return false;
+      }
+      board[getSquare(piece.second)] =
+          static_cast<uint8_t>(type) |
+          ((piece.first == Color::black) ? k_blackPieceFlag : 0);
+    }
+    return true;
+  };
+
+  if (!addPieces(state.pawns, PieceType::pawn) ||
+      !addPieces(state.knights, PieceType::knight) ||
+      !addPieces(state.bishops, PieceType::bishop) ||
+      !addPieces(state.rooks, PieceType::rook) ||
+      !addPieces(state.queens, PieceType::queen) ||
+      !addPieces(state.kings, PieceType::king)) {
+    return false;
+  }
+
+  packed = PackedPosition();
+  size_t count = 0;
+  for (int square = 0; square < k_totalSquares; ++square) {
+    if (!board[square]) {
+      continue;
+    }
+    if (count == k_totalPieces) {
+      return false;
+    }
+    packed.occupancy |= uint64_t(1) << square;
+    packed.pieces[count / 2] |= board[square] << ((count % 2) * 4);
+    ++count;
+  }
+
+  packed.flags = (state.whoseTurn == Color::black) ? k_blackToMoveFlag : 0;
+  packed.flags |= state.castleStatus.to_ulong() << k_castleStatusShift;
+
+  if (state.enPassantStatus.has_value()) {
+    packed.enPassantFile = state.enPassantStatus->second.first;
+  }
+
+  packed.halfMoveClock = std::min<size_t>(state.halfMoveNum, UINT8_MAX);
+  packed.moveNumber = std::min<size_t>(state.turnNum, UINT16_MAX);
+
+  return true;
+}
+
+void unpackPosition(const PackedPosition &packed,
+                    LumpedBoardAndGameState &state) {
+  state.pawns.clear();
+  state.knights.clear();
+  state.bishops.clear();
+  state.rooks.clear();
+  state.queens.clear();
+  state.kings.clear();
+
+  uint64_t occupancy = packed.occupancy;
+  size_t count = 0;
+  while (occupancy) {
+    const int square = __builtin_ctzll(occupancy);
+    occupancy &= occupancy - 1;
+
+    const uint8_t nibble = (packed.pieces[count / 2] >> ((count % 2) * 4)) & 15;
+    ++count;
+
+    auto *container =
+        getContainer(state, static_cast<PieceType>(nibble & k_pieceTypeMask));
+    if (container) {
+      container->emplace_back((nibble & k_blackPieceFlag) ? Color::black
+                                                          : Color::white,
+                              getPosition(square));
+    }
+  }
+
+  state.whoseTurn =
+      (packed.flags & k_blackToMoveFlag) ? Color::black : Color::white;
+  state.castleStatus = CastleStatus(packed.flags >> k_castleStatusShift);
+
+  // The pawn that can be taken belongs to whoever isn't moving
+  if (packed.enPassantFile < 8) {
+    const int rank = (state.whoseTurn == Color::white) ? 5 : 2;
+    state.enPassantStatus = {getOtherColor(state.whoseTurn),
+                             {packed.enPassantFile, rank}};
+  } else {
+    state.enPassantStatus.reset();
+  }
+
+  state.halfMoveNum = packed.halfMoveClock;
+  state.turnNum = packed.moveNumber;
+}
+
+PackedMove packMove(const Position &start, const Position &end,
+                    PieceType promotion) {
+  return getSquare(start) | (getSquare(end) << k_squareBits) |
+         (static_cast<PackedMove>(promotion) << (2 * k_squareBits));
+}
+
+void unpackMove(PackedMove move, Position &start, Position &end,
+                PieceType &promotion) {
+  start = getPosition(move & k_squareMask);
+  end = getPosition((move >> k_squareBits) & k_squareMask);
+  promotion = static_cast<PieceType>((move >> (2 * k_squareBits)) &
+                                     k_pieceTypeMask);
+}
+
+void PackedGame::clear() {
+  start.reset();
+  moves.clear();
+  result = PackedResult::unknown;
+}
+
+bool PackedWriter::open(const std::string &filename, PackedFileType type) {
+  close();
+
+  // Appending is only allowed to a file of the same type
+  bool needsHeader = true;
+  if (std::FILE *existing = std::fopen(filename.c_str(), "rb")) {
+    char header[sizeof(PackedFileHeader)];
+    const size_t length = std::fread(header, 1, sizeof(header), existing);
+    std::fclose(existing);
+
+    PackedFileType existingType;
+    if (length > 0) {
+      if (!readHeader(header, length, existingType) || existingType != type) {
+        std::cout << "Error: " << filename
+                  << " is not a packed file of the same type" << std::endl;
+        return false;
+      }
+      needsHeader = false;
+    }
+  }
+
+  m_file = std::fopen(filename.c_str(), "ab");
+  if (!m_file) {
+    std::cout << "Error: could not open " << filename << " for writing"
+              << std::endl;
+    return false;
+  }
+
+  // Everything is batched here already
+  std::setvbuf(m_file, nullptr, _IONBF, 0);
+  m_filename = filename;
+  m_type = type;
+
+  if (needsHeader) {
+    PackedFileHeader header;
+    std::memcpy(header.magic, k_packedMagic, sizeof(k_packedMagic));
+    header.version = k_packedVersion;
+    header.type = type;
+    append(&header, sizeof(header));
+  }
+
+  return true;
+}
+
+void PackedWriter::close() {
+  RETURN_IF_NULL(m_file);
+
+  flush();
+  std::fclose(m_file);
+  m_file = nullptr;
+  m_filename.clear();
+}
+
+bool PackedWriter::write(const PackedPosition &position) {
+  if (!m_file || m_type != PackedFileType::positions) {
+    return false;
+  }
+
+  append(&position, sizeof(position));
+  return true;
+}
+
+bool PackedWriter::write(const PackedGame &game) {
+  if (!m_file || m_type != PackedFileType::games ||
+      game.moves.size() > k_maxPackedGameMoves) {
+    return false;
+  }
+
+  const PackedGameHeader header = {static_cast<uint16_t>(game.moves.size()),
+                                   game.result, game.start.has_value()};
+  append(&header, sizeof(header));
+  if (game.start.has_value()) {
+    append(&game.start.value(), sizeof(PackedPosition));
+  }
+  append(game.moves.data(), game.moves.size() * sizeof(PackedMove));
+  return true;
+}
+
+void PackedWriter::append(const void *data, size_t size) {
+  if (m_buffer.size() + size > k_bufferSize) {
+    flush();
+  }
+
+  const char *bytes = static_cast<const char *>(data);
+  m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+}
+
+void PackedWriter::flush() {
+  if (!m_file || m_buffer.empty()) {
+    return;
+  }
+
+  if (std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) !=
+      m_buffer.size()) {
+    std::cout << "Error: failed to write to " << m_filename << std::endl;
+  }
+  m_buffer.clear();
+}
+
+bool PackedReader::open(const std::string &filename) {
+  close();
+
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error: could not open " << filename << std::endl;
+    return false;
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 ||
+      static_cast<size_t>(fileStat.st_size) < sizeof(PackedFileHeader)) {
+    std::cout << "Error: " << filename << " is not a packed file"
+              << std::endl;
+    ::close(fd);
+    return false;
+  }
+
+  m_size = fileStat.st_size;
+  void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    m_size = 0;
+    return false;
+  }
+  m_data = static_cast<const char *>(mapping);
+
+  if (!readHeader(m_data, m_size, m_type)) {
+    std::cout << "Error: " << filename << " is not a packed file"
+              << std::endl;
+    close();
+    return false;
+  }
+
+  // Games are read front to back
+  if (m_type == PackedFileType::games) {
+    madvise(mapping, m_size, MADV_SEQUENTIAL);
+  }
+
+  rewind();
+  return true;
+}
+
+void PackedReader::close() {
+  if (m_data) {
+    munmap(const_cast<char *>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_offset = 0;
+}
+
+size_t PackedReader::size() const {
+  if (!m_data || m_type != PackedFileType::positions) {
+    return 0;
+  }
+  return (m_size - sizeof(PackedFileHeader)) / sizeof(PackedPosition);
+}
+
+bool PackedReader::getPosition(size_t index, PackedPosition &position) const {
+  if (index >= size()) {
+    return false;
+  }
+
+  std::memcpy(&position,
+              m_data + sizeof(PackedFileHeader) +
+                  index * sizeof(PackedPosition),
+              sizeof(PackedPosition));
+  return true;
+}
+
+bool PackedReader::nextGame(PackedGame &game) {
+  game.clear();
+  if (!m_data || m_type != PackedFileType::games ||
+      m_size - m_offset < sizeof(PackedGameHeader)) {
+    return false;
+  }
+
+  PackedGameHeader header;
+  std::memcpy(&header, m_data + m_offset, sizeof(header));
+
+  const size_t startSize = header.hasStart ? sizeof(PackedPosition) : 0;
+  const size_t movesSize = header.numMoves * sizeof(PackedMove);
+  // Truncated by a writer that didn't get to finish
+  if (m_size - m_offset < sizeof(header) + startSize + movesSize) {
+    m_offset = m_size;
+    return false;
+  }
+  m_offset += sizeof(header);
+
+  if (header.hasStart) {
+    game.start = PackedPosition();
+    std::memcpy(&game.start.value(), m_data + m_offset, startSize);
+    m_offset += startSize;
+  }
+
+  game.moves.resize(header.numMoves);
+  std::memcpy(game.moves.data(), m_data + m_offset, movesSize);
+  m_offset += movesSize;
+
+  game.result = header.result;
+  return true;
+}
+
+void PackedReader::rewind() { m_offset = sizeof(PackedFileHeader); }
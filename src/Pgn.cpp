@@ -0,0 +1,539 @@
+#include "Pgn.h"
+#include "Fen.h"
+#include "Trace.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Check suffixes and annotations, none of which matter for finding the move
+constexpr std::string_view k_sanSuffixes = "+#!?";
+
+// Characters that end a movetext token
+constexpr std::string_view k_tokenDelimiters = " \t\r\n{}()[];$";
+
+// Export format keeps lines under 80 columns
+constexpr size_t k_maxLineLength = 79;
+
+// In the order export format wants them, with the placeholder for unknowns
+constexpr std::array<PgnTag, 7> k_sevenTagRoster = {{{"Event", "?"},
+                                                     {"Site", "?"},
+                                                     {"Date", "????.??.??"},
+                                                     {"Round", "?"},
+                                                     {"White", "?"},
+                                                     {"Black", "?"},
+                                                     {"Result", "*"}}};
+
+char getSanLetter(PieceType type) {
+  switch (type) {
+  case PieceType::knight:
+    return 'N';
+  case PieceType::bishop:
+    return 'B';
+  case PieceType::rook:
+    return 'R';
+  case PieceType::queen:
+    return 'Q';
+  case PieceType::king:
+    return 'K';
+  default:
+    return '\0';
+  }
+}
+
+PieceType getSanPieceType(char letter) {
+  switch (letter) {
+  case 'N':
+    return PieceType::knight;
+  case 'B':
+    return PieceType::bishop;
+  case 'R':
+    return PieceType::rook;
+  case 'Q':
+    return PieceType::queen;
+  case 'K':
+    return PieceType::king;
+  default:
+    return PieceType::none;
+  }
+}
+
+inline bool isResult(std::string_view token) {
+  return token == "1-0" || token == "0-1" || token == "1/2-1/2" ||
+         token == "*";
+}
+
+inline bool isCastling(std::string_view token) {
+  return token == "O-O" || token == "0-0" || token == "O-O-O" ||
+         token == "0-0-0";
+}
+
+inline bool isDigit(char letter) { return letter >= '0' && letter <= '9'; }
+
+// Appends token to out, starting a new line if it wouldn't fit on this one
+void appendToken(std::string &out, size_t &lineLength, std::string_view token) {
+  if (lineLength > 0) {
+    if (lineLength + 1 + token.size() > k_maxLineLength) {
+      out += '\n';
+      lineLength = 0;
+    } else {
+      out += ' ';
+      ++lineLength;
+    }
+  }
+  out += token;
+  lineLength += token.size();
+}
+
+} // namespace
+
+std::string toSan(Board &board, const FullMove &move, PieceType promotion) {
+  const int fileDelta = move.end.first - move.start.first;
+  if (move.pieceType == PieceType::king && std::abs(fileDelta) == 2) {
+    return (fileDelta > 0) ? "O-O" : "O-O-O";
+  }
+
+  std::string san;
+  const bool isPawn = move.pieceType == PieceType::pawn;
+  // Pawns only change files when capturing, en passant included
+  const bool isCapture =
+      board.getPieceAt(move.end) != nullptr || (isPawn && fileDelta != 0);
+
+  if (isPawn) {
+    if (isCapture) {
+      san += 'a' + move.start.first;
+    }
+  } else {
+    san += getSanLetter(move.pieceType);
+
+    // Other pieces of the same type that can get to the same square
+    bool isAmbiguous = false;
+    bool sharesFile = false;
+    bool sharesRank = false;
+    for (const auto &other : board.getAllValidMoves()) {
+      if (other.color != move.color || other.pieceType != move.pieceType ||
+          other.end != move.end || other.start == move.start) {
+        continue;
+      }
+      isAmbiguous = true;
+      sharesFile |= other.start.first == move.start.first;
+      sharesRank |= other.start.second == move.start.second;
+    }
+
+    // File if that's enough, then rank, then both
+    if (isAmbiguous) {
+      if (!sharesFile || sharesRank) {
+        san += 'a' + move.start.first;
+      }
+      if (sharesFile) {
+        san += '1' + move.start.second;
+      }
+    }
+  }
+
+  if (isCapture) {
+    san += 'x';
+  }
+  san += 'a' + move.end.first;
+  san += '1' + move.end.second;
+
+  if (isPawn && (move.end.second == 0 || move.end.second == 7)) {
+    san += '=';
+    san += getSanLetter(promotion == PieceType::none ? PieceType::queen
+                                                     : promotion);
+  }
+
+  return san;
+}
+
+std::string playSanMove(Board &board, const FullMove &move,
+                        PieceType promotion) {
+  std::string san = toSan(board, move, promotion);
+  if (!board.applyMove(move.color, move.start, move.end, promotion)) {
+    return {};
+  }
+
+  const Color otherColor = getOtherColor(move.color);
+  if (board.isKingInCheck(otherColor)) {
+    san += board.isKingCheckmated(otherColor) ? '#' : '+';
+  }
+
+  return san;
+}
+
+std::optional<FullMove> fromSan(Board &board, Color color, std::string_view san,
+                                PieceType &promotion) {
+  promotion = PieceType::none;
+
+  while (!san.empty() && k_sanSuffixes.find(san.back()) != san.npos) {
+    san.remove_suffix(1);
+  }
+
+  PieceType type = PieceType::pawn;
+  Position end;
+  int startFile = -1;
+  int startRank = -1;
+
+  if (isCastling(san)) {
+    const int rank = (color == Color::white) ? 0 : 7;
+    type = PieceType::king;
+    startFile = 4;
+    startRank = rank;
+    end = {(san.size() > 3) ? 2 : 6, rank};
+  } else {
+    if (!san.empty() && getSanPieceType(san.front()) != PieceType::none) {
+      type = getSanPieceType(san.front());
+      san.remove_prefix(1);
+    }
+
+    // Both e8=Q and e8Q are out there
+    if (type == PieceType::pawn && !san.empty() &&
+        getSanPieceType(san.back()) != PieceType::none) {
+      promotion = getSanPieceType(san.back());
+      san.remove_suffix(1);
+      if (!san.empty() && san.back() == '=') {
+        san.remove_suffix(1);
+      }
+      if (promotion == PieceType::king) {
+        return std::nullopt;
+      }
+    }
+
+    if (san.size() < 2) {
+      return std::nullopt;
+    }
+
+    const char endFile = san[san.size() - 2];
+    const char endRank = san[san.size() - 1];
+    if (endFile < 'a' || endFile > 'h' || endRank < '1' || endRank > '8') {
+      return std::nullopt;
+    }
+    end = {endFile - 'a', endRank - '1'};
+    san.remove_suffix(2);
+
+    // Whatever's left is disambiguation and capture marks
+    for (const char letter : san) {
+      if (letter >= 'a' && letter <= 'h') {
+        startFile = letter - 'a';
+      } else if (letter >= '1' && letter <= '8') {
+        startRank = letter - '1';
+      } else if (letter != 'x' && letter != ':' && letter != '-') {
+        return std::nullopt;
+      }
+    }
+  }
+
+  std::optional<FullMove> found = std::nullopt;
+  for (const auto &move : board.getAllValidMoves()) {
+    if (move.color != color || move.pieceType != type || move.end != end ||
+        (startFile >= 0 && move.start.first != startFile) ||
+        (startRank >= 0 && move.start.second != startRank)) {
+      continue;
+    }
+
+    // Underspecified. En passant captures can be listed twice, which is fine
+    if (found.has_value()) {
+      if (found->start == move.start) {
+        continue;
+      }
+      return std::nullopt;
+    }
+    found = move;
+  }
+
+  return found;
+}
+
+std::string_view PgnGame::getTag(std::string_view name) const {
+  for (const auto &tag : tags) {
+    if (tag.name == name) {
+      return tag.value;
+    }
+  }
+  return {};
+}
+
+void PgnGame::clear() {
+  tags.clear();
+  moves.clear();
+  result = "*";
+}
+
+void writePgn(const PgnGame &game, std::string &out) {
+  for (const auto &rosterTag : k_sevenTagRoster) {
+    std::string_view value = game.getTag(rosterTag.name);
+    if (value.empty()) {
+      value = (rosterTag.name == "Result") ? game.result : rosterTag.value;
+    }
+    out += '[';
+    out += rosterTag.name;
+    out += " \"";
+    out += value;
+    out += "\"]\n";
+  }
+
+  for (const auto &tag : game.tags) {
+    const bool isRosterTag =
+        std::find_if(k_sevenTagRoster.begin(), k_sevenTagRoster.end(),
+                     [&tag](const PgnTag &rosterTag) {
+                       return rosterTag.name == tag.name;
+                     }) != k_sevenTagRoster.end();
+    if (isRosterTag) {
+      continue;
+    }
+    out += '[';
+    out += tag.name;
+    out += " \"";
+    out += tag.value;
+    out += "\"]\n";
+  }
+  out += '\n';
+
+  // Games set up from a FEN don't have to start on move 1 or with white
+  LumpedBoardAndGameState start;
+  const std::string_view fen = game.getTag("FEN");
+  if (!fen.empty() && !readFen(fen, start)) {
+    start = LumpedBoardAndGameState();
+  }
+
+  size_t moveNumber = start.turnNum;
+  bool isWhite = start.whoseTurn == Color::white;
+  size_t lineLength = 0;
+  char number[24];
+
+  for (size_t i = 0; i < game.moves.size(); ++i) {
+    if (isWhite || i == 0) {
+      const int length = std::snprintf(number, sizeof(number), "%zu%s",
+                                       moveNumber, isWhite ? "." : "...");
+      appendToken(out, lineLength, std::string_view(number, length));
+    }
+    appendToken(out, lineLength, game.moves[i]);
+
+    if (!isWhite) {
+      ++moveNumber;
+    }
+    isWhite = !isWhite;
+  }
+
+  appendToken(out, lineLength, game.result);
+  out += "\n\n";
+}
+
+PgnReader::~PgnReader() { close(); }
+
+bool PgnReader::open(const std::string &filename) {
+  TRACE_SCOPE("PgnReader::open");
+  close();
+
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error: could not open " << filename << std::endl;
+    return false;
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  m_size = fileStat.st_size;
+  if (m_size > 0) {
+    void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      m_size = 0;
+      return false;
+    }
+    m_data = static_cast<const char *>(mapping);
+    // Read front to back exactly once
+    madvise(mapping, m_size, MADV_SEQUENTIAL);
+  }
+  ::close(fd);
+
+  m_offset = 0;
+  m_isOpen = true;
+  return true;
+}
+
+void PgnReader::close() {
+  if (m_data) {
+    munmap(const_cast<char *>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_offset = 0;
+  m_gameOffset = 0;
+  m_isOpen = false;
+}
+
+bool PgnReader::seek(size_t offset) {
+  if (offset > m_size) {
+    return false;
+  }
+  m_offset = offset;
+  return true;
+}
+
+void PgnReader::skipWhitespace() {
+  while (m_offset < m_size && std::isspace(m_data[m_offset])) {
+    ++m_offset;
+  }
+}
+
+void PgnReader::skipPast(char letter) {
+  if (m_offset >= m_size) {
+    m_offset = m_size;
+    return;
+  }
+
+  const void *found =
+      std::memchr(m_data + m_offset, letter, m_size - m_offset);
+  m_offset = found ? static_cast<const char *>(found) - m_data + 1 : m_size;
+}
+
+void PgnReader::skipLine() { skipPast('\n'); }
+
+bool PgnReader::readTag(PgnGame &game) {
+  // Past the [
+  ++m_offset;
+  skipWhitespace();
+
+  const size_t nameStart = m_offset;
+  while (m_offset < m_size && !std::isspace(m_data[m_offset]) &&
+         m_data[m_offset] != '"' && m_data[m_offset] != ']') {
+    ++m_offset;
+  }
+  const std::string_view name(m_data + nameStart, m_offset - nameStart);
+
+  skipWhitespace();
+  if (m_offset >= m_size || m_data[m_offset] != '"' || name.empty()) {
+    return false;
+  }
+  ++m_offset;
+
+  const size_t valueStart = m_offset;
+  while (m_offset < m_size && m_data[m_offset] != '"') {
+    // Escaped quotes and backslashes
+    m_offset += (m_data[m_offset] == '\\') ? 2 : 1;
+  }
+  if (m_offset >= m_size) {
+    return false;
+  }
+  const std::string_view value(m_data + valueStart, m_offset - valueStart);
+
+  skipPast(']');
+  game.tags.push_back({name, value});
+  return true;
+}
+
+bool PgnReader::nextGame(PgnGame &game) {
+  game.clear();
+
+  bool foundGame = false;
+  bool inMovetext = false;
+  int variationDepth = 0;
+
+  while (true) {
+    skipWhitespace();
+    if (m_offset >= m_size) {
+      break;
+    }
+
+    const char letter = m_data[m_offset];
+
+    // Escaped lines only count at the start of a line
+    if (letter == '%' && (m_offset == 0 || m_data[m_offset - 1] == '\n')) {
+      skipLine();
+      continue;
+    }
+
+    switch (letter) {
+    case '[':
+      // Next game's tags, this one never got a result
+      if (inMovetext) {
+        return true;
+      }
+      if (!foundGame) {
+        m_gameOffset = m_offset;
+      }
+      if (!readTag(game)) {
+        skipLine();
+      }
+      foundGame = true;
+      continue;
+    case '{':
+      skipPast('}');
+      continue;
+    case ';':
+      skipLine();
+      continue;
+    case '(':
+      ++variationDepth;
+      ++m_offset;
+      continue;
+    case ')':
+      variationDepth = std::max(variationDepth - 1, 0);
+      ++m_offset;
+      continue;
+    case '$':
+      ++m_offset;
+      while (m_offset < m_size && isDigit(m_data[m_offset])) {
+        ++m_offset;
+      }
+      continue;
+    default:
+      break;
+    }
+
+    const size_t tokenStart = m_offset;
+    while (m_offset < m_size &&
+           k_tokenDelimiters.find(m_data[m_offset]) == std::string_view::npos) {
+      ++m_offset;
+    }
+    std::string_view token(m_data + tokenStart, m_offset - tokenStart);
+
+    // Stray ] or }
+    if (token.empty()) {
+      ++m_offset;
+      continue;
+    }
+
+    if (!foundGame) {
+      m_gameOffset = tokenStart;
+    }
+    foundGame = true;
+    inMovetext = true;
+    if (variationDepth > 0) {
+      continue;
+    }
+
+    if (isResult(token)) {
+      game.result = token;
+      return true;
+    }
+
+    // Move numbers, which can be stuck to the move as in 1.e4 or 1...e5
+    if (isDigit(token.front()) && !isCastling(token)) {
+      const size_t numberEnd = token.find_first_not_of("0123456789");
+      if (numberEnd == std::string_view::npos || token[numberEnd] != '.') {
+        continue;
+      }
+      token.remove_prefix(numberEnd);
+    }
+    while (!token.empty() && token.front() == '.') {
+      token.remove_prefix(1);
+    }
+
+    if (!token.empty()) {
+      game.moves.push_back(token);
+    }
+  }
+
+  return foundGame;
+}
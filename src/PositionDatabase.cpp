@@ -0,0 +1,438 @@
+#include "PositionDatabase.h"
+#include "Fen.h"
+#include "Trace.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+
+namespace {
+
+constexpr char k_magic[8] = {'C', 'H', 'E', 'S', 'S', 'P', 'D', 'B'};
+constexpr uint32_t k_version = 1;
+
+struct DatabaseHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t numFiles;
+  uint64_t numRecords;
+  uint64_t recordsOffset;
+};
+
+// A location is the file index, the game's offset in it and the ply, from
+// the top bits down. Sorting by location sorts by game, then ply
+constexpr int k_plyBits = 16;
+constexpr int k_offsetBits = 40;
+constexpr int k_fileIndexShift = k_plyBits + k_offsetBits;
+constexpr uint64_t k_maxPly = (uint64_t(1) << k_plyBits) - 1;
+constexpr uint64_t k_maxOffset = (uint64_t(1) << k_offsetBits) - 1;
+constexpr size_t k_maxFiles = 256;
+
+constexpr size_t k_recordSize = 2 * sizeof(uint64_t);
+constexpr size_t k_recordAlignment = 16;
+
+inline uint64_t makeLocation(size_t fileIndex, uint64_t offset, size_t ply) {
+  return (uint64_t(fileIndex) << k_fileIndexShift) | (offset << k_plyBits) |
+         ply;
+}
+
+// Same game, whatever the ply
+inline uint64_t getGameLocation(uint64_t location) {
+  return location >> k_plyBits;
+}
+
+} // namespace
+
+PositionDatabaseBuilder::PositionDatabaseBuilder(const std::string &filename,
+                                                 size_t memoryLimit,
+                                                 size_t maxPly)
+    : m_filename(filename),
+      m_maxRecords(std::max<size_t>(memoryLimit / k_recordSize, 1)),
+      m_maxPly(std::min<size_t>(maxPly, k_maxPly)) {}
+
+PositionDatabaseBuilder::~PositionDatabaseBuilder() { removeRuns(); }
+
+bool PositionDatabaseBuilder::addPgnFile(const std::string &filename) {
+  if (m_gameFilenames.size() == k_maxFiles) {
+    std::cout << "Error: can't index more than " << k_maxFiles << " files"
+              << std::endl;
+    return false;
+  }
+
+  PgnReader reader;
+  if (!reader.open(filename)) {
+    return false;
+  }
+
+  // Absolute, so the index works from any directory
+  const size_t fileIndex = m_gameFilenames.size();
+  std::error_code error;
+  const auto path = std::filesystem::absolute(filename, error);
+  m_gameFilenames.push_back(error ? filename
+                                  : path.lexically_normal().string());
+
+  Board board;
+  PgnGame game;
+  LumpedBoardAndGameState start;
+  while (reader.nextGame(game)) {
+    const uint64_t offset = reader.getGameOffset();
+    if (offset > k_maxOffset) {
+      std::cout << "Error: " << filename << " is too large to index"
+                << std::endl;
+      return false;
+    }
+
+    const std::string_view fen = game.getTag("FEN");
+    if (fen.empty()) {
+      start = LumpedBoardAndGameState();
+      board.loadGame();
+      board.refreshValidMoves();
+    } else if (readFen(fen, start)) {
+      board.loadFromState(start);
+    } else {
+      continue;
+    }
+    ++m_numGames;
+
+    Color color = start.whoseTurn;
+    for (size_t ply = 0; ply <= m_maxPly; ++ply) {
+      const uint64_t key = getZobristKey(board.getBoardAndGameState(color));
+      m_records.push_back({key, makeLocation(fileIndex, offset, ply)});
+      ++m_numPositions;
+      if (m_records.size() == m_maxRecords && !writeRun()) {
+        return false;
+      }
+
+      if (ply == game.moves.size()) {
+        break;
+      }
+
+      // The rest of a game with a move we can't follow isn't indexed
+      PieceType promotion;
+      const auto move = fromSan(board, color, game.moves[ply], promotion);
+      if (!move.has_value() ||
+          !board.applyMove(color, move->start, move->end, promotion)) {
+        break;
+      }
+      color = getOtherColor(color);
+    }
+  }
+
+  return true;
+}
+
+bool PositionDatabaseBuilder::writeRun() {
+  std::sort(m_records.begin(), m_records.end(),
+            [](const Record &first, const Record &second) {
+              return std::tie(first.key, first.location) <
+                     std::tie(second.key, second.location);
+            });
+
+  const std::string runFilename =
+      m_filename + ".run" + std::to_string(m_runFilenames.size());
+  std::FILE *file = std::fopen(runFilename.c_str(), "wb");
+  if (!file) {
+    std::cout << "Error: could not open " << runFilename << " for writing"
+              << std::endl;
+    return false;
+  }
+  m_runFilenames.push_back(runFilename);
+
+  const bool written = std::fwrite(m_records.data(), sizeof(Record),
+                                   m_records.size(),
+                                   file) == m_records.size();
+  std::fclose(file);
+  m_records.clear();
+
+  if (!written) {
+    std::cout << "Error: failed to write to " << runFilename << std::endl;
+  }
+  return written;
+}
+
+void PositionDatabaseBuilder::removeRuns() {
+  for (const auto &runFilename : m_runFilenames) {
+    std::remove(runFilename.c_str());
+  }
+  m_runFilenames.clear();
+}
+
+bool PositionDatabaseBuilder::finish() {
+  if (!m_records.empty() && !writeRun()) {
+    return false;
+  }
+  m_records.clear();
+  m_records.shrink_to_fit();
+
+  std::FILE *output = std::fopen(m_filename.c_str(), "wb");
+  if (!output) {
+    std::cout << "Error: could not open " << m_filename << " for writing"
+              << std::endl;
+    return false;
+  }
+  std::vector<char> outputBuffer(1 << 20);
+  std::setvbuf(output, outputBuffer.data(), _IOFBF, outputBuffer.size());
+
+  // Header first, the record count gets filled in at the end
+  DatabaseHeader header = {};
+  std::memcpy(header.magic, k_magic, sizeof(k_magic));
+  header.version = k_version;
+  header.numFiles = m_gameFilenames.size();
+  std::fwrite(&header, sizeof(header), 1, output);
+
+  size_t offset = sizeof(header);
+  for (const auto &gameFilename : m_gameFilenames) {
+    std::fwrite(gameFilename.c_str(), 1, gameFilename.size() + 1, output);
+    offset += gameFilename.size() + 1;
+  }
+  const char padding[k_recordAlignment] = {};
+  const size_t paddingSize =
+      (k_recordAlignment - offset % k_recordAlignment) % k_recordAlignment;
+  std::fwrite(padding, 1, paddingSize, output);
+  header.recordsOffset = offset + paddingSize;
+
+  // k-way merge of the runs, reading each in chunks that together take about
+  // as much memory as a single run did
+  struct RunReader {
+    std::FILE *file;
+    std::vector<Record> chunk;
+    size_t next;
+  };
+
+  const size_t chunkSize =
+      std::max<size_t>(m_maxRecords / std::max<size_t>(m_runFilenames.size(),
+                                                       1),
+                       1);
+  std::vector<RunReader> runs;
+  bool succeeded = true;
+  for (const auto &runFilename : m_runFilenames) {
+    std::FILE *file = std::fopen(runFilename.c_str(), "rb");
+    if (!file) {
+      succeeded = false;
+      break;
+    }
+    runs.push_back({file, {}, 0});
+  }
+
+  auto refill = [chunkSize](RunReader &run) {
+    run.chunk.resize(chunkSize);
+    run.chunk.resize(
+        std::fread(run.chunk.data(), sizeof(Record), chunkSize, run.file));
+    run.next = 0;
+    return !run.chunk.empty();
+  };
+
+  // Smallest record on top
+  auto isLater = [&runs](size_t first, size_t second) {
+    const Record &a = runs[first].chunk[runs[first].next];
+    const Record &b = runs[second].chunk[runs[second].next];
+    return std::tie(a.key, a.location) > std::tie(b.key, b.location);
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(isLater)> heap(
+      isLater);
+
+  if (succeeded) {
+    for (size_t i = 0; i < runs.size(); ++i) {
+      if (refill(runs[i])) {
+        heap.push(i);
+      }
+    }
+  }
+
+  Record last = {0, UINT64_MAX};
+  while (!heap.empty()) {
+    const size_t runIndex = heap.top();
+    heap.pop();
+
+    RunReader &run = runs[runIndex];
+    const Record record = run.chunk[run.next++];
+
+    // Positions that repeat within a game are only listed at the first ply
+    if (record.key != last.key ||
+        getGameLocation(record.location) != getGameLocation(last.location)) {
+      std::fwrite(&record, sizeof(record), 1, output);
+      ++header.numRecords;
+      last = record;
+    }
+
+    if (run.next < run.chunk.size() || refill(run)) {
+      heap.push(runIndex);
+    }
+  }
+
+  for (auto &run : runs) {
+    std::fclose(run.file);
+  }
+  removeRuns();
+
+  std::fseek(output, 0, SEEK_SET);
+  std::fwrite(&header, sizeof(header), 1, output);
+  succeeded &= std::ferror(output) == 0;
+  succeeded &= std::fclose(output) == 0;
+
+  if (!succeeded) {
+    std::cout << "Error: failed to write " << m_filename << std::endl;
+  }
+  return succeeded;
+}
+
+bool PositionDatabase::open(const std::string &filename) {
+  TRACE_SCOPE("PositionDatabase::open");
+  close();
+
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error: could not open position database " << filename
+              << std::endl;
+    return false;
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 ||
+      static_cast<size_t>(fileStat.st_size) < sizeof(DatabaseHeader)) {
+    ::close(fd);
+    return false;
+  }
+
+  void *mapping =
+      mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  m_data = static_cast<const char *>(mapping);
+  m_size = fileStat.st_size;
+
+  DatabaseHeader header;
+  std::memcpy(&header, m_data, sizeof(header));
+  if (std::memcmp(header.magic, k_magic, sizeof(k_magic)) != 0 ||
+      header.version != k_version || header.recordsOffset > m_size ||
+      header.numRecords > (m_size - header.recordsOffset) / k_recordSize) {
+    std::cout << "Error: " << filename << " is not a position database"
+              << std::endl;
+    close();
+    return false;
+  }
+
+  // Lookups jump all over the records
+  madvise(mapping, m_size, MADV_RANDOM);
+  m_records = m_data + header.recordsOffset;
+  m_numRecords = header.numRecords;
+
+  const char *name = m_data + sizeof(header);
+  for (uint32_t i = 0; i < header.numFiles; ++i) {
+    const size_t length = strnlen(name, m_records - name);
+    m_gameFilenames.emplace_back(name, length);
+    name += length + 1;
+
+    // Unreadable game files only make getGame() fail
+    m_readers.push_back(std::make_unique<PgnReader>());
+    m_readers.back()->open(m_gameFilenames.back());
+  }
+
+  return true;
+}
+
+void PositionDatabase::close() {
+  if (m_data) {
+    munmap(const_cast<char *>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_records = nullptr;
+  m_numRecords = 0;
+  m_gameFilenames.clear();
+  m_readers.clear();
+}
+
+size_t PositionDatabase::size() const { return m_numRecords; }
+
+void PositionDatabase::findGames(const LumpedBoardAndGameState &state,
+                                 std::vector<PositionMatch> &matches,
+                                 size_t maxMatches) const {
+  if (!m_data) {
+    return;
+  }
+
+  auto getRecord = [this](size_t index, uint64_t &key, uint64_t &location) {
+    const char *record = m_records + index * k_recordSize;
+    std::memcpy(&key, record, sizeof(key));
+    std::memcpy(&location, record + sizeof(key), sizeof(location));
+  };
+
+  const uint64_t key = getZobristKey(state);
+  uint64_t recordKey;
+  uint64_t location;
+
+  // First record with the key
+  size_t low = 0;
+  size_t high = m_numRecords;
+  while (low < high) {
+    const size_t middle = low + (high - low) / 2;
+    getRecord(middle, recordKey, location);
+    if (recordKey < key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  for (size_t i = low; i < m_numRecords && maxMatches > 0; ++i) {
+    getRecord(i, recordKey, location);
+    if (recordKey != key) {
+      break;
+    }
+    matches.push_back({static_cast<size_t>(location >> k_fileIndexShift),
+                       (location >> k_plyBits) & k_maxOffset,
+                       static_cast<size_t>(location & k_maxPly)});
+    --maxMatches;
+  }
+}
+
+bool PositionDatabase::getGame(const PositionMatch &match, PgnGame &game) {
+  if (match.fileIndex >= m_readers.size()) {
+    return false;
+  }
+
+  auto &reader = *m_readers[match.fileIndex];
+  return reader.isOpen() && reader.seek(match.offset) &&
+         reader.nextGame(game);
+}
+
+bool PositionDatabase::getPosition(const PositionMatch &match, Board &board,
+                                   Color &whoseTurn) {
+  PgnGame game;
+  if (!getGame(match, game) || match.ply > game.moves.size()) {
+    return false;
+  }
+
+  const std::string_view fen = game.getTag("FEN");
+  LumpedBoardAndGameState start;
+  if (fen.empty()) {
+    board.loadGame();
+    board.refreshValidMoves();
+    whoseTurn = Color::white;
+  } else if (readFen(fen, start)) {
+    board.loadFromState(start);
+    whoseTurn = start.whoseTurn;
+  } else {
+    return false;
+  }
+
+  for (size_t ply = 0; ply < match.ply; ++ply) {
+    PieceType promotion;
+    const auto move = fromSan(board, whoseTurn, game.moves[ply], promotion);
+    if (!move.has_value() ||
+        !board.applyMove(whoseTurn, move->start, move->end, promotion)) {
+      return false;
+    }
+    whoseTurn = getOtherColor(whoseTurn);
+  }
+
+  return true;
+}
@@ -0,0 +1,549 @@
+#include "Tablebase.h"
+#include "Trace.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char k_magic[8] = {'C', 'H', 'E', 'S', 'S', 'T', 'B', '\0'};
+constexpr uint32_t k_version = 1;
+constexpr size_t k_nameLength = 16;
+constexpr size_t k_tableAlignment = 64;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t tableCount;
+};
+
+struct FileEntry {
+  char name[k_nameLength];
+  uint64_t offset;
+  uint64_t size;
+};
+
+// Without pawns the white king can be folded into the a1-d1-d4 triangle,
+// with pawns only the left-right mirror is available
+constexpr int k_pawnlessKingSquares = 10;
+constexpr int k_pawnKingSquares = 32;
+constexpr std::array<int, k_pawnlessKingSquares> k_triangleSquares = {
+    0, 1, 2, 3, 9, 10, 11, 18, 19, 27};
+
+// Order pieces are listed in within a side, strongest first
+constexpr std::array<PieceType, 5> k_nonKingTypes = {
+    PieceType::queen, PieceType::rook, PieceType::bishop, PieceType::knight,
+    PieceType::pawn};
+
+int getTypeOrder(PieceType type) {
+  switch (type) {
+  case PieceType::queen:
+    return 0;
+  case PieceType::rook:
+    return 1;
+  case PieceType::bishop:
+    return 2;
+  case PieceType::knight:
+    return 3;
+  case PieceType::pawn:
+    return 4;
+  default:
+    return 5;
+  }
+}
+
+int getMaterial(PieceType type) {
+  switch (type) {
+  case PieceType::queen:
+    return 9;
+  case PieceType::rook:
+    return 5;
+  case PieceType::bishop:
+  case PieceType::knight:
+    return 3;
+  case PieceType::pawn:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+char getTypeLetter(PieceType type) {
+  switch (type) {
+  case PieceType::queen:
+    return 'Q';
+  case PieceType::rook:
+    return 'R';
+  case PieceType::bishop:
+    return 'B';
+  case PieceType::knight:
+    return 'N';
+  case PieceType::pawn:
+    return 'P';
+  default:
+    return 'K';
+  }
+}
+
+// True if side a should be stored as white when playing side b. Sides are
+// expected to be sorted with getTypeOrder
+bool isStrongerSide(const std::vector<PieceType> &a,
+                    const std::vector<PieceType> &b) {
+  int materialA = 0;
+  int materialB = 0;
+  for (const auto type : a) {
+    materialA += getMaterial(type);
+  }
+  for (const auto type : b) {
+    materialB += getMaterial(type);
+  }
+
+  if (materialA != materialB) {
+    return materialA > materialB;
+  }
+
+  // Same material, so fall back on a fixed ordering
+  for (size_t i = 0; i < std::min(a.size(), b.size()); ++i) {
+    if (a[i] != b[i]) {
+      return getTypeOrder(a[i]) < getTypeOrder(b[i]);
+    }
+  }
+
+  return a.size() >= b.size();
+}
+
+std::string getSideName(const std::vector<PieceType> &side) {
+  std::string name = "K";
+  for (const auto type : side) {
+    name.push_back(getTypeLetter(type));
+  }
+  return name;
+}
+
+inline int transformSquare(int square, int transform) {
+  int file = square % 8;
+  int rank = square / 8;
+
+  if (transform & 1) {
+    file = 7 - file;
+  }
+  if (transform & 2) {
+    rank = 7 - rank;
+  }
+  if (transform & 4) {
+    std::swap(file, rank);
+  }
+
+  return rank * 8 + file;
+}
+
+// Picks the symmetry that moves the white king into its canonical region. A
+// king on the a1-h8 diagonal leaves a choice, which goes to whichever puts
+// the first piece off the diagonal below it
+int getCanonicalTransform(const TablebaseSquares &squares, int count,
+                          bool hasPawns) {
+  int transform = 0;
+  int file = squares[0] % 8;
+  int rank = squares[0] / 8;
+
+  if (file > 3) {
+    transform |= 1;
+    file = 7 - file;
+  }
+
+  if (hasPawns) {
+    return transform;
+  }
+
+  if (rank > 3) {
+    transform |= 2;
+    rank = 7 - rank;
+  }
+
+  if (rank > file) {
+    return transform | 4;
+  }
+
+  if (rank == file) {
+    for (int i = 1; i < count; ++i) {
+      const int square = transformSquare(squares[i], transform);
+      if (square / 8 != square % 8) {
+        return (square / 8 > square % 8) ? (transform | 4) : transform;
+      }
+    }
+  }
+
+  return transform;
+}
+
+inline int getKingIndex(int square, bool hasPawns) {
+  if (hasPawns) {
+    return (square / 8) * 4 + (square % 8);
+  }
+
+  for (int i = 0; i < k_pawnlessKingSquares; ++i) {
+    if (k_triangleSquares[i] == square) {
+      return i;
+    }
+  }
+
+  // Unreachable once canonicalized
+  return 0;
+}
+
+size_t computeIndex(const TablebaseSquares &squares, int count, bool hasPawns,
+                    Color toMove) {
+  const int transform = getCanonicalTransform(squares, count, hasPawns);
+  const size_t kingSquares =
+      hasPawns ? k_pawnKingSquares : k_pawnlessKingSquares;
+
+  size_t index = (toMove == Color::white) ? 0 : 1;
+  index = index * kingSquares +
+          getKingIndex(transformSquare(squares[0], transform), hasPawns);
+  for (int i = 1; i < count; ++i) {
+    index = index * k_totalSquares + transformSquare(squares[i], transform);
+  }
+
+  return index;
+}
+
+} // namespace
+
+size_t TablebaseTable::size() const {
+  size_t size = 2 * (hasPawns ? k_pawnKingSquares : k_pawnlessKingSquares);
+  for (size_t i = 1; i < pieces.size(); ++i) {
+    size *= k_totalSquares;
+  }
+  return size;
+}
+
+size_t TablebaseTable::getIndex(const TablebaseSquares &squares,
+                                Color toMove) const {
+  return computeIndex(squares, static_cast<int>(pieces.size()), hasPawns,
+                      toMove);
+}
+
+void TablebaseTable::getSquares(size_t index, TablebaseSquares &squares,
+                                Color &toMove) const {
+  for (int i = static_cast<int>(pieces.size()) - 1; i > 0; --i) {
+    squares[i] = static_cast<int>(index % k_totalSquares);
+    index /= k_totalSquares;
+  }
+
+  const size_t kingSquares =
+      hasPawns ? k_pawnKingSquares : k_pawnlessKingSquares;
+  const int kingIndex = static_cast<int>(index % kingSquares);
+  squares[0] = hasPawns ? (kingIndex / 4) * 8 + (kingIndex % 4)
+                        : k_triangleSquares[kingIndex];
+  toMove = (index / kingSquares == 0) ? Color::white : Color::black;
+}
+
+Tablebase::~Tablebase() {
+  if (m_data) {
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+    m_data = nullptr;
+  }
+}
+
+bool Tablebase::load(const std::string &filename) {
+  TRACE_SCOPE("Tablebase::load");
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error: could not open tablebase " << filename << std::endl;
+    return false;
+  }
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 ||
+      static_cast<size_t>(fileStat.st_size) < sizeof(FileHeader)) {
+    ::close(fd);
+    return false;
+  }
+
+  void *mapping =
+      mmap(nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  m_data = static_cast<const uint8_t *>(mapping);
+  m_size = fileStat.st_size;
+
+  FileHeader header;
+  std::memcpy(&header, m_data, sizeof(header));
+  if (std::memcmp(header.magic, k_magic, sizeof(k_magic)) != 0 ||
+      header.version != k_version ||
+      sizeof(FileHeader) + header.tableCount * sizeof(FileEntry) > m_size) {
+    std::cout << "Error: " << filename << " is not a tablebase file"
+              << std::endl;
+    munmap(mapping, m_size);
+    m_data = nullptr;
+    return false;
+  }
+
+  // Probes index tables by their shape, so a table of any other size (from a
+  // truncated or stale file, say) would be read out of bounds
+  std::unordered_map<std::string, size_t> expectedSizes;
+  for (const auto &table : getAllTables(k_maxTablebasePieces)) {
+    expectedSizes[table.name] = table.size();
+  }
+
+  m_tables.clear();
+  for (uint32_t i = 0; i < header.tableCount; ++i) {
+    FileEntry entry;
+    std::memcpy(&entry,
+                m_data + sizeof(FileHeader) + i * sizeof(FileEntry),
+                sizeof(entry));
+    const std::string name(entry.name, strnlen(entry.name, k_nameLength));
+    const auto expected = expectedSizes.find(name);
+    if (entry.size > m_size || entry.offset > m_size - entry.size ||
+        expected == expectedSizes.end() || entry.size != expected->second) {
+      std::cout << "Error: skipping bad tablebase table " << name
+                << std::endl;
+      continue;
+    }
+    m_tables[name] = {m_data + entry.offset, entry.size};
+  }
+
+  if (k_verbose) {
+    std::cout << "Loaded " << m_tables.size() << " tablebase tables"
+              << std::endl;
+  }
+
+  return true;
+}
+
+std::optional<TablebaseResult>
+Tablebase::probe(const LumpedBoardAndGameState &state) const {
+  std::vector<TablebasePiece> pieces;
+  pieces.reserve(k_maxTablebasePieces);
+
+  auto addPieces = [&pieces](const PieceContainer &container,
+                             PieceType type) {
+    for (const auto &piece : container) {
+      // Skip pieces that the search has taken off the board
+      if (piece.second.first < 0 || piece.second.second < 0) {
+        continue;
+      }
+      pieces.push_back(
+          {type, piece.first, piece.second.second * 8 + piece.second.first});
+    }
+  };
+
+  addPieces(state.pawns, PieceType::pawn);
+  addPieces(state.knights, PieceType::knight);
+  addPieces(state.bishops, PieceType::bishop);
+  addPieces(state.rooks, PieceType::rook);
+  addPieces(state.queens, PieceType::queen);
+  addPieces(state.kings, PieceType::king);
+
+  return probe(pieces, state.whoseTurn);
+}
+
+std::optional<TablebaseResult>
+Tablebase::probe(const std::vector<TablebasePiece> &pieces,
+                 Color toMove) const {
+  if (pieces.size() == 2) {
+    // Bare kings
+    return TablebaseResult{TablebaseOutcome::draw, 0};
+  }
+
+  std::string tableName;
+  size_t index = 0;
+  if (!isLoaded() || !locate(pieces, toMove, tableName, index)) {
+    return std::nullopt;
+  }
+
+  const auto it = m_tables.find(tableName);
+  if (it == m_tables.end()) {
+    return std::nullopt;
+  }
+
+  const auto [entries, size] = it->second;
+  if (index >= size) {
+    return std::nullopt;
+  }
+
+  const uint8_t value = entries[index];
+  if (value == k_tablebaseIllegal) {
+    return std::nullopt;
+  }
+
+  return decode(value);
+}
+
+std::vector<TablebaseTable> Tablebase::getAllTables(int maxPieces) {
+  std::vector<std::vector<PieceType>> sides = {{}};
+  for (const auto first : k_nonKingTypes) {
+    sides.push_back({first});
+    for (const auto second : k_nonKingTypes) {
+      if (getTypeOrder(second) >= getTypeOrder(first)) {
+        sides.push_back({first, second});
+      }
+    }
+  }
+
+  std::vector<TablebaseTable> tables;
+  for (const auto &white : sides) {
+    for (const auto &black : sides) {
+      const int count = 2 + static_cast<int>(white.size() + black.size());
+      if (count > maxPieces || count < 3 || !isStrongerSide(white, black)) {
+        continue;
+      }
+
+      TablebaseTable table;
+      table.name = getSideName(white) + "v" + getSideName(black);
+      table.pieces.emplace_back(PieceType::king, Color::white);
+      for (const auto type : white) {
+        table.pieces.emplace_back(type, Color::white);
+        table.hasPawns |= (type == PieceType::pawn);
+      }
+      table.pieces.emplace_back(PieceType::king, Color::black);
+      for (const auto type : black) {
+        table.pieces.emplace_back(type, Color::black);
+        table.hasPawns |= (type == PieceType::pawn);
+      }
+      tables.push_back(table);
+    }
+  }
+
+  // Captures lead to tables with fewer pieces, promotions to tables with
+  // fewer pawns
+  auto countPawns = [](const TablebaseTable &table) {
+    return std::count_if(table.pieces.begin(), table.pieces.end(),
+                         [](const auto &piece) {
+                           return piece.first == PieceType::pawn;
+                         });
+  };
+  std::stable_sort(tables.begin(), tables.end(),
+                   [&countPawns](const auto &a, const auto &b) {
+                     if (a.pieces.size() != b.pieces.size()) {
+                       return a.pieces.size() < b.pieces.size();
+                     }
+                     return countPawns(a) < countPawns(b);
+                   });
+
+  return tables;
+}
+
+bool Tablebase::locate(const std::vector<TablebasePiece> &pieces,
+                       Color toMove, std::string &tableName, size_t &index) {
+  const int count = static_cast<int>(pieces.size());
+  if (count < 3 || count > k_maxTablebasePieces) {
+    return false;
+  }
+
+  std::vector<PieceType> white;
+  std::vector<PieceType> black;
+  int whiteKings = 0;
+  int blackKings = 0;
+  bool hasPawns = false;
+
+  for (const auto &piece : pieces) {
+    if (piece.type == PieceType::king) {
+      (piece.color == Color::white) ? ++whiteKings : ++blackKings;
+    } else {
+      (piece.color == Color::white) ? white.push_back(piece.type)
+                                    : black.push_back(piece.type);
+      hasPawns |= (piece.type == PieceType::pawn);
+    }
+  }
+
+  if (whiteKings != 1 || blackKings != 1) {
+    return false;
+  }
+
+  auto byOrder = [](PieceType a, PieceType b) {
+    return getTypeOrder(a) < getTypeOrder(b);
+  };
+  std::sort(white.begin(), white.end(), byOrder);
+  std::sort(black.begin(), black.end(), byOrder);
+
+  // Store the stronger side as white, mirroring the board vertically
+  const bool flip = !isStrongerSide(white, black);
+  const Color strongColor = flip ? Color::black : Color::white;
+  tableName = flip ? getSideName(black) + "v" + getSideName(white)
+                   : getSideName(white) + "v" + getSideName(black);
+
+  // Lay squares out in table order: strong king, strong pieces, weak king,
+  // weak pieces
+  TablebaseSquares squares = {};
+  int next = 0;
+  for (const bool strong : {true, false}) {
+    const Color color = strong ? strongColor : getOtherColor(strongColor);
+    for (const auto &piece : pieces) {
+      if (piece.color == color && piece.type == PieceType::king) {
+        squares[next++] = flip ? (piece.square ^ 56) : piece.square;
+      }
+    }
+    for (const auto type : k_nonKingTypes) {
+      for (const auto &piece : pieces) {
+        if (piece.color == color && piece.type == type) {
+          squares[next++] = flip ? (piece.square ^ 56) : piece.square;
+        }
+      }
+    }
+  }
+
+  index = computeIndex(squares, count, hasPawns,
+                       flip ? getOtherColor(toMove) : toMove);
+  return true;
+}
+
+TablebaseResult Tablebase::decode(uint8_t value) {
+  if (value == k_tablebaseDraw || value >= k_tablebaseUnknown) {
+    return {TablebaseOutcome::draw, 0};
+  }
+
+  if (value <= k_tablebaseMaxWin) {
+    return {TablebaseOutcome::win, value};
+  }
+
+  return {TablebaseOutcome::loss, value - k_tablebaseLossBase};
+}
+
+bool Tablebase::write(const std::string &filename,
+                      const std::vector<TablebaseTable> &tables,
+                      const std::vector<std::vector<uint8_t>> &data) {
+  std::ofstream ofs(filename, std::ios::binary);
+  if (!ofs.is_open()) {
+    std::cout << "Error: could not write " << filename << std::endl;
+    return false;
+  }
+
+  FileHeader header = {};
+  std::memcpy(header.magic, k_magic, sizeof(k_magic));
+  header.version = k_version;
+  header.tableCount = static_cast<uint32_t>(tables.size());
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  auto align = [](uint64_t offset) {
+    return (offset + k_tableAlignment - 1) / k_tableAlignment *
+           k_tableAlignment;
+  };
+
+  uint64_t offset =
+      align(sizeof(FileHeader) + tables.size() * sizeof(FileEntry));
+  for (size_t i = 0; i < tables.size(); ++i) {
+    FileEntry entry = {};
+    std::strncpy(entry.name, tables[i].name.c_str(), k_nameLength - 1);
+    entry.offset = offset;
+    entry.size = data[i].size();
+    ofs.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    offset = align(offset + entry.size);
+  }
+
+  for (size_t i = 0; i < tables.size(); ++i) {
+    const uint64_t position = static_cast<uint64_t>(ofs.tellp());
+    const std::vector<char> padding(align(position) - position, 0);
+    ofs.write(padding.data(), padding.size());
+    ofs.write(reinterpret_cast<const char *>(data[i].data()), data[i].size());
+  }
+
+  return ofs.good();
+}
@@ -0,0 +1,611 @@
+#include "TablebaseGenerator.h"
+
+#include <atomic>
+#include <chrono>
+
+namespace {
+
+constexpr int k_noSquare = -1;
+
+// Marks positions that have nothing scheduled, ply 0 never is
+constexpr uint8_t k_nothingScheduled = 0;
+
+// Losses have to stay below the unknown marker
+constexpr int k_maxPly = k_tablebaseUnknown - k_tablebaseLossBase - 1;
+
+// Threads grab this many indices at a time
+constexpr size_t k_blockSize = 4096;
+
+constexpr std::array<std::pair<int, int>, 8> k_kingSteps = {
+    {{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}}};
+constexpr std::array<std::pair<int, int>, 8> k_knightSteps = {
+    {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}}};
+constexpr std::array<std::pair<int, int>, 4> k_diagonalSteps = {
+    {{1, 1}, {1, -1}, {-1, 1}, {-1, -1}}};
+constexpr std::array<std::pair<int, int>, 4> k_orthogonalSteps = {
+    {{1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
+
+constexpr std::array<PieceType, 4> k_promotionTypes = {
+    PieceType::queen, PieceType::rook, PieceType::bishop, PieceType::knight};
+
+// Flattened copy of a table's pieces
+struct Layout {
+  int count = 0;
+  std::array<PieceType, k_maxTablebasePieces> types = {};
+  std::array<Color, k_maxTablebasePieces> colors = {};
+  // Indexed by color
+  std::array<int, 2> kings = {};
+};
+
+Layout getLayout(const TablebaseTable &table) {
+  Layout layout;
+  layout.count = static_cast<int>(table.pieces.size());
+  for (int i = 0; i < layout.count; ++i) {
+    layout.types[i] = table.pieces[i].first;
+    layout.colors[i] = table.pieces[i].second;
+    if (layout.types[i] == PieceType::king) {
+      layout.kings[static_cast<int>(layout.colors[i])] = i;
+    }
+  }
+  return layout;
+}
+
+inline bool isOnBoard(int file, int rank) {
+  return file >= 0 && file < 8 && rank >= 0 && rank < 8;
+}
+
+inline int getSign(int value) { return (value > 0) - (value < 0); }
+
+inline uint8_t loadEntry(std::vector<uint8_t> &entries, size_t index) {
+  return std::atomic_ref<uint8_t>(entries[index])
+      .load(std::memory_order_relaxed);
+}
+
+// Only unknown entries are ever overwritten, so the first writer wins
+inline bool resolveEntry(std::vector<uint8_t> &entries, size_t index,
+                         uint8_t value) {
+  uint8_t expected = k_tablebaseUnknown;
+  return std::atomic_ref<uint8_t>(entries[index])
+      .compare_exchange_strong(expected, value, std::memory_order_relaxed);
+}
+
+int getPieceOn(const Layout &layout, const TablebaseSquares &squares,
+               int square) {
+  for (int i = 0; i < layout.count; ++i) {
+    if (squares[i] == square) {
+      return i;
+    }
+  }
+  return k_noSquare;
+}
+
+bool attacks(const Layout &layout, const TablebaseSquares &squares, int piece,
+             int target) {
+  const int fileDiff = target % 8 - squares[piece] % 8;
+  const int rankDiff = target / 8 - squares[piece] / 8;
+  const bool isDiagonal = std::abs(fileDiff) == std::abs(rankDiff);
+  const bool isOrthogonal = fileDiff == 0 || rankDiff == 0;
+
+  if (fileDiff == 0 && rankDiff == 0) {
+    return false;
+  }
+
+  switch (layout.types[piece]) {
+  case PieceType::king:
+    return std::max(std::abs(fileDiff), std::abs(rankDiff)) == 1;
+  case PieceType::knight:
+    return std::abs(fileDiff * rankDiff) == 2;
+  case PieceType::pawn:
+    return std::abs(fileDiff) == 1 &&
+           rankDiff == ((layout.colors[piece] == Color::white) ? 1 : -1);
+  case PieceType::bishop:
+    if (!isDiagonal) {
+      return false;
+    }
+    break;
+  case PieceType::rook:
+    if (!isOrthogonal) {
+      return false;
+    }
+    break;
+  case PieceType::queen:
+    if (!isDiagonal && !isOrthogonal) {
+      return false;
+    }
+    break;
+  default:
+    return false;
+  }
+
+  // Sliders need a clear path
+  const int step = getSign(rankDiff) * 8 + getSign(fileDiff);
+  for (int square = squares[piece] + step; square != target; square += step) {
+    if (getPieceOn(layout, squares, square) != k_noSquare) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool isInCheck(const Layout &layout, const TablebaseSquares &squares,
+               Color color) {
+  const int king = squares[layout.kings[static_cast<int>(color)]];
+  for (int i = 0; i < layout.count; ++i) {
+    if (layout.colors[i] != color && squares[i] != k_noSquare &&
+        attacks(layout, squares, i, king)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Calls onMove(child, movedPiece, promotion, isCapture) for every legal move
+template <typename Callback>
+void forEachMove(const Layout &layout, const TablebaseSquares &squares,
+                 Color toMove, Callback &&onMove) {
+  auto tryMove = [&](int piece, int target, PieceType promotion) {
+    TablebaseSquares child = squares;
+    const int captured = getPieceOn(layout, squares, target);
+    if (captured != k_noSquare) {
+      if (layout.colors[captured] == toMove ||
+          layout.types[captured] == PieceType::king) {
+        return;
+      }
+      child[captured] = k_noSquare;
+    }
+    child[piece] = target;
+
+    if (!isInCheck(layout, child, toMove)) {
+      onMove(child, piece, promotion, captured != k_noSquare);
+    }
+  };
+
+  auto tryPawnMove = [&](int piece, int target) {
+    const int lastRank = (toMove == Color::white) ? 7 : 0;
+    if (target / 8 != lastRank) {
+      tryMove(piece, target, PieceType::none);
+      return;
+    }
+    for (const auto promotion : k_promotionTypes) {
+      tryMove(piece, target, promotion);
+    }
+  };
+
+  auto trySteps = [&](int piece, const auto &steps, bool slides) {
+    for (const auto &step : steps) {
+      int file = squares[piece] % 8 + step.first;
+      int rank = squares[piece] / 8 + step.second;
+      while (isOnBoard(file, rank)) {
+        const int target = rank * 8 + file;
+        tryMove(piece, target, PieceType::none);
+        if (!slides || getPieceOn(layout, squares, target) != k_noSquare) {
+          break;
+        }
+        file += step.first;
+        rank += step.second;
+      }
+    }
+  };
+
+  for (int i = 0; i < layout.count; ++i) {
+    if (layout.colors[i] != toMove || squares[i] == k_noSquare) {
+      continue;
+    }
+
+    switch (layout.types[i]) {
+    case PieceType::king:
+      trySteps(i, k_kingSteps, false);
+      break;
+    case PieceType::knight:
+      trySteps(i, k_knightSteps, false);
+      break;
+    case PieceType::bishop:
+      trySteps(i, k_diagonalSteps, true);
+      break;
+    case PieceType::rook:
+      trySteps(i, k_orthogonalSteps, true);
+      break;
+    case PieceType::queen:
+      trySteps(i, k_diagonalSteps, true);
+      trySteps(i, k_orthogonalSteps, true);
+      break;
+    case PieceType::pawn: {
+      const int direction = (toMove == Color::white) ? 8 : -8;
+      const int startRank = (toMove == Color::white) ? 1 : 6;
+      const int file = squares[i] % 8;
+      const int forward = squares[i] + direction;
+
+      if (getPieceOn(layout, squares, forward) == k_noSquare) {
+        tryPawnMove(i, forward);
+        if (squares[i] / 8 == startRank &&
+            getPieceOn(layout, squares, forward + direction) == k_noSquare) {
+          tryMove(i, forward + direction, PieceType::none);
+        }
+      }
+
+      for (const int fileStep : {-1, 1}) {
+        if (!isOnBoard(file + fileStep, 0)) {
+          continue;
+        }
+        const int target = forward + fileStep;
+        const int captured = getPieceOn(layout, squares, target);
+        if (captured != k_noSquare && layout.colors[captured] != toMove) {
+          tryPawnMove(i, target);
+        }
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+// Calls onUnmove(parent) for every position the side not to move could have
+// come from with a move that neither captured nor promoted
+template <typename Callback>
+void forEachUnmove(const Layout &layout, const TablebaseSquares &squares,
+                   Color toMove, Callback &&onUnmove) {
+  const Color mover = getOtherColor(toMove);
+
+  auto tryUnmove = [&](int piece, int origin) {
+    TablebaseSquares parent = squares;
+    parent[piece] = origin;
+    // The side to move now can't have been left in check
+    if (!isInCheck(layout, parent, toMove)) {
+      onUnmove(parent);
+    }
+  };
+
+  auto trySteps = [&](int piece, const auto &steps, bool slides) {
+    for (const auto &step : steps) {
+      int file = squares[piece] % 8 + step.first;
+      int rank = squares[piece] / 8 + step.second;
+      while (isOnBoard(file, rank) &&
+             getPieceOn(layout, squares, rank * 8 + file) == k_noSquare) {
+        tryUnmove(piece, rank * 8 + file);
+        if (!slides) {
+          break;
+        }
+        file += step.first;
+        rank += step.second;
+      }
+    }
+  };
+
+  for (int i = 0; i < layout.count; ++i) {
+    if (layout.colors[i] != mover || squares[i] == k_noSquare) {
+      continue;
+    }
+
+    switch (layout.types[i]) {
+    case PieceType::king:
+      trySteps(i, k_kingSteps, false);
+      break;
+    case PieceType::knight:
+      trySteps(i, k_knightSteps, false);
+      break;
+    case PieceType::bishop:
+      trySteps(i, k_diagonalSteps, true);
+      break;
+    case PieceType::rook:
+      trySteps(i, k_orthogonalSteps, true);
+      break;
+    case PieceType::queen:
+      trySteps(i, k_diagonalSteps, true);
+      trySteps(i, k_orthogonalSteps, true);
+      break;
+    case PieceType::pawn: {
+      const int direction = (mover == Color::white) ? 8 : -8;
+      const int doublePushRank = (mover == Color::white) ? 3 : 4;
+      const int origin = squares[i] - direction;
+
+      // Pawns never stand on the back ranks
+      if (origin / 8 == 0 || origin / 8 == 7 ||
+          getPieceOn(layout, squares, origin) != k_noSquare) {
+        break;
+      }
+      tryUnmove(i, origin);
+
+      if (squares[i] / 8 == doublePushRank &&
+          getPieceOn(layout, squares, origin - direction) == k_noSquare) {
+        tryUnmove(i, origin - direction);
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+bool isLegal(const TablebaseTable &table, const Layout &layout,
+             const TablebaseSquares &squares, Color toMove, size_t index) {
+  for (int i = 0; i < layout.count; ++i) {
+    if (layout.types[i] == PieceType::pawn &&
+        (squares[i] / 8 == 0 || squares[i] / 8 == 7)) {
+      return false;
+    }
+    for (int j = i + 1; j < layout.count; ++j) {
+      if (squares[i] == squares[j]) {
+        return false;
+      }
+    }
+  }
+
+  // Skip indices that are a mirror image of another index
+  if (table.getIndex(squares, toMove) != index) {
+    return false;
+  }
+
+  return !isInCheck(layout, squares, getOtherColor(toMove));
+}
+
+// Runs work(index) over every index in the table
+template <typename Work>
+void runInParallel(int numThreads, size_t size, const Work &work) {
+  std::atomic<size_t> nextBlock = 0;
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads);
+
+  for (int t = 0; t < numThreads; ++t) {
+    threads.emplace_back([&nextBlock, &work, size]() {
+      while (true) {
+        const size_t begin = nextBlock.fetch_add(k_blockSize);
+        if (begin >= size) {
+          return;
+        }
+        const size_t end = std::min(size, begin + k_blockSize);
+        for (size_t i = begin; i < end; ++i) {
+          work(i);
+        }
+      }
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace
+
+uint8_t TablebaseGenerator::probeConversion(const TablebaseTable &table,
+                                            const TablebaseSquares &squares,
+                                            int movedPiece, PieceType promotion,
+                                            Color toMove) const {
+  std::vector<TablebasePiece> pieces;
+  pieces.reserve(k_maxTablebasePieces);
+  for (size_t i = 0; i < table.pieces.size(); ++i) {
+    if (squares[i] == k_noSquare) {
+      continue;
+    }
+    const bool promoted =
+        static_cast<int>(i) == movedPiece && promotion != PieceType::none;
+    pieces.push_back({promoted ? promotion : table.pieces[i].first,
+                      table.pieces[i].second, squares[i]});
+  }
+
+  std::string tableName;
+  size_t index = 0;
+  if (pieces.size() == 2 ||
+      !Tablebase::locate(pieces, toMove, tableName, index)) {
+    // Bare kings
+    return k_tablebaseDraw;
+  }
+
+  const auto it = m_generated.find(tableName);
+  if (it == m_generated.end()) {
+    std::cout << "Error: " << table.name << " depends on " << tableName
+              << ", which hasn't been generated" << std::endl;
+    return k_tablebaseDraw;
+  }
+
+  return it->second[index];
+}
+
+std::vector<uint8_t> TablebaseGenerator::generate(const TablebaseTable &table) {
+  const Layout layout = getLayout(table);
+  const size_t size = table.size();
+
+  std::vector<uint8_t> entries(size, k_tablebaseUnknown);
+  // Ply at which a capture or promotion wins the position
+  std::vector<uint8_t> conversionWins(size, k_nothingScheduled);
+  // Ply at which a position where every move loses gets resolved, for when
+  // the slowest of those losses goes through a capture or promotion
+  std::vector<uint8_t> pendingLosses(size, k_nothingScheduled);
+
+  // Distance to mate for a position where every move leads to a win for the
+  // opponent, or 0 if there's a move that doesn't (yet)
+  auto getLossDistance = [&](const TablebaseSquares &squares, Color toMove) {
+    int slowestLoss = 0;
+    bool allLose = true;
+
+    forEachMove(layout, squares, toMove,
+                [&](const TablebaseSquares &child, int piece,
+                    PieceType promotion, bool isCapture) {
+                  if (!allLose) {
+                    return;
+                  }
+                  const Color opponent = getOtherColor(toMove);
+                  const uint8_t value =
+                      (isCapture || promotion != PieceType::none)
+                          ? probeConversion(table, child, piece, promotion,
+                                            opponent)
+                          : loadEntry(entries,
+                                      table.getIndex(child, opponent));
+                  if (value == k_tablebaseDraw || value > k_tablebaseMaxWin) {
+                    allLose = false;
+                    return;
+                  }
+                  slowestLoss = std::max(slowestLoss, value + 1);
+                });
+
+    return allLose ? slowestLoss : 0;
+  };
+
+  // Mates, stalemates and anything decided by captures or promotions
+  runInParallel(m_numThreads, size, [&](size_t index) {
+    TablebaseSquares squares;
+    Color toMove;
+    table.getSquares(index, squares, toMove);
+
+    if (!isLegal(table, layout, squares, toMove, index)) {
+      entries[index] = k_tablebaseIllegal;
+      return;
+    }
+
+    bool hasMoves = false;
+    bool canAvoidLoss = false;
+    int fastestWin = 0;
+    int slowestLoss = 0;
+
+    forEachMove(layout, squares, toMove,
+                [&](const TablebaseSquares &child, int piece,
+                    PieceType promotion, bool isCapture) {
+                  hasMoves = true;
+                  if (!isCapture && promotion == PieceType::none) {
+                    canAvoidLoss = true;
+                    return;
+                  }
+
+                  const auto result = Tablebase::decode(probeConversion(
+                      table, child, piece, promotion, getOtherColor(toMove)));
+                  switch (result.outcome) {
+                  case TablebaseOutcome::loss:
+                    fastestWin = (fastestWin == 0)
+                                     ? result.distanceToMate + 1
+                                     : std::min(fastestWin,
+                                                result.distanceToMate + 1);
+                    break;
+                  case TablebaseOutcome::win:
+                    slowestLoss =
+                        std::max(slowestLoss, result.distanceToMate + 1);
+                    break;
+                  case TablebaseOutcome::draw:
+                    canAvoidLoss = true;
+                    break;
+                  }
+                });
+
+    if (!hasMoves) {
+      entries[index] = isInCheck(layout, squares, toMove) ? k_tablebaseLossBase
+                                                          : k_tablebaseDraw;
+    } else if (fastestWin > 0) {
+      conversionWins[index] = static_cast<uint8_t>(fastestWin);
+    } else if (!canAvoidLoss) {
+      pendingLosses[index] = static_cast<uint8_t>(slowestLoss);
+    }
+  });
+
+  for (int ply = 1; ply <= k_maxPly; ++ply) {
+    std::atomic<size_t> resolved = 0;
+    const uint8_t lostLastPly = k_tablebaseLossBase + ply - 1;
+    const uint8_t wonLastPly = ply - 1;
+
+    runInParallel(m_numThreads, size, [&](size_t index) {
+      const uint8_t value = loadEntry(entries, index);
+
+      if (value == k_tablebaseUnknown) {
+        if (conversionWins[index] == ply) {
+          resolved += resolveEntry(entries, index, ply);
+        } else if (loadEntry(pendingLosses, index) == ply) {
+          resolved += resolveEntry(entries, index, k_tablebaseLossBase + ply);
+        }
+        return;
+      }
+
+      const bool wasLost = value == lostLastPly;
+      const bool wasWon = ply > 1 && value == wonLastPly;
+      if (!wasLost && !wasWon) {
+        return;
+      }
+
+      TablebaseSquares squares;
+      Color toMove;
+      table.getSquares(index, squares, toMove);
+      const Color mover = getOtherColor(toMove);
+
+      forEachUnmove(layout, squares, toMove,
+                    [&](const TablebaseSquares &parent) {
+                      const size_t parentIndex = table.getIndex(parent, mover);
+
+                      // Any move into a lost position wins
+                      if (wasLost) {
+                        resolved += resolveEntry(entries, parentIndex, ply);
+                        return;
+                      }
+
+                      if (loadEntry(entries, parentIndex) !=
+                          k_tablebaseUnknown) {
+                        return;
+                      }
+                      const int distance = getLossDistance(parent, mover);
+                      if (distance == ply) {
+                        resolved += resolveEntry(entries, parentIndex,
+                                                 k_tablebaseLossBase + ply);
+                      } else if (distance > ply) {
+                        std::atomic_ref<uint8_t>(pendingLosses[parentIndex])
+                            .store(static_cast<uint8_t>(distance),
+                                   std::memory_order_relaxed);
+                      }
+                    });
+    });
+
+    if (resolved > 0) {
+      continue;
+    }
+
+    // Nothing left to propagate, but conversions may still be due
+    bool isScheduled = false;
+    for (size_t i = 0; i < size && !isScheduled; ++i) {
+      isScheduled = entries[i] == k_tablebaseUnknown &&
+                    (conversionWins[i] > ply || pendingLosses[i] > ply);
+    }
+    if (!isScheduled) {
+      break;
+    }
+  }
+
+  // Whatever couldn't be resolved is a draw
+  for (auto &entry : entries) {
+    if (entry == k_tablebaseUnknown) {
+      entry = k_tablebaseDraw;
+    }
+  }
+
+  return entries;
+}
+
+bool TablebaseGenerator::generateAll(int maxPieces,
+                                     const std::string &filename) {
+  const auto tables = Tablebase::getAllTables(maxPieces);
+
+  for (const auto &table : tables) {
+    const auto start = std::chrono::steady_clock::now();
+    auto entries = generate(table);
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    int longestWin = 0;
+    for (const auto entry : entries) {
+      if (entry <= k_tablebaseMaxWin) {
+        longestWin = std::max(longestWin, static_cast<int>(entry));
+      }
+    }
+
+    printf("Generated %s: %zu entries, longest win %d plies, %.2f s\n",
+           table.name.c_str(), entries.size(), longestWin, elapsed.count());
+    m_generated[table.name] = std::move(entries);
+  }
+
+  std::vector<std::vector<uint8_t>> data;
+  data.reserve(tables.size());
+  for (const auto &table : tables) {
+    data.push_back(std::move(m_generated[table.name]));
+  }
+  m_generated.clear();
+
+  return Tablebase::write(filename, tables, data);
+}
@@ -0,0 +1,146 @@
+#include "Trace.h"
+
+#ifdef CHESS_TRACE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Per thread, about 1.5 MB each
+constexpr size_t k_bufferSize = 1 << 16;
+
+struct TraceSpan {
+  const char *name;
+  int64_t start;
+  int64_t end;
+};
+
+// Spans are stored field by field as atomics, so writeTrace() can copy them
+// while they're being written without it being a data race
+struct TraceSlot {
+  std::atomic<const char *> name = nullptr;
+  std::atomic<int64_t> start = 0;
+  std::atomic<int64_t> end = 0;
+};
+
+// Written only by the thread it belongs to. head counts every span ever
+// recorded, so the newest k_bufferSize of them are the ones still there.
+// claimed is bumped before a slot is written and head after, so a reader can
+// tell which slots may have been overwritten under it
+struct TraceBuffer {
+  std::array<TraceSlot, k_bufferSize> slots;
+  std::atomic<size_t> claimed = 0;
+  std::atomic<size_t> head = 0;
+  size_t threadId = 0;
+};
+
+// Buffers are never freed, so threads that have finished still get written
+std::mutex g_buffersMutex;
+std::vector<std::unique_ptr<TraceBuffer>> g_buffers;
+
+// Only locks the first time a thread records anything
+TraceBuffer &getThreadBuffer() {
+  thread_local TraceBuffer *buffer = nullptr;
+  if (!buffer) {
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+    g_buffers.push_back(std::make_unique<TraceBuffer>());
+    buffer = g_buffers.back().get();
+    buffer->threadId = g_buffers.size();
+  }
+  return *buffer;
+}
+
+// The spans still in buffer, oldest first. Its thread can keep recording
+// while this copies them, so any that might have been overwritten partway
+// are dropped rather than written out torn
+std::vector<TraceSpan> copySpans(const TraceBuffer &buffer) {
+  const size_t head = buffer.head.load(std::memory_order_acquire);
+  const size_t first = (head > k_bufferSize) ? head - k_bufferSize : 0;
+
+  std::vector<TraceSpan> spans;
+  spans.reserve(head - first);
+  for (size_t i = first; i < head; ++i) {
+    const auto &slot = buffer.slots[i % k_bufferSize];
+    spans.push_back({slot.name.load(std::memory_order_acquire),
+                     slot.start.load(std::memory_order_acquire),
+                     slot.end.load(std::memory_order_acquire)});
+  }
+
+  // If any slot read above was being rewritten, the acquire loads saw the
+  // claim made before it, so claimed has moved past it
+  const size_t claimed = buffer.claimed.load(std::memory_order_relaxed);
+  const size_t firstIntact =
+      (claimed > k_bufferSize) ? claimed - k_bufferSize : 0;
+  if (firstIntact > first) {
+    spans.erase(spans.begin(),
+                spans.begin() + std::min(firstIntact - first, spans.size()));
+  }
+
+  return spans;
+}
+
+} // namespace
+
+void recordTraceSpan(const char *name, int64_t start, int64_t end) {
+  TraceBuffer &buffer = getThreadBuffer();
+  const size_t head = buffer.head.load(std::memory_order_relaxed);
+  buffer.claimed.store(head + 1, std::memory_order_relaxed);
+
+  auto &slot = buffer.slots[head % k_bufferSize];
+  slot.name.store(name, std::memory_order_release);
+  slot.start.store(start, std::memory_order_release);
+  slot.end.store(end, std::memory_order_release);
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+bool writeTrace(const std::string &filename) {
+  std::FILE *file = std::fopen(filename.c_str(), "wb");
+  if (!file) {
+    std::cout << "Error: could not open " << filename << " for writing"
+              << std::endl;
+    return false;
+  }
+
+  // Copied once up front, so both passes below see the same spans
+  std::vector<std::pair<size_t, std::vector<TraceSpan>>> threads;
+  {
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+    for (const auto &buffer : g_buffers) {
+      threads.emplace_back(buffer->threadId, copySpans(*buffer));
+    }
+  }
+
+  // Times are relative to the first span, in microseconds
+  int64_t origin = INT64_MAX;
+  for (const auto &[threadId, spans] : threads) {
+    for (const auto &span : spans) {
+      origin = std::min(origin, span.start);
+    }
+  }
+
+  std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+  bool isFirst = true;
+  for (const auto &[threadId, spans] : threads) {
+    for (const auto &span : spans) {
+      std::fprintf(file,
+                   "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,"
+                   "\"ts\":%.3f,\"dur\":%.3f}",
+                   isFirst ? "" : ",", span.name, threadId,
+                   (span.start - origin) / 1000.0,
+                   (span.end - span.start) / 1000.0);
+      isFirst = false;
+    }
+  }
+  std::fputs("\n]}\n", file);
+
+  return std::fclose(file) == 0;
+}
+
+#endif // CHESS_TRACE
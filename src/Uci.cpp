@@ -0,0 +1,423 @@
+#include "Uci.h"
+#include "Fen.h"
+
+#include <cstdio>
+
+namespace {
+
+const std::string k_engineName = "chesscpp";
+const std::string k_engineAuthor = "jdmsharpe";
+
+// In moves
+constexpr size_t k_defaultBookDepth = 12;
+
+// Nothing has more legal moves than this
+constexpr size_t k_maxMultiPv = 256;
+
+std::string toUci(const Position &position) {
+  return {static_cast<char>('a' + position.first),
+          static_cast<char>('1' + position.second)};
+}
+
+std::optional<Position> fromUci(std::string_view square) {
+  if (square.size() != 2 || square[0] < 'a' || square[0] > 'h' ||
+      square[1] < '1' || square[1] > '8') {
+    return std::nullopt;
+  }
+  return Position(square[0] - 'a', square[1] - '1');
+}
+
+PieceType getPromotion(char letter) {
+  switch (letter) {
+  case 'n':
+    return PieceType::knight;
+  case 'b':
+    return PieceType::bishop;
+  case 'r':
+    return PieceType::rook;
+  default:
+    return PieceType::queen;
+  }
+}
+
+// For the w and b in wtime, binc, etc.
+inline Color getColor(char letter) {
+  return (letter == 'w') ? Color::white : Color::black;
+}
+
+} // namespace
+
+std::string toUciMove(Board &board, const std::pair<Position, Position> &move) {
+  std::string uci = toUci(move.first) + toUci(move.second);
+
+  const auto *piece = board.getPieceAt(move.first);
+  if (piece && piece->getType() == PieceType::pawn &&
+      (move.second.second == 0 || move.second.second == 7)) {
+    uci += 'q';
+  }
+  return uci;
+}
+
+std::vector<std::string>
+toUciPv(Board &board, const std::vector<std::pair<Position, Position>> &pv) {
+  // Every move gets its own depth, i.e. its own square for what it captures
+  std::vector<std::string> moves;
+  for (size_t i = 0; i < pv.size(); ++i) {
+    moves.push_back(toUciMove(board, pv[i]));
+    board.testMove(pv[i].first, pv[i].second, pv.size() - i);
+  }
+  for (size_t i = pv.size(); i-- > 0;) {
+    board.undoMove(pv[i].first, pv[i].second, pv.size() - i);
+  }
+  return moves;
+}
+
+bool playUciMove(Board &board, Color color, std::string_view move) {
+  const auto start = fromUci(move.substr(0, 2));
+  const auto end = fromUci(move.substr(std::min<size_t>(move.size(), 2), 2));
+  const PieceType promotion = getPromotion(move.size() > 4 ? move[4] : 'q');
+  return start.has_value() && end.has_value() && move.size() <= 5 &&
+         board.applyMove(color, start.value(), end.value(), promotion);
+}
+
+UciEngine::UciEngine(std::ostream &output)
+    : m_output(output), m_bookDepth(k_defaultBookDepth) {
+  m_board.loadGame();
+  m_board.refreshValidMoves();
+}
+
+UciEngine::~UciEngine() { stopSearch(); }
+
+int UciEngine::run(std::istream &input) {
+  std::string line;
+  while (std::getline(input, line)) {
+    if (!handleCommand(line)) {
+      return 0;
+    }
+  }
+
+  // Piped in commands shouldn't lose the last search
+  waitForSearch();
+  return 0;
+}
+
+bool UciEngine::handleCommand(const std::string &line) {
+  std::istringstream tokens(line);
+  std::string command;
+  tokens >> command;
+
+  if (command == "uci") {
+    sendId();
+  } else if (command == "isready") {
+    send("readyok");
+  } else if (command == "ucinewgame") {
+    stopSearch();
+    m_board.loadGame();
+    m_board.refreshValidMoves();
+    m_color = Color::white;
+    m_ply = 0;
+    if (m_seed.has_value()) {
+      m_computer.setSeed(m_seed.value());
+    }
+  } else if (command == "position") {
+    stopSearch();
+    setPosition(tokens);
+  } else if (command == "setoption") {
+    stopSearch();
+    setOption(tokens);
+  } else if (command == "go") {
+    stopSearch();
+    startSearch(tokens);
+  } else if (command == "ponderhit") {
+    ponderHit();
+  } else if (command == "stop") {
+    stopSearch();
+  } else if (command == "quit") {
+    stopSearch();
+    return false;
+  } else if (!command.empty()) {
+    send("info string unknown command " + command);
+  }
+
+  return true;
+}
+
+void UciEngine::sendId() {
+  send("id name " + k_engineName);
+  send("id author " + k_engineAuthor);
+  send("option name BookFile type string default <empty>");
+  send("option name BookDepth type spin default " +
+       std::to_string(k_defaultBookDepth) + " min 0 max 100");
+  send("option name TablebaseFile type string default <empty>");
+  send("option name Ponder type check default false");
+  send("option name MultiPV type spin default 1 min 1 max " +
+       std::to_string(k_maxMultiPv));
+  send("option name Seed type spin default 0 min 0 max " +
+       std::to_string(INT32_MAX));
+  send("uciok");
+}
+
+void UciEngine::setPosition(std::istringstream &tokens) {
+  std::string token;
+  tokens >> token;
+
+  if (token == "startpos") {
+    m_board.loadGame();
+    m_board.refreshValidMoves();
+    m_color = Color::white;
+    m_ply = 0;
+    tokens >> token;
+  } else if (token == "fen") {
+    std::string fen;
+    while (tokens >> token && token != "moves") {
+      fen += token + " ";
+    }
+
+    LumpedBoardAndGameState state;
+    if (!readFen(fen, state)) {
+      send("info string invalid fen " + fen);
+      return;
+    }
+    m_board.loadFromState(state);
+    m_color = state.whoseTurn;
+    m_ply = 2 * (std::max<size_t>(state.turnNum, 1) - 1) +
+            (m_color == Color::black ? 1 : 0);
+  } else {
+    return;
+  }
+
+  if (token != "moves") {
+    return;
+  }
+
+  while (tokens >> token) {
+    if (!playUciMove(m_board, m_color, token)) {
+      send("info string illegal move " + token);
+      return;
+    }
+    m_color = getOtherColor(m_color);
+    ++m_ply;
+  }
+}
+
+void UciEngine::setOption(std::istringstream &tokens) {
+  // setoption name <name> [value <value>], either can have spaces
+  std::string token;
+  std::string name;
+  std::string value;
+  std::string *field = nullptr;
+  while (tokens >> token) {
+    if (token == "name") {
+      field = &name;
+    } else if (token == "value") {
+      field = &value;
+    } else if (field) {
+      *field += (field->empty() ? "" : " ") + token;
+    }
+  }
+
+  if (value == "<empty>") {
+    value.clear();
+  }
+
+  if (name == "BookFile") {
+    m_computer.setOpeningBook(nullptr, 0, false);
+    m_book.close();
+    if (!value.empty() && m_book.open(value)) {
+      m_computer.setOpeningBook(&m_book, m_bookDepth, false);
+    }
+  } else if (name == "BookDepth") {
+    m_bookDepth = std::strtoul(value.c_str(), nullptr, 10);
+    if (m_book.isOpen()) {
+      m_computer.setOpeningBook(&m_book, m_bookDepth, false);
+    }
+  } else if (name == "MultiPV") {
+    m_multiPv = std::clamp<size_t>(std::strtoul(value.c_str(), nullptr, 10), 1,
+                                   k_maxMultiPv);
+  } else if (name == "Seed") {
+    // 0 goes back to a different seed every run
+    const uint32_t seed = std::strtoul(value.c_str(), nullptr, 10);
+    m_seed = (seed != 0) ? std::optional<uint32_t>(seed) : std::nullopt;
+    m_computer.setSeed(m_seed.value_or(std::random_device()()));
+  } else if (name == "Ponder") {
+    // Only tells us the GUI might send go ponder, which always works
+  } else if (name == "TablebaseFile") {
+    m_computer.setTablebase(nullptr);
+    if (!value.empty() && m_tablebase.load(value)) {
+      m_computer.setTablebase(&m_tablebase);
+    }
+  } else {
+    send("info string unknown option " + name);
+  }
+}
+
+void UciEngine::startSearch(std::istringstream &tokens) {
+  SearchLimits limits;
+  m_isInfinite = false;
+  m_isPondering = false;
+  std::optional<int> movesToGo;
+  std::array<std::optional<int>, 2> clock;
+  std::array<int, 2> increment = {};
+
+  // Indexed like Color
+  const size_t side = static_cast<size_t>(m_color);
+
+  std::string token;
+  while (tokens >> token) {
+    int value = 0;
+    if (token == "infinite") {
+      m_isInfinite = true;
+    } else if (token == "ponder") {
+      // The position already has the move we expect the opponent to play
+      m_isPondering = true;
+      continue;
+    } else if (!(tokens >> value)) {
+      break;
+    } else if (token == "depth") {
+      limits.depth = std::clamp(value, 1, k_maxSearchDepth);
+    } else if (token == "nodes") {
+      limits.nodes = std::max(value, 1);
+    } else if (token == "movetime") {
+      limits.time = std::chrono::milliseconds(std::max(value, 1));
+    } else if (token == "movestogo") {
+      movesToGo = std::max(value, 1);
+    } else if (token == "wtime" || token == "btime") {
+      clock[static_cast<size_t>(getColor(token[0]))] = value;
+    } else if (token == "winc" || token == "binc") {
+      increment[static_cast<size_t>(getColor(token[0]))] = value;
+    }
+  }
+
+  if (!limits.time.has_value() && clock[side].has_value()) {
+    limits.time = getMoveTime(std::chrono::milliseconds(clock[side].value()),
+                              std::chrono::milliseconds(increment[side]),
+                              movesToGo.value_or(0));
+  }
+
+  m_stopSearch = false;
+  limits.stop = &m_stopSearch;
+  limits.multiPv = m_multiPv;
+  if (m_isPondering) {
+    limits.ponder = &m_isPondering;
+  }
+  m_computer.setColor(m_color);
+
+  m_searchThread = std::thread([this, limits, isInfinite = m_isInfinite]() {
+    std::optional<std::pair<Position, Position>> ponderMove;
+    auto move = m_computer.getBookMove(m_color, m_ply);
+    if (!move.has_value()) {
+      move = m_computer.search(
+          m_color, limits, [this](const SearchInfo &info) {
+            for (size_t i = 0; i < info.lines.size(); ++i) {
+              sendLine(info, i);
+            }
+          });
+      ponderMove = m_computer.getPonderMove();
+      sendStats(m_computer.getStats());
+    }
+
+    // go infinite only reports once it's told to stop, and pondering once
+    // it's told to stop or the opponent plays the move it was pondering on
+    {
+      std::unique_lock<std::mutex> lock(m_stopMutex);
+      m_stopCondition.wait(lock, [this, isInfinite] {
+        return m_stopSearch || (!isInfinite && !m_isPondering);
+      });
+    }
+
+    if (!move.has_value()) {
+      send("bestmove 0000");
+    } else if (!ponderMove.has_value()) {
+      send("bestmove " + toUciMove(m_board, move.value()));
+    } else {
+      send("bestmove " + toUciMove(m_board, move.value()) + " ponder " +
+           toUciMove(m_board, ponderMove.value()));
+    }
+  });
+}
+
+void UciEngine::waitForSearch() {
+  if (m_isInfinite || m_isPondering) {
+    stopSearch();
+  } else if (m_searchThread.joinable()) {
+    m_searchThread.join();
+  }
+}
+
+void UciEngine::ponderHit() {
+  if (!m_searchThread.joinable() || !m_isPondering) {
+    return;
+  }
+
+  // The search picks this up by itself and starts its clock
+  {
+    std::lock_guard<std::mutex> lock(m_stopMutex);
+    m_isPondering = false;
+  }
+  m_stopCondition.notify_all();
+}
+
+void UciEngine::stopSearch() {
+  if (!m_searchThread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_stopMutex);
+    m_stopSearch = true;
+  }
+  m_stopCondition.notify_all();
+  m_searchThread.join();
+}
+
+void UciEngine::sendLine(const SearchInfo &info, size_t index) {
+  const auto &line = info.lines[index];
+  const auto mateMoves = getMateMoves(line.score, info.depth);
+  const std::string score = mateMoves.has_value()
+                                ? "mate " + std::to_string(mateMoves.value())
+                                : "cp " + std::to_string(line.score);
+
+  std::string pv;
+  for (const auto &move : toUciPv(m_board, line.pv)) {
+    pv += (pv.empty() ? "" : " ") + move;
+  }
+
+  // Single line output stays the same for GUIs that don't know multipv
+  const std::string multiPv =
+      (m_multiPv > 1) ? " multipv " + std::to_string(index + 1) : "";
+
+  const std::string tablebaseHits =
+      (info.stats.tablebaseHits > 0)
+          ? " tbhits " + std::to_string(info.stats.tablebaseHits)
+          : "";
+
+  const long long time = info.elapsed.count();
+  send("info depth " + std::to_string(info.depth) + " seldepth " +
+       std::to_string(info.stats.selDepth) + multiPv + " score " + score +
+       " nodes " + std::to_string(info.nodes) + " nps " +
+       std::to_string(info.nodes * 1000 / std::max(time, 1LL)) + " time " +
+       std::to_string(time) + tablebaseHits + " pv " + pv);
+}
+
+void UciEngine::sendStats(const SearchStats &stats) {
+  char line[256];
+  std::snprintf(line, sizeof(line),
+                "info string stats leaves %zu pruned %zu cutoffs %zu "
+                "firstcutoff %.1f%% branching",
+                stats.leafNodes, stats.prunedMoves, stats.cutoffs,
+                stats.getFirstMoveCutoffRate() * 100);
+
+  std::string branching;
+  for (size_t ply = 0; ply + 1 < stats.nodesPerPly.size(); ++ply) {
+    char factor[16];
+    std::snprintf(factor, sizeof(factor), " %.1f",
+                  stats.getBranchingFactor(ply));
+    branching += factor;
+  }
+  send(line + branching);
+}
+
+void UciEngine::send(const std::string &line) {
+  std::lock_guard<std::mutex> lock(m_outputMutex);
+  m_output << line << std::endl;
+}
@@ -1,6 +1,9 @@
 #include "Window.h"
 
 #include "Defs.h"
+#include "Pgn.h"
+#include "Trace.h"
+#include "Zobrist.h"
 
 namespace {
 
@@ -10,7 +13,11 @@ constexpr int k_dt = 16; // ms
 
 constexpr int k_whiteVerticalOffset = 7;
 
-const std::string k_writeFenFilename = "write.fen";
+// Games listed by the position database lookup
+constexpr size_t k_maxDatabaseGames = 10;
+
+// Moves shown by the analysis overlay
+constexpr size_t k_analysisLines = 3;
 
 } // namespace
 
@@ -21,6 +28,8 @@ Window::Window(const bool isLegacyMode) : m_legacyMode(isLegacyMode) {
 }
 
 Window::~Window() {
+  stopPondering();
+
   if (!m_legacyMode) {
     close();
   }
@@ -58,8 +67,8 @@ void Window::open() {
 
   SDL_SetRenderDrawBlendMode(m_sdlRenderer, SDL_BLENDMODE_BLEND);
 
-  m_board.setRenderer(m_sdlRenderer);
-  m_board.loadTextures();
+  m_boardRenderer.setRenderer(m_sdlRenderer);
+  m_boardRenderer.loadTextures();
 }
 
 void Window::close() {
@@ -78,6 +87,7 @@ void Window::close() {
 }
 
 void Window::render() {
+  TRACE_SCOPE("Window::render");
   Uint32 frameStart = SDL_GetTicks();
 
   // Grey background
@@ -85,24 +95,25 @@ void Window::render() {
   SDL_RenderClear(m_sdlRenderer);
 
   if (m_board.pawnToPromote()) {
-    m_board.sdlDisplayPromotionOptions(m_game.whoseTurnIsItNot());
+    m_boardRenderer.displayPromotionOptions(m_game.whoseTurnIsItNot());
   } else {
     if (m_isComputerPlaying) {
       // Don't need to show board from computer's perspective
       RETURN_IF_VALID(!m_computer.getColor().has_value());
 
       if (m_game.whoseTurnIsIt() == m_computer.getColor().value()) {
-        m_board.sdlDisplay(m_game.whoseTurnIsItNot());
+        m_boardRenderer.display(m_game.whoseTurnIsItNot());
       } else {
-        m_board.sdlDisplay(m_game.whoseTurnIsIt());
+        m_boardRenderer.display(m_game.whoseTurnIsIt());
       }
 
     } else {
-      m_board.sdlDisplay(m_game.whoseTurnIsIt());
+      m_boardRenderer.display(m_game.whoseTurnIsIt());
     }
   }
 
   SDL_RenderPresent(m_sdlRenderer);
+  m_presentTime = std::chrono::steady_clock::now();
 
   Uint32 frameTime = SDL_GetTicks() - frameStart;
 
@@ -111,6 +122,7 @@ void Window::render() {
   if (k_dt > frameTime) {
     // Debug print to check actual elapsed time
     // SDL_Log("Elapsed frame time was %d ms.", frameTime);
+    TRACE_SCOPE("SDL_Delay");
     SDL_Delay(k_dt - frameTime);
   }
 }
@@ -146,9 +158,12 @@ void Window::handleKeyboardInput(const SDL_KeyboardEvent &kbe) {
   const Uint8 *kb = SDL_GetKeyboardState(NULL);
 
   if (kbe.keysym.sym == SDLK_r) {
+    stopPondering();
+    m_recorder.flush();
     m_board.loadGame();
     m_board.refreshValidMoves();
-    m_board.clearOldKingHighlight();
+    m_boardRenderer.clearOldKingHighlight();
+    m_boardRenderer.clearAnalysisMoves();
     m_game.reset();
 
     if (m_computer.getColor().has_value()) {
@@ -156,13 +171,136 @@ void Window::handleKeyboardInput(const SDL_KeyboardEvent &kbe) {
     }
   }
 
+  // Anything being pondered was searched to the old depth
   if (kbe.keysym.sym == SDLK_p) {
+    stopPondering();
     m_computer.setDifficulty(1);
   }
 
   if (kbe.keysym.sym == SDLK_m) {
+    stopPondering();
     m_computer.setDifficulty(-1);
   }
+
+  if (kbe.keysym.sym == SDLK_g) {
+    printDatabaseGames();
+  }
+
+  // 1 to 9, then 0 for the tenth, picks a game from the last g listing
+  if (kbe.keysym.sym >= '0' && kbe.keysym.sym <= '9') {
+    loadDatabaseGame((kbe.keysym.sym - '0' + 9) % 10);
+  }
+
+  if (kbe.keysym.sym == SDLK_a) {
+    showAnalysis();
+  }
+}
+
+void Window::showAnalysis() {
+  const Color color = m_game.whoseTurnIsIt();
+
+  // Searched as the side to move, whoever that is
+  AI analyst(m_board);
+  analyst.setColor(color);
+  if (m_tablebase.isLoaded()) {
+    analyst.setTablebase(&m_tablebase);
+  }
+
+  SearchLimits limits;
+  limits.depth = m_computer.getDifficulty();
+  limits.multiPv = k_analysisLines;
+
+  std::vector<SearchLine> lines;
+  analyst.search(color, limits,
+                 [&lines](const SearchInfo &info) { lines = info.lines; });
+
+  std::vector<std::pair<Position, Position>> moves;
+  const auto validMoves = m_board.getValidMovesFor(color);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    for (const auto &validMove : validMoves) {
+      if (validMove.start == lines[i].move.first &&
+          validMove.end == lines[i].move.second) {
+        std::cout << i + 1 << ". " << toSan(m_board, validMove) << " ("
+                  << lines[i].score << ")" << std::endl;
+        break;
+      }
+    }
+    moves.push_back(lines[i].move);
+  }
+
+  m_boardRenderer.setAnalysisMoves(moves);
+}
+
+void Window::printDatabaseGames() {
+  if (!m_positionDatabase.isOpen()) {
+    return;
+  }
+
+  m_databaseMatches.clear();
+  m_positionDatabase.findGames(
+      m_board.getBoardAndGameState(m_game.whoseTurnIsIt()), m_databaseMatches,
+      k_maxDatabaseGames);
+  if (m_databaseMatches.empty()) {
+    std::cout << "No games found for this position" << std::endl;
+    return;
+  }
+
+  PgnGame game;
+  for (size_t i = 0; i < m_databaseMatches.size(); ++i) {
+    const auto &match = m_databaseMatches[i];
+    if (!m_positionDatabase.getGame(match, game)) {
+      continue;
+    }
+
+    std::cout << (i + 1) % 10 << ". " << game.getTag("White") << " - "
+              << game.getTag("Black") << ", " << game.getTag("Event") << " "
+              << game.getTag("Date") << ": " << game.result;
+    if (match.ply < game.moves.size()) {
+      std::cout << " (next " << game.moves[match.ply] << ")";
+    }
+    std::cout << std::endl;
+  }
+  std::cout << "Press a game's number to play on from this position in it"
+            << std::endl;
+}
+
+void Window::loadDatabaseGame(size_t index) {
+  if (index >= m_databaseMatches.size()) {
+    return;
+  }
+
+  stopPondering();
+
+  size_t plies = m_databaseMatches[index].ply;
+  Color whoseTurn;
+  if (!m_positionDatabase.getPosition(m_databaseMatches[index], m_board,
+                                      whoseTurn)) {
+    std::cout << "Couldn't replay that game" << std::endl;
+    // Whatever the board was left as, start over
+    m_board.loadGame();
+    m_board.refreshValidMoves();
+    whoseTurn = Color::white;
+    plies = 0;
+  }
+
+  // Same as a reset, except for where the game starts
+  m_recorder.flush();
+  m_boardRenderer.clearOldPieceHighlight();
+  m_boardRenderer.clearOldKingHighlight();
+  m_boardRenderer.clearAnalysisMoves();
+  m_clickedPositionQueue = {};
+  m_databaseMatches.clear();
+
+  // Counted from the game's start, so the book and the move numbers line up
+  m_game.reset();
+  m_game.setTurn((plies % 2) ? getOtherColor(whoseTurn) : whoseTurn);
+  for (size_t ply = 0; ply < plies; ++ply) {
+    m_game.switchPlayers();
+  }
+
+  if (m_computer.getColor().has_value()) {
+    m_computer.reset();
+  }
 }
 
 void Window::stepGame() {
@@ -215,9 +353,10 @@ void Window::stepLegacyGame() {
 }
 
 void Window::stepSdlGame() {
+  TRACE_SCOPE("Window::stepSdlGame");
   if (m_board.isKingInCheck(m_game.whoseTurnIsIt())) {
     // Alert player if their king is in check
-    m_board.highlightKingInCheck(m_game.whoseTurnIsIt());
+    m_boardRenderer.highlightKingInCheck(m_game.whoseTurnIsIt());
   }
 
   // Unfortunately, we have to handle player promotion here
@@ -249,17 +388,22 @@ void Window::stepSdlGame() {
     }
   }
 
+  // Clear storage for moves to highlight
+  m_boardRenderer.clearOldPieceHighlight();
+  m_boardRenderer.clearOldKingHighlight();
+  m_boardRenderer.clearAnalysisMoves();
+
   if (m_board.isKingCheckmated(m_game.whoseTurnIsItNot())) {
+    // Highlight now because render stops being called after game over
+    m_boardRenderer.highlightKingInCheck(m_game.whoseTurnIsItNot());
     m_game.endWithVictory();
   } else if (m_board.hasStalemateOccurred(m_game.whoseTurnIsItNot())) {
     m_game.endWithDraw();
   }
 
   if (m_saveGames) {
-    m_game.writeToFen(m_activeFilename,
-                      m_board.getBoardAndGameState(m_game.whoseTurnIsItNot(),
-                                                   m_game.getHalfMoveCount(),
-                                                   m_game.getMoveCount()));
+    m_recorder.record(m_board, m_game.whoseTurnIsItNot(),
+                      m_game.getMoveCount());
   }
 
   // When move is complete, turn is over
@@ -267,8 +411,10 @@ void Window::stepSdlGame() {
 }
 
 void Window::endGame() {
+  stopPondering();
   // m_board.cliDisplay(m_game.whoseTurnIsIt());
   m_game.whoWon();
+  m_recorder.flush();
 }
 
 bool Window::makePlayerMove() {
@@ -280,7 +426,7 @@ bool Window::makePlayerMove() {
   // Standard mode uses SDL for graphics
   if (m_clickedPositionQueue.size() < 1) {
     // No input to process
-    m_board.clearOldPieceHighlight();
+    m_boardRenderer.clearOldPieceHighlight();
     return false;
   }
 
@@ -290,7 +436,7 @@ bool Window::makePlayerMove() {
   }
 
   if (m_clickedPositionQueue.size() < 2) {
-    m_board.highlightPotentialMoves(m_clickedPositionQueue.front());
+    m_boardRenderer.highlightPotentialMoves(m_clickedPositionQueue.front());
     return false;
   }
 
@@ -321,9 +467,28 @@ bool Window::makeComputerMove() {
     return false;
   }
 
+  const auto moveStart = std::chrono::steady_clock::now();
   Color computerColor = m_computer.getColor().value();
 
-  const auto &bestMove = m_computer.minimaxRoot(computerColor);
+  // No need to search known theory
+  const auto bookMove =
+      m_computer.getBookMove(computerColor, m_game.getHalfMoveCount());
+  const auto ponderMove =
+      bookMove.has_value() ? std::nullopt : takePonderMove(computerColor);
+  stopPondering();
+
+  std::pair<Position, Position> bestMove;
+  std::optional<std::pair<Position, Position>> reply;
+  if (bookMove.has_value()) {
+    bestMove = bookMove.value();
+  } else if (ponderMove.has_value()) {
+    // Ponder hit, the search is already done
+    bestMove = ponderMove.value();
+    reply = m_ponderComputer.getPonderMove();
+  } else {
+    bestMove = m_computer.minimaxRoot(computerColor);
+    reply = m_computer.getPonderMove();
+  }
 
   if (k_verbose) {
     std::cout << "The move was from: " << bestMove.first.first << " "
@@ -346,8 +511,60 @@ bool Window::makeComputerMove() {
 
     m_board.refreshValidMoves();
 
+    if (m_ponder && reply.has_value()) {
+      startPondering(computerColor, reply.value());
+    }
+
+    m_computerMoveLatency.record(std::chrono::steady_clock::now() - moveStart);
     return true;
   }
 
   return false;
 }
+
+void Window::startPondering(Color computerColor,
+                            const std::pair<Position, Position> &reply) {
+  const Color playerColor = getOtherColor(computerColor);
+  m_ponderBoard = m_board;
+  if (!m_ponderBoard.applyMove(playerColor, reply.first, reply.second)) {
+    return;
+  }
+  m_ponderKey =
+      getZobristKey(m_ponderBoard.getBoardAndGameState(computerColor));
+
+  // Same depth the computer would search to once the player moves
+  SearchLimits limits;
+  limits.depth = m_computer.getDifficulty();
+  limits.stop = &m_stopPonder;
+
+  m_stopPonder = false;
+  m_ponderComputer.setColor(computerColor);
+  m_ponderThread = std::thread([this, computerColor, limits]() {
+    m_ponderMove = m_ponderComputer.search(computerColor, limits);
+  });
+}
+
+std::optional<std::pair<Position, Position>>
+Window::takePonderMove(Color computerColor) {
+  if (!m_ponderThread.joinable()) {
+    return std::nullopt;
+  }
+
+  if (getZobristKey(m_board.getBoardAndGameState(computerColor)) !=
+      m_ponderKey) {
+    stopPondering();
+    return std::nullopt;
+  }
+
+  m_ponderThread.join();
+  return m_ponderMove;
+}
+
+void Window::stopPondering() {
+  if (!m_ponderThread.joinable()) {
+    return;
+  }
+
+  m_stopPonder = true;
+  m_ponderThread.join();
+}
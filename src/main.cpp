@@ -1,6 +1,53 @@
+#include "Analyze.h"
 #include "Application.h"
+#include "Bench.h"
+#include "EpdTest.h"
+#include "Trace.h"
+#include "Uci.h"
+
+#include <cstring>
+
+namespace {
+
+int run(int argc, char **argv) {
+  // "chess epdtest ..." runs a test suite without opening a window
+  if (argc > 1 && std::strcmp(argv[1], "epdtest") == 0) {
+    return runEpdTest(argc - 1, argv + 1);
+  }
+
+  // "chess analyze ..." searches a file of positions, also without a window
+  if (argc > 1 && std::strcmp(argv[1], "analyze") == 0) {
+    return runAnalyze(argc - 1, argv + 1);
+  }
+
+  // "chess bench ..." prints the node count signature, also without a window
+  if (argc > 1 && std::strcmp(argv[1], "bench") == 0) {
+    return runBench(argc - 1, argv + 1);
+  }
+
+  // "chess --uci" talks UCI over stdin and stdout, also without a window
+  if (std::find(argv, argv + argc, std::string("--uci")) != argv + argc) {
+    UciEngine engine;
+    return engine.run();
+  }
 
-int main(int argc, char **argv) {
   Application app(argc, argv);
   return app.run();
 }
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const int result = run(argc, argv);
+
+  // "--trace <file>" writes out where the time went, see Trace.h. Only
+  // builds made with CHESS_TRACE record anything
+  char **trace = std::find(argv, argv + argc, std::string("--trace"));
+  if (trace != argv + argc && trace + 1 != argv + argc) {
+    if (!writeTrace(*(trace + 1))) {
+      std::cout << "Error: no trace written, is CHESS_TRACE on?" << std::endl;
+    }
+  }
+
+  return result;
+}
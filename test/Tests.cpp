@@ -1,7 +1,28 @@
+#include "AI.h"
+#include "Analyze.h"
+#include "Bench.h"
 #include "Board.h"
+#include "EngineServer.h"
+#include "EpdTest.h"
+#include "Fen.h"
 #include "Game.h"
-
+#include "GameRecorder.h"
+#include "LatencyHistogram.h"
+#include "PackedPosition.h"
+#include "Pgn.h"
+#include "PositionDatabase.h"
+#include "TablebaseGenerator.h"
+#include "Trace.h"
+#include "Uci.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <random>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 namespace {
 
@@ -15,11 +36,35 @@ constexpr int k_kingsWithBishopsOnSameColorFenIndex = 5;
 constexpr int k_fiftyMoveRuleFenIndex = 6;
 constexpr int k_enPassantFenIndex = 7;
 constexpr int k_checkmateFenIndex = 8;
+constexpr int k_undefendedPawnFenIndex = 9;
+constexpr int k_defendedPawnFenIndex = 10;
+constexpr int k_doubledRooksFenIndex = 11;
+constexpr int k_hangingKnightFenIndex = 12;
+constexpr int k_whiteQueenMateInOneFenIndex = 13;
+constexpr int k_blackQueenMateInOneFenIndex = 14;
+constexpr int k_numTestFens = 15;
+
+const std::string k_testTablebaseFilepath = "test.tb";
+const std::string k_testRecordFilepath = "test_record.fen";
+const std::string k_testPgnFilepath = "../../chess/test/test.pgn";
+const std::string k_testPgnRoundTripFilepath = "test_round_trip.pgn";
+constexpr int k_numTestPgnGames = 3;
+const std::string k_testPackedFilepath = "test_packed.bin";
+const std::string k_testBookFilepath = "test_book.bin";
+const std::string k_testPositionDatabaseFilepath = "test_positions.db";
+const std::string k_testTraceFilepath = "test_trace.json";
+
+constexpr unsigned int k_fenFuzzSeed = 20240601;
+constexpr int k_fenFuzzIterations = 2000;
 
 const std::bitset<k_numCastleOptions> k_bothSidesCastleRights =
     std::bitset<k_numCastleOptions>().set();
 const std::bitset<k_numCastleOptions> k_blackLostQueensideCastleRights =
     std::bitset<k_numCastleOptions>(std::string("1101"));
+const std::bitset<k_numCastleOptions> k_whiteOnlyKingsideCastleRights =
+    std::bitset<k_numCastleOptions>(std::string("0100"));
+const std::bitset<k_numCastleOptions> k_blackOnlyQueensideCastleRights =
+    std::bitset<k_numCastleOptions>(std::string("0010"));
 const std::bitset<k_numCastleOptions> k_blackOnlyKingsideCastleRights =
     std::bitset<k_numCastleOptions>(std::string("0001"));
 const std::bitset<k_numCastleOptions> k_blackOnlyCastleRights =
@@ -350,6 +395,1217 @@ TEST_F(TestBoard, SimpleCheckmate) {
   EXPECT_TRUE(m_board->isKingCheckmated(Color::black));
 }
 
+TEST_F(TestBoard, StaticExchangeEvaluation) {
+  // Rook takes a pawn nobody defends
+  m_board->loadFromState(
+      m_game->parseFen(k_testFenFilepath, k_undefendedPawnFenIndex));
+  EXPECT_EQ(m_board->see({4, 0}, {4, 4}), 100);
+
+  // Rook takes a pawn defended by a pawn, and gets taken back
+  m_board->loadFromState(
+      m_game->parseFen(k_testFenFilepath, k_defendedPawnFenIndex));
+  EXPECT_EQ(m_board->see({4, 0}, {4, 4}), -400);
+
+  // The rook behind only joins in once the front one has gone
+  m_board->loadFromState(
+      m_game->parseFen(k_testFenFilepath, k_doubledRooksFenIndex));
+  EXPECT_EQ(m_board->see({4, 1}, {4, 4}), -300);
+
+  // Quiet moves onto an attacked square just hang the piece
+  m_board->loadFromState(
+      m_game->parseFen(k_testFenFilepath, k_hangingKnightFenIndex));
+  EXPECT_EQ(m_board->see({3, 2}, {4, 4}), -300);
+  EXPECT_EQ(m_board->see({3, 2}, {1, 3}), 0);
+}
+
+TEST_F(TestBoard, EndgameTablebase) {
+  const auto tables = Tablebase::getAllTables(3);
+  ASSERT_EQ(tables.front().name, "KQvK");
+
+  // King and queen mate a bare king in at most ten moves
+  TablebaseGenerator generator(2);
+  const auto entries = generator.generate(tables.front());
+  int longestWin = 0;
+  for (const auto entry : entries) {
+    if (entry <= k_tablebaseMaxWin) {
+      longestWin = std::max(longestWin, static_cast<int>(entry));
+    }
+  }
+  EXPECT_EQ(longestWin, 19);
+
+  ASSERT_TRUE(
+      Tablebase::write(k_testTablebaseFilepath, {tables.front()}, {entries}));
+  Tablebase tablebase;
+  ASSERT_TRUE(tablebase.load(k_testTablebaseFilepath));
+
+  auto result = tablebase.probe(
+      m_game->parseFen(k_testFenFilepath, k_whiteQueenMateInOneFenIndex));
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->outcome, TablebaseOutcome::win);
+  EXPECT_EQ(result->distanceToMate, 1);
+
+  // Same position with the colors swapped
+  result = tablebase.probe(
+      m_game->parseFen(k_testFenFilepath, k_blackQueenMateInOneFenIndex));
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->outcome, TablebaseOutcome::win);
+  EXPECT_EQ(result->distanceToMate, 1);
+
+  // Material that isn't in the file
+  std::string tableName;
+  size_t index = 0;
+  ASSERT_TRUE(Tablebase::locate({{PieceType::king, Color::white, 0},
+                                 {PieceType::rook, Color::white, 8},
+                                 {PieceType::king, Color::black, 63}},
+                                Color::white, tableName, index));
+  EXPECT_EQ(tableName, "KRvK");
+  EXPECT_FALSE(tablebase
+                   .probe({{PieceType::king, Color::white, 0},
+                           {PieceType::rook, Color::white, 8},
+                           {PieceType::king, Color::black, 63}},
+                          Color::white)
+                   .has_value());
+
+  // A table that's the wrong size for its material is never probed
+  ASSERT_TRUE(Tablebase::write(
+      k_testTablebaseFilepath, {tables.front()},
+      {std::vector<uint8_t>(entries.begin(),
+                            entries.begin() + entries.size() / 2)}));
+  Tablebase truncated;
+  ASSERT_TRUE(truncated.load(k_testTablebaseFilepath));
+  EXPECT_FALSE(
+      truncated
+          .probe(m_game->parseFen(k_testFenFilepath,
+                                  k_whiteQueenMateInOneFenIndex))
+          .has_value());
+
+  std::remove(k_testTablebaseFilepath.c_str());
+}
+
+TEST_F(TestBoard, FenParsing) {
+  LumpedBoardAndGameState state;
+  ASSERT_TRUE(readFen(
+      "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", state));
+  EXPECT_EQ(state.pawns.size(), 16);
+  EXPECT_EQ(state.kings.size(), 2);
+  EXPECT_TRUE(state.whoseTurn == Color::black);
+  EXPECT_TRUE(state.castleStatus == k_bothSidesCastleRights);
+  ASSERT_TRUE(state.enPassantStatus.has_value());
+  EXPECT_TRUE(state.enPassantStatus->first == Color::white);
+  EXPECT_TRUE(state.enPassantStatus->second == Position({4, 2}));
+
+  // No castling rights, multi-digit counters
+  ASSERT_TRUE(readFen("4k3/8/8/8/8/8/8/4K3 w - - 12 345", state));
+  EXPECT_TRUE(state.castleStatus == k_neitherSideCastleRights);
+  EXPECT_FALSE(state.enPassantStatus.has_value());
+  EXPECT_EQ(state.halfMoveNum, 12);
+  EXPECT_EQ(state.turnNum, 345);
+
+  // EPD records stop after the en passant square
+  ASSERT_TRUE(
+      readFen("4k3/8/8/8/8/8/8/4K3 b Kq - bm Kd7; c9 \"1-0\";", state));
+  EXPECT_TRUE(state.castleStatus == (k_whiteOnlyKingsideCastleRights |
+                                     k_blackOnlyQueensideCastleRights));
+  EXPECT_EQ(state.turnNum, 1);
+
+  // Short rank, too many files, bad side to move
+  EXPECT_FALSE(readFen("4k3/8/8/8/5r/8/8/4K3 w - - 0 1", state));
+  EXPECT_FALSE(readFen("4k3/8/8/8/44r/8/8/4K3 w - - 0 1", state));
+  EXPECT_FALSE(readFen("4k3/8/8/8/8/8/8/4K3 x - - 0 1", state));
+
+  FenFile file;
+  ASSERT_TRUE(file.open(k_testFenFilepath));
+  EXPECT_EQ(file.size(), k_numTestFens);
+  EXPECT_EQ(file.getLine(k_kingVsKingFenIndex),
+            "4k3/8/8/8/8/8/8/3K4 w - - 0 0");
+  ASSERT_TRUE(file.getPosition(k_fiftyMoveRuleFenIndex, state));
+  EXPECT_EQ(state.halfMoveNum, 48);
+  EXPECT_TRUE(file.getLine(k_numTestFens).empty());
+}
+
+TEST_F(TestBoard, FenRoundTrip) {
+  // Fixed seed so failures reproduce
+  std::mt19937 generator(k_fenFuzzSeed);
+  constexpr std::array<PieceType, 6> types = {
+      PieceType::pawn, PieceType::knight, PieceType::bishop,
+      PieceType::rook, PieceType::queen,  PieceType::king};
+  char fen[k_maxFenLength];
+  char roundTrip[k_maxFenLength];
+  LumpedBoardAndGameState parsed;
+
+  for (int i = 0; i < k_fenFuzzIterations; ++i) {
+    LumpedBoardAndGameState state;
+    std::array<bool, k_totalSquares> occupied = {};
+    const int numPieces = generator() % k_totalPieces;
+    for (int j = 0; j < numPieces; ++j) {
+      const int square = generator() % k_totalSquares;
+      if (occupied[square]) {
+        continue;
+      }
+      occupied[square] = true;
+
+      const Color color = (generator() % 2) ? Color::white : Color::black;
+      const Position position = {square % 8, square / 8};
+      switch (types[generator() % types.size()]) {
+      case PieceType::pawn:
+        state.pawns.emplace_back(color, position);
+        break;
+      case PieceType::knight:
+        state.knights.emplace_back(color, position);
+        break;
+      case PieceType::bishop:
+        state.bishops.emplace_back(color, position);
+        break;
+      case PieceType::rook:
+        state.rooks.emplace_back(color, position);
+        break;
+      case PieceType::queen:
+        state.queens.emplace_back(color, position);
+        break;
+      default:
+        state.kings.emplace_back(color, position);
+        break;
+      }
+    }
+
+    state.whoseTurn = (generator() % 2) ? Color::white : Color::black;
+    state.castleStatus = CastleStatus(generator() % 16);
+    if (generator() % 2) {
+      const Color color = (generator() % 2) ? Color::white : Color::black;
+      state.enPassantStatus = {
+          color,
+          {static_cast<int>(generator() % 8), color == Color::white ? 2 : 5}};
+    }
+    // Counters well past a single digit
+    state.halfMoveNum = generator() % 1000;
+    state.turnNum = (generator() % 2) ? generator() : generator() % 10;
+
+    const size_t length = writeFen(state, fen, sizeof(fen));
+    ASSERT_GT(length, 0);
+    ASSERT_TRUE(readFen(std::string_view(fen, length), parsed)) << fen;
+    ASSERT_GT(writeFen(parsed, roundTrip, sizeof(roundTrip)), 0);
+    ASSERT_STREQ(fen, roundTrip);
+    EXPECT_EQ(parsed.halfMoveNum, state.halfMoveNum);
+    EXPECT_EQ(parsed.turnNum, state.turnNum);
+  }
+
+  // Straight from the board
+  m_board->loadFromState(
+      m_game->parseFen(k_testFenFilepath, k_enPassantFenIndex));
+  ASSERT_GT(m_board->toFen(Color::white, 12, fen, sizeof(fen)), 0);
+  EXPECT_STREQ(fen, "4k3/p1pppppp/8/PpP5/5p1p/8/1P1PPPPP/3K4 w - b6 0 12");
+
+  // Too small a buffer
+  EXPECT_EQ(m_board->toFen(Color::white, 12, fen, 10), 0);
+}
+
+TEST_F(TestBoard, GameRecorder) {
+  std::remove(k_testRecordFilepath.c_str());
+  m_board->loadFromState(
+      m_game->parseFen(k_testFenFilepath, k_basicCastlingFenIndex));
+
+  GameRecorder recorder;
+  ASSERT_TRUE(recorder.open(k_testRecordFilepath));
+  recorder.record(*m_board, Color::white, 1);
+  recorder.record(*m_board, Color::black, 1);
+
+  // Nothing hits the file until a flush
+  FenFile file;
+  ASSERT_TRUE(file.open(k_testRecordFilepath));
+  EXPECT_EQ(file.size(), 0);
+
+  recorder.flush();
+  ASSERT_TRUE(file.open(k_testRecordFilepath));
+  ASSERT_EQ(file.size(), 2);
+  EXPECT_EQ(file.getLine(1), "r3k2r/8/8/8/8/8/8/R3K2R b KQkq - 0 1");
+  EXPECT_FALSE(file.hasChanged());
+  EXPECT_EQ(m_game->parseFen(k_testRecordFilepath, 2).kings.size(), 0);
+
+  // Closing flushes as well
+  recorder.record(*m_board, Color::white, 2);
+  recorder.close();
+  EXPECT_TRUE(file.hasChanged());
+  ASSERT_TRUE(file.open(k_testRecordFilepath));
+  EXPECT_EQ(file.size(), 3);
+
+  // Games kept open for parseFen() pick up what was added since
+  EXPECT_EQ(m_game->parseFen(k_testRecordFilepath, 2).turnNum, 2);
+
+  std::remove(k_testRecordFilepath.c_str());
+}
+
+TEST_F(TestBoard, SanMoves) {
+  LumpedBoardAndGameState state;
+  ASSERT_TRUE(readFen("r5k1/8/8/8/R6R/8/8/R3K3 w Q - 0 1", state));
+  m_board->loadFromState(state);
+  m_board->refreshValidMoves();
+
+  auto sanFor = [this](std::string_view san) {
+    PieceType promotion;
+    const auto move = fromSan(*m_board, Color::white, san, promotion);
+    return move.has_value() ? toSan(*m_board, move.value()) : "";
+  };
+
+  // File when that's enough, rank when it isn't, both when neither is
+  EXPECT_EQ(sanFor("Rhd4"), "Rhd4");
+  EXPECT_EQ(sanFor("R1a3"), "R1a3");
+  EXPECT_EQ(sanFor("Ra4b4"), "Rab4");
+  EXPECT_EQ(sanFor("Ra4-a6"), "Ra6");
+  EXPECT_EQ(sanFor("Rxa8+"), "Rxa8");
+  EXPECT_EQ(sanFor("O-O-O"), "O-O-O");
+  EXPECT_EQ(sanFor("Kd2"), "Kd2");
+
+  // Underspecified, impossible and malformed
+  EXPECT_EQ(sanFor("Rd4"), "");
+  EXPECT_EQ(sanFor("Ra3"), "");
+  EXPECT_EQ(sanFor("O-O"), "");
+  EXPECT_EQ(sanFor("Nb3"), "");
+  EXPECT_EQ(sanFor("Ri4"), "");
+  EXPECT_EQ(sanFor(""), "");
+
+  ASSERT_TRUE(readFen("k7/6P1/8/8/8/8/8/K7 w - - 0 1", state));
+  m_board->loadFromState(state);
+  m_board->refreshValidMoves();
+
+  PieceType promotion;
+  const auto move = fromSan(*m_board, Color::white, "g8N", promotion);
+  ASSERT_TRUE(move.has_value());
+  EXPECT_EQ(promotion, PieceType::knight);
+  EXPECT_EQ(playSanMove(*m_board, move.value(), promotion), "g8=N");
+  EXPECT_EQ(m_board->getPieceAt({6, 7})->getType(), PieceType::knight);
+}
+
+TEST_F(TestBoard, PgnReadAndWrite) {
+  PgnReader reader;
+  ASSERT_TRUE(reader.open(k_testPgnFilepath));
+
+  std::vector<std::string> readMoves;
+  std::string written;
+  PgnGame game;
+  int numGames = 0;
+
+  while (reader.nextGame(game)) {
+    ++numGames;
+
+    LumpedBoardAndGameState state;
+    if (game.getTag("FEN").empty()) {
+      m_board->loadGame();
+    } else {
+      ASSERT_TRUE(readFen(game.getTag("FEN"), state));
+      m_board->loadFromState(state);
+    }
+    m_board->refreshValidMoves();
+
+    // Every move has to resolve, and come back out as the same SAN
+    Color color = state.whoseTurn;
+    for (auto san : game.moves) {
+      PieceType promotion;
+      const auto move = fromSan(*m_board, color, san, promotion);
+      ASSERT_TRUE(move.has_value()) << san;
+      readMoves.emplace_back(san);
+
+      while (san.back() == '!' || san.back() == '?') {
+        san.remove_suffix(1);
+      }
+      ASSERT_EQ(playSanMove(*m_board, move.value(), promotion), san);
+      color = getOtherColor(color);
+    }
+
+    writePgn(game, written);
+  }
+
+  ASSERT_EQ(numGames, k_numTestPgnGames);
+
+  // Only the mainline is left of the first game, ending in mate
+  EXPECT_TRUE(m_board->isKingCheckmated(Color::black));
+
+  std::FILE *file = std::fopen(k_testPgnRoundTripFilepath.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  std::fwrite(written.data(), 1, written.size(), file);
+  std::fclose(file);
+
+  ASSERT_TRUE(reader.open(k_testPgnRoundTripFilepath));
+  size_t moveIndex = 0;
+  numGames = 0;
+  while (reader.nextGame(game)) {
+    ++numGames;
+    for (const auto &san : game.moves) {
+      ASSERT_LT(moveIndex, readMoves.size());
+      EXPECT_EQ(san, readMoves[moveIndex++]);
+    }
+
+    if (numGames == 1) {
+      EXPECT_EQ(game.moves.size(), 33);
+      EXPECT_EQ(game.getTag("White"), "Paul Morphy");
+      EXPECT_EQ(game.result, "1-0");
+    } else if (numGames == 2) {
+      // Missing Seven Tag Roster tags get filled in
+      EXPECT_EQ(game.getTag("Date"), "????.??.??");
+      EXPECT_EQ(game.result, "*");
+    }
+  }
+  EXPECT_EQ(numGames, k_numTestPgnGames);
+  EXPECT_EQ(moveIndex, readMoves.size());
+
+  reader.close();
+  std::remove(k_testPgnRoundTripFilepath.c_str());
+}
+
+TEST_F(TestBoard, PackedPositions) {
+  std::remove(k_testPackedFilepath.c_str());
+
+  FenFile fens;
+  ASSERT_TRUE(fens.open(k_testFenFilepath));
+  ASSERT_EQ(fens.size(), k_numTestFens);
+
+  LumpedBoardAndGameState state;
+  LumpedBoardAndGameState unpacked;
+  char fen[k_maxFenLength];
+  char roundTrip[k_maxFenLength];
+
+  PackedWriter writer;
+  ASSERT_TRUE(writer.open(k_testPackedFilepath, PackedFileType::positions));
+  for (size_t i = 0; i < fens.size(); ++i) {
+    ASSERT_TRUE(fens.getPosition(i, state));
+    PackedPosition packed;
+    ASSERT_TRUE(packPosition(state, packed));
+    packed.score = i;
+    EXPECT_TRUE(writer.write(packed));
+  }
+  // Wrong kind of record for this file
+  EXPECT_FALSE(writer.write(PackedGame()));
+  writer.close();
+
+  // Games can't be appended to a positions file
+  EXPECT_FALSE(writer.open(k_testPackedFilepath, PackedFileType::games));
+
+  PackedReader reader;
+  ASSERT_TRUE(reader.open(k_testPackedFilepath));
+  EXPECT_EQ(reader.getType(), PackedFileType::positions);
+  ASSERT_EQ(reader.size(), k_numTestFens);
+  for (size_t i = 0; i < fens.size(); ++i) {
+    ASSERT_TRUE(fens.getPosition(i, state));
+    PackedPosition packed;
+    ASSERT_TRUE(reader.getPosition(i, packed));
+    EXPECT_EQ(packed.score, i);
+
+    unpackPosition(packed, unpacked);
+    ASSERT_GT(writeFen(state, fen, sizeof(fen)), 0);
+    ASSERT_GT(writeFen(unpacked, roundTrip, sizeof(roundTrip)), 0);
+    EXPECT_STREQ(fen, roundTrip);
+  }
+  reader.close();
+
+  ASSERT_TRUE(readFen(
+      "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w Kq f6 0 3", state));
+  PackedPosition packed;
+  ASSERT_TRUE(packPosition(state, packed));
+  unpackPosition(packed, unpacked);
+  ASSERT_TRUE(unpacked.enPassantStatus.has_value());
+  EXPECT_EQ(unpacked.enPassantStatus->first, Color::black);
+  EXPECT_EQ(unpacked.enPassantStatus->second, Position(5, 5));
+
+  // Too many pieces
+  state.pawns.emplace_back(Color::white, Position(0, 3));
+  EXPECT_FALSE(packPosition(state, packed));
+
+  std::remove(k_testPackedFilepath.c_str());
+}
+
+TEST_F(TestBoard, PackedGames) {
+  std::remove(k_testPackedFilepath.c_str());
+
+  // Ruy Lopez, then a pawn ending with an underpromotion
+  PackedGame opening;
+  opening.moves = {packMove({4, 1}, {4, 3}), packMove({4, 6}, {4, 4}),
+                   packMove({6, 0}, {5, 2}), packMove({1, 7}, {2, 5}),
+                   packMove({5, 0}, {1, 4})};
+  PackedGame ending;
+  ending.moves = {packMove({6, 6}, {6, 7}, PieceType::knight)};
+  ending.result = PackedResult::draw;
+  LumpedBoardAndGameState state;
+  ASSERT_TRUE(readFen("k7/6P1/8/8/8/8/8/K7 w - - 0 1", state));
+  ending.start = PackedPosition();
+  ASSERT_TRUE(packPosition(state, ending.start.value()));
+
+  PackedWriter writer;
+  ASSERT_TRUE(writer.open(k_testPackedFilepath, PackedFileType::games));
+  EXPECT_TRUE(writer.write(opening));
+  writer.close();
+  // Appends
+  ASSERT_TRUE(writer.open(k_testPackedFilepath, PackedFileType::games));
+  EXPECT_TRUE(writer.write(ending));
+  writer.close();
+
+  PackedReader reader;
+  ASSERT_TRUE(reader.open(k_testPackedFilepath));
+  EXPECT_EQ(reader.getType(), PackedFileType::games);
+  EXPECT_EQ(reader.size(), 0);
+
+  PackedGame game;
+  ASSERT_TRUE(reader.nextGame(game));
+  EXPECT_FALSE(game.start.has_value());
+  EXPECT_EQ(game.moves, opening.moves);
+  EXPECT_EQ(game.result, PackedResult::unknown);
+
+  // Replaying it gets to the Ruy Lopez
+  m_board->loadGame();
+  m_board->refreshValidMoves();
+  Color color = Color::white;
+  for (const auto move : game.moves) {
+    Position start;
+    Position end;
+    PieceType promotion;
+    unpackMove(move, start, end, promotion);
+    EXPECT_EQ(promotion, PieceType::none);
+    ASSERT_TRUE(m_board->applyMove(color, start, end, promotion));
+    color = getOtherColor(color);
+  }
+  char fen[k_maxFenLength];
+  m_board->toFen(color, 3, fen, sizeof(fen));
+  EXPECT_STREQ(fen,
+               "r1bqkbnr/pppp1ppp/2n5/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R b KQkq - "
+               "0 3");
+
+  ASSERT_TRUE(reader.nextGame(game));
+  ASSERT_TRUE(game.start.has_value());
+  EXPECT_EQ(game.result, PackedResult::draw);
+  ASSERT_EQ(game.moves.size(), 1);
+  Position start;
+  Position end;
+  PieceType promotion;
+  unpackMove(game.moves[0], start, end, promotion);
+  EXPECT_EQ(start, Position(6, 6));
+  EXPECT_EQ(end, Position(6, 7));
+  EXPECT_EQ(promotion, PieceType::knight);
+
+  EXPECT_FALSE(reader.nextGame(game));
+  reader.rewind();
+  EXPECT_TRUE(reader.nextGame(game));
+
+  reader.close();
+  std::remove(k_testPackedFilepath.c_str());
+}
+
+TEST_F(TestBoard, CompactBoardState) {
+  FenFile fens;
+  ASSERT_TRUE(fens.open(k_testFenFilepath));
+
+  LumpedBoardAndGameState state;
+  Board copy;
+  char fen[k_maxFenLength];
+  char roundTrip[k_maxFenLength];
+  for (size_t i = 0; i < fens.size(); ++i) {
+    ASSERT_TRUE(fens.getPosition(i, state));
+    m_board->loadFromState(state);
+
+    // Good for copying around like any plain struct
+    CompactBoardState compact;
+    const auto original = m_board->getCompactState(state.whoseTurn);
+    std::memcpy(&compact, &original, sizeof(compact));
+    copy.loadFromCompactState(compact);
+
+    ASSERT_GT(m_board->toFen(state.whoseTurn, 1, fen, sizeof(fen)), 0);
+    ASSERT_GT(copy.toFen(compact.whoseTurn, 1, roundTrip, sizeof(roundTrip)),
+              0);
+    EXPECT_STREQ(fen, roundTrip);
+
+    // Moves are left until they're asked for
+    EXPECT_TRUE(copy.getAllValidMoves().empty());
+    copy.refreshValidMoves();
+    EXPECT_EQ(copy.getAllValidMoves().size(),
+              m_board->getAllValidMoves().size());
+  }
+
+  // En passant and last moves carry over too, unlike with FEN
+  m_board->loadFromState(
+      m_game->parseFen(k_testFenFilepath, k_enPassantFenIndex));
+  ASSERT_TRUE(m_board->applyMove(Color::white, {6, 1}, {6, 3}));
+  copy.loadFromCompactState(m_board->getCompactState(Color::black));
+  EXPECT_TRUE(copy.isValidMove(Color::black, {5, 3}, {6, 2}, true));
+  EXPECT_EQ(copy.getLastMove(Color::white), Position(6, 3));
+  EXPECT_EQ(copy.getLastMove(Color::black), std::nullopt);
+}
+
+TEST_F(TestBoard, CopyBoard) {
+  FenFile fens;
+  ASSERT_TRUE(fens.open(k_testFenFilepath));
+
+  LumpedBoardAndGameState state;
+  Board copy;
+  char fen[k_maxFenLength];
+  char copyFen[k_maxFenLength];
+  for (size_t i = 0; i < fens.size(); ++i) {
+    ASSERT_TRUE(fens.getPosition(i, state));
+    m_board->loadFromState(state);
+
+    // Assigned over whatever position the last one left behind
+    copy = *m_board;
+    ASSERT_GT(m_board->toFen(state.whoseTurn, 1, fen, sizeof(fen)), 0);
+    ASSERT_GT(copy.toFen(state.whoseTurn, 1, copyFen, sizeof(copyFen)), 0);
+    EXPECT_STREQ(fen, copyFen);
+    EXPECT_EQ(copy.getAllValidMoves().size(),
+              m_board->getAllValidMoves().size());
+  }
+
+  // Moves on the copy leave the original alone
+  m_board->loadGame();
+  m_board->refreshValidMoves();
+  Board other(*m_board);
+  ASSERT_TRUE(other.applyMove(Color::white, {4, 1}, {4, 3}));
+  EXPECT_EQ(other.getPieceAt({4, 1}), nullptr);
+  ASSERT_NE(m_board->getPieceAt({4, 1}), nullptr);
+  EXPECT_FALSE(m_board->getPieceAt({4, 1})->hasMoved());
+  EXPECT_EQ(m_board->getLastMove(Color::white), std::nullopt);
+  EXPECT_EQ(other.getLastMove(Color::white), Position(4, 3));
+}
+
+// Keys from the Polyglot book format's own examples
+TEST_F(TestBoard, PolyglotKeys) {
+  const std::vector<std::pair<std::string, uint64_t>> examples = {
+      {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+       0x463b96181691fc9c},
+      {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1",
+       0x823c9b50fd114196},
+      {"rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2",
+       0x0756b94461c50fb0},
+      {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2",
+       0x662fafb965db29d4},
+      {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+       0x22a48b5a8e47ff78},
+      {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3",
+       0x652a607ca3f242c1},
+      {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4",
+       0x00fdd303c946bdd9},
+      {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3",
+       0x3c8123ea7b067637},
+      {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4",
+       0x5c3f9b829b279560}};
+
+  LumpedBoardAndGameState state;
+  for (const auto &[fen, key] : examples) {
+    ASSERT_TRUE(readFen(fen, state));
+    EXPECT_EQ(getZobristKey(state), key) << fen;
+  }
+}
+
+TEST_F(TestBoard, OpeningBook) {
+  std::remove(k_testBookFilepath.c_str());
+
+  LumpedBoardAndGameState start;
+  LumpedBoardAndGameState transposed;
+  ASSERT_TRUE(readFen(
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", start));
+
+  // Same position reached two ways, and an en passant square nobody can use
+  ASSERT_TRUE(readFen(
+      "r1bqkbnr/pppppppp/2n5/8/8/2N2N2/PPPPPPPP/R1BQKB1R b KQkq - 3 2",
+      transposed));
+  LumpedBoardAndGameState other;
+  ASSERT_TRUE(readFen(
+      "r1bqkbnr/pppppppp/2n5/8/8/2N2N2/PPPPPPPP/R1BQKB1R b KQkq - 0 9",
+      other));
+  EXPECT_EQ(getZobristKey(transposed), getZobristKey(other));
+  EXPECT_NE(getZobristKey(start), getZobristKey(transposed));
+  ASSERT_TRUE(readFen(
+      "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", start));
+  ASSERT_TRUE(readFen(
+      "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq - 0 1", other));
+  EXPECT_EQ(getZobristKey(start), getZobristKey(other));
+  other.castleStatus = k_whiteOnlyKingsideCastleRights;
+  EXPECT_NE(getZobristKey(start), getZobristKey(other));
+
+  m_board->loadGame();
+  m_board->refreshValidMoves();
+  const uint64_t startKey =
+      getZobristKey(m_board->getBoardAndGameState(Color::white));
+
+  LumpedBoardAndGameState castling;
+  ASSERT_TRUE(readFen("r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", castling));
+
+  std::vector<BookEntry> entries = {
+      {startKey,
+       encodeBookMove({PieceType::pawn, Color::white, {3, 1}, {3, 3}}), 5, 0},
+      {getZobristKey(castling),
+       encodeBookMove({PieceType::king, Color::white, {4, 0}, {6, 0}}), 3, 0},
+      {startKey,
+       encodeBookMove({PieceType::pawn, Color::white, {4, 1}, {4, 3}}), 10, 0},
+      {startKey,
+       encodeBookMove({PieceType::pawn, Color::white, {0, 1}, {0, 3}}), 0, 0}};
+  ASSERT_TRUE(writeOpeningBook(k_testBookFilepath, entries));
+
+  OpeningBook book;
+  ASSERT_TRUE(book.open(k_testBookFilepath));
+  ASSERT_EQ(book.size(), entries.size());
+
+  std::vector<BookMove> moves;
+  book.getMoves(m_board->getBoardAndGameState(Color::white), moves);
+  ASSERT_EQ(moves.size(), 3);
+  EXPECT_EQ(moves[0].start, Position(4, 1));
+  EXPECT_EQ(moves[0].end, Position(4, 3));
+  EXPECT_EQ(moves[1].weight, 5);
+
+  // Stored as king takes rook
+  book.getMoves(castling, moves);
+  ASSERT_EQ(moves.size(), 1);
+  EXPECT_EQ(moves[0].end, Position(6, 0));
+
+  // Zero weight moves never get picked
+  std::mt19937 generator(k_fenFuzzSeed);
+  for (int i = 0; i < 100; ++i) {
+    const auto move = book.pickMove(start, false, generator);
+    EXPECT_FALSE(move.has_value());
+    const auto picked = book.pickMove(
+        m_board->getBoardAndGameState(Color::white), false, generator);
+    ASSERT_TRUE(picked.has_value());
+    EXPECT_NE(picked->start, Position(0, 1));
+  }
+
+  AI computer(*m_board);
+  computer.setOpeningBook(&book, 1, true);
+  const auto bookMove = computer.getBookMove(Color::white, 0);
+  ASSERT_TRUE(bookMove.has_value());
+  EXPECT_EQ(bookMove->first, Position(4, 1));
+  EXPECT_EQ(bookMove->second, Position(4, 3));
+
+  // Past the book depth, and a position that isn't in it
+  EXPECT_FALSE(computer.getBookMove(Color::white, 2).has_value());
+  EXPECT_FALSE(computer.getBookMove(Color::black, 0).has_value());
+
+  book.close();
+  std::remove(k_testBookFilepath.c_str());
+}
+
+TEST_F(TestBoard, PositionDatabase) {
+  std::remove(k_testPositionDatabaseFilepath.c_str());
+
+  // Small enough to need a few runs merged
+  PositionDatabaseBuilder builder(k_testPositionDatabaseFilepath, 128, 100);
+  ASSERT_TRUE(builder.addPgnFile(k_testPgnFilepath));
+  ASSERT_TRUE(builder.finish());
+  EXPECT_EQ(builder.getNumGames(), 3);
+  EXPECT_EQ(builder.getNumPositions(), 43);
+
+  PositionDatabase database;
+  ASSERT_TRUE(database.open(k_testPositionDatabaseFilepath));
+  EXPECT_EQ(database.size(), 43);
+  EXPECT_EQ(database.getFilename(0),
+            std::filesystem::absolute(k_testPgnFilepath)
+                .lexically_normal()
+                .string());
+
+  // The promotion game starts somewhere else
+  m_board->loadGame();
+  m_board->refreshValidMoves();
+  std::vector<PositionMatch> matches;
+  database.findGames(m_board->getBoardAndGameState(Color::white), matches);
+  ASSERT_EQ(matches.size(), 2);
+  EXPECT_EQ(matches[0].ply, 0);
+  EXPECT_LT(matches[0].offset, matches[1].offset);
+
+  PgnGame game;
+  ASSERT_TRUE(database.getGame(matches[0], game));
+  EXPECT_EQ(game.getTag("White"), "Paul Morphy");
+  ASSERT_TRUE(database.getGame(matches[1], game));
+  EXPECT_EQ(game.getTag("Event"), "En passant");
+
+  ASSERT_TRUE(m_board->applyMove(Color::white, {4, 1}, {4, 3}));
+  matches.clear();
+  database.findGames(m_board->getBoardAndGameState(Color::black), matches, 1);
+  ASSERT_EQ(matches.size(), 1);
+  EXPECT_EQ(matches[0].ply, 1);
+  ASSERT_TRUE(database.getGame(matches[0], game));
+  EXPECT_EQ(game.moves[matches[0].ply], "e5");
+
+  // Replaying a game up to a match gets back the position looked up
+  Board replayed;
+  Color whoseTurn;
+  ASSERT_TRUE(database.getPosition(matches[0], replayed, whoseTurn));
+  EXPECT_EQ(whoseTurn, Color::black);
+  EXPECT_EQ(getZobristKey(replayed.getBoardAndGameState(whoseTurn)),
+            getZobristKey(m_board->getBoardAndGameState(Color::black)));
+
+  // The position after the last move is indexed too
+  LumpedBoardAndGameState promoted;
+  ASSERT_TRUE(readFen("Q7/8/8/8/8/8/8/k1K5 b - - 0 1", promoted));
+  matches.clear();
+  database.findGames(promoted, matches);
+  ASSERT_EQ(matches.size(), 1);
+  EXPECT_EQ(matches[0].ply, 1);
+  ASSERT_TRUE(database.getPosition(matches[0], replayed, whoseTurn));
+  EXPECT_EQ(getZobristKey(replayed.getBoardAndGameState(whoseTurn)),
+            getZobristKey(promoted));
+
+  database.close();
+  std::remove(k_testPositionDatabaseFilepath.c_str());
+}
+
+TEST_F(TestBoard, EpdTest) {
+  EpdPosition position;
+  ASSERT_TRUE(readEpd("r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR "
+                      "w KQkq - bm Qxf7#; am Qxe5+ Qh4; id \"mate; in 1\";",
+                      position));
+  EXPECT_EQ(position.id, "mate; in 1");
+  ASSERT_EQ(position.bestMoves.size(), 1);
+  EXPECT_EQ(position.bestMoves[0], "Qxf7#");
+  ASSERT_EQ(position.avoidMoves.size(), 2);
+  EXPECT_EQ(position.avoidMoves[1], "Qh4");
+  EXPECT_EQ(position.state.whoseTurn, Color::white);
+
+  SearchLimits limits;
+  limits.depth = 2;
+  const auto result = solveEpd(position, limits);
+  EXPECT_TRUE(result.isValid);
+  EXPECT_TRUE(result.solved);
+  EXPECT_EQ(result.move, "Qxf7");
+  EXPECT_TRUE(result.timeToSolution.has_value());
+  EXPECT_GT(result.nodes, 0);
+
+  EXPECT_FALSE(readEpd("not a position bm e4;", position));
+
+  // Moves that aren't legal can't be scored
+  ASSERT_TRUE(readEpd("4k3/8/8/8/8/8/8/4K3 w - - bm Qd8#;", position));
+  EXPECT_FALSE(solveEpd(position, limits).isValid);
+
+  // Stops on time, with a move from whatever depth it got through
+  m_board->loadGame();
+  AI computer(*m_board);
+  computer.setColor(Color::white);
+  limits.depth = k_maxSearchDepth;
+  limits.time = std::chrono::milliseconds(50);
+  int lastDepth = 0;
+  const auto start = std::chrono::steady_clock::now();
+  const auto move = computer.search(
+      Color::white, limits,
+      [&lastDepth](const SearchInfo &info) { lastDepth = info.depth; });
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+  ASSERT_TRUE(move.has_value());
+  EXPECT_LT(lastDepth, k_maxSearchDepth);
+  EXPECT_TRUE(m_board->isValidMove(Color::white, move->first, move->second,
+                                   false));
+}
+
+TEST_F(TestBoard, Uci) {
+  std::ostringstream output;
+  UciEngine engine(output);
+
+  EXPECT_TRUE(engine.handleCommand("uci"));
+  EXPECT_NE(output.str().find("uciok\n"), std::string::npos);
+
+  // Black mates in one along the back rank
+  output.str("");
+  engine.handleCommand(
+      "position fen 1r4k1/8/8/8/8/8/P4PPP/6K1 w - - 0 1 moves a2a3");
+  engine.handleCommand("go depth 3");
+  engine.waitForSearch();
+  EXPECT_NE(output.str().find("score mate 1"), std::string::npos);
+  EXPECT_NE(output.str().find("bestmove b8b1\n"), std::string::npos);
+  EXPECT_NE(output.str().find("info depth 2 seldepth 2 "), std::string::npos);
+  EXPECT_NE(output.str().find("info string stats leaves "), std::string::npos);
+
+  output.str("");
+  engine.handleCommand("position startpos moves e2e4 e2e4");
+  EXPECT_NE(output.str().find("illegal move e2e4"), std::string::npos);
+
+  // Held back until stop, and answering isready in the meantime
+  output.str("");
+  engine.handleCommand("go infinite");
+  engine.handleCommand("isready");
+  EXPECT_NE(output.str().find("readyok"), std::string::npos);
+  engine.handleCommand("stop");
+  EXPECT_NE(output.str().find("bestmove "), std::string::npos);
+
+  // Pondering holds the best move back even once the depth is done, then a
+  // hit lets the same search finish and name the reply it expects
+  output.str("");
+  engine.handleCommand("position startpos moves e2e4");
+  engine.handleCommand("go ponder depth 2");
+  engine.handleCommand("isready");
+  EXPECT_NE(output.str().find("readyok"), std::string::npos);
+  EXPECT_EQ(output.str().find("bestmove "), std::string::npos);
+  engine.handleCommand("ponderhit");
+  engine.waitForSearch();
+  EXPECT_NE(output.str().find("bestmove "), std::string::npos);
+  EXPECT_NE(output.str().find(" ponder "), std::string::npos);
+
+  // A miss is just a stop
+  output.str("");
+  engine.handleCommand("go ponder wtime 1000 btime 1000");
+  engine.handleCommand("stop");
+  EXPECT_NE(output.str().find("bestmove "), std::string::npos);
+
+  output.str("");
+  engine.handleCommand("go nodes 100");
+  engine.waitForSearch();
+  EXPECT_FALSE(engine.handleCommand("quit"));
+  EXPECT_NE(output.str().find("bestmove "), std::string::npos);
+}
+
+TEST_F(TestBoard, SearchStats) {
+  m_board->loadGame();
+  AI computer(*m_board);
+  computer.setColor(Color::white);
+  SearchLimits limits;
+  limits.depth = 3;
+
+  std::vector<SearchStats> perDepth;
+  computer.search(Color::white, limits, [&](const SearchInfo &info) {
+    EXPECT_EQ(info.stats.depth, info.depth);
+    EXPECT_EQ(info.stats.nodes, info.nodes);
+    perDepth.push_back(info.stats);
+  });
+  ASSERT_EQ(perDepth.size(), 3);
+
+  const auto stats = computer.getStats();
+  EXPECT_EQ(stats.depth, 3);
+  EXPECT_EQ(stats.selDepth, 3);
+  EXPECT_EQ(stats.nodes, computer.getNodes());
+  EXPECT_GT(stats.leafNodes, 0);
+  EXPECT_LT(stats.leafNodes, stats.nodes);
+  EXPECT_EQ(stats.tablebaseHits, 0);
+  EXPECT_GT(stats.cutoffs, 0);
+  EXPECT_LE(stats.firstMoveCutoffs, stats.cutoffs);
+  EXPECT_GT(stats.getFirstMoveCutoffRate(), 0);
+  EXPECT_LE(stats.getFirstMoveCutoffRate(), 1);
+
+  // Each depth's counts are for its own tree, the root counted once and
+  // everything below it being that depth's nodes
+  for (size_t i = 0; i < perDepth.size(); ++i) {
+    const auto &nodesPerPly = perDepth[i].nodesPerPly;
+    ASSERT_EQ(nodesPerPly.size(), i + 2);
+    EXPECT_EQ(nodesPerPly[0], 1);
+    EXPECT_EQ(nodesPerPly[1], 20);
+    size_t belowRoot = 0;
+    for (size_t ply = 1; ply < nodesPerPly.size(); ++ply) {
+      belowRoot += nodesPerPly[ply];
+    }
+    const size_t previousNodes = i ? perDepth[i - 1].nodes : 0;
+    EXPECT_EQ(belowRoot, perDepth[i].nodes - previousNodes);
+  }
+  EXPECT_EQ(stats.nodesPerPly, perDepth.back().nodesPerPly);
+
+  // Twenty moves at the start, and at most twenty replies to each
+  EXPECT_DOUBLE_EQ(stats.getBranchingFactor(0), 20);
+  EXPECT_GT(stats.getBranchingFactor(1), 1);
+  EXPECT_LE(stats.getBranchingFactor(1), 20);
+  EXPECT_DOUBLE_EQ(stats.getBranchingFactor(1),
+                   static_cast<double>(stats.nodesPerPly[2]) /
+                       stats.nodesPerPly[1]);
+  EXPECT_EQ(stats.getBranchingFactor(3), 0);
+
+  // Finished, so it stays put
+  EXPECT_EQ(computer.getStats().elapsed, stats.elapsed);
+}
+
+TEST_F(TestBoard, Trace) {
+  std::remove(k_testTraceFilepath.c_str());
+
+#ifdef CHESS_TRACE
+  {
+    TRACE_SCOPE("outer");
+    { TRACE_SCOPE("inner"); }
+  }
+  std::thread([]() { TRACE_SCOPE("other thread"); }).join();
+  m_board->loadGame();
+  m_board->refreshValidMoves();
+
+  ASSERT_TRUE(writeTrace(k_testTraceFilepath));
+  std::ifstream file(k_testTraceFilepath);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  const std::string trace = contents.str();
+
+  EXPECT_EQ(trace.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0),
+            0);
+  EXPECT_NE(trace.find("{\"name\":\"inner\",\"ph\":\"X\""),
+            std::string::npos);
+  EXPECT_NE(trace.find("{\"name\":\"outer\",\"ph\":\"X\""),
+            std::string::npos);
+  EXPECT_NE(trace.find("\"name\":\"Board::refreshValidMoves\""),
+            std::string::npos);
+
+  // Its own buffer, so its own track
+  const size_t other = trace.find("\"name\":\"other thread\"");
+  const size_t outer = trace.find("\"name\":\"outer\"");
+  ASSERT_NE(other, std::string::npos);
+  EXPECT_NE(trace.substr(trace.find("\"tid\":", other), 10),
+            trace.substr(trace.find("\"tid\":", outer), 10));
+  EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+
+  // Written while another thread keeps wrapping its buffer around, spans
+  // come out whole or not at all
+  std::atomic<bool> isDone = false;
+  std::thread busy([&isDone]() {
+    for (int64_t i = 0; !isDone; ++i) {
+      recordTraceSpan("busy", i * 1000, i * 1000 + 1000);
+    }
+  });
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_TRUE(writeTrace(k_testTraceFilepath));
+  }
+  isDone = true;
+  busy.join();
+
+  std::ifstream busyFile(k_testTraceFilepath);
+  std::string line;
+  while (std::getline(busyFile, line)) {
+    if (line.find("\"name\":\"busy\"") != std::string::npos) {
+      EXPECT_NE(line.find("\"dur\":1.000}"), std::string::npos) << line;
+    }
+  }
+#else
+  // Compiled out, so there's nothing to write
+  TRACE_SCOPE("outer");
+  EXPECT_FALSE(writeTrace(k_testTraceFilepath));
+#endif
+
+  std::remove(k_testTraceFilepath.c_str());
+}
+
+TEST_F(TestBoard, LatencyHistogram) {
+  using std::chrono::microseconds;
+  using std::chrono::milliseconds;
+  using std::chrono::nanoseconds;
+
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.getCount(), 0);
+  EXPECT_EQ(histogram.getPercentile(50), nanoseconds(0));
+
+  // 98 fast frames and two slow ones
+  for (int i = 0; i < 98; ++i) {
+    histogram.record(milliseconds(16));
+  }
+  histogram.record(milliseconds(40));
+  histogram.record(milliseconds(250));
+
+  EXPECT_EQ(histogram.getCount(), 100);
+  EXPECT_EQ(histogram.getMax(), milliseconds(250));
+
+  // Within a bucket's width, about 3%, and never over
+  const auto p50 = histogram.getPercentile(50);
+  EXPECT_GE(p50, milliseconds(16));
+  EXPECT_LE(p50, microseconds(16500));
+  const auto p99 = histogram.getPercentile(99);
+  EXPECT_GE(p99, milliseconds(40));
+  EXPECT_LE(p99, microseconds(41250));
+  EXPECT_EQ(histogram.getPercentile(100), milliseconds(250));
+
+  // Small values are exact, and nothing goes below 0
+  histogram.reset();
+  histogram.record(nanoseconds(7));
+  histogram.record(nanoseconds(-5));
+  EXPECT_EQ(histogram.getCount(), 2);
+  EXPECT_EQ(histogram.getPercentile(50), nanoseconds(0));
+  EXPECT_EQ(histogram.getPercentile(100), nanoseconds(7));
+
+  // The largest values still get a bucket
+  histogram.record(nanoseconds(INT64_MAX));
+  EXPECT_EQ(histogram.getPercentile(100), nanoseconds(INT64_MAX));
+}
+
+TEST_F(TestBoard, PrincipalVariation) {
+  LumpedBoardAndGameState state;
+  ASSERT_TRUE(readFen("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11", state));
+  m_board->loadFromState(state);
+
+  AI computer(*m_board);
+  computer.setColor(Color::white);
+  SearchLimits limits;
+  limits.depth = 4;
+  limits.multiPv = 2;
+  SearchInfo last;
+  const auto move = computer.search(
+      Color::white, limits, [&last](const SearchInfo &info) { last = info; });
+  ASSERT_TRUE(move.has_value());
+  ASSERT_EQ(last.depth, 4);
+  ASSERT_EQ(last.lines.size(), 2);
+
+  // A move for every ply, starting with the best move and its expected reply
+  for (const auto &line : last.lines) {
+    ASSERT_EQ(line.pv.size(), 4);
+    EXPECT_EQ(line.pv[0], line.move);
+  }
+  EXPECT_EQ(last.lines[0].move, move.value());
+  EXPECT_EQ(last.lines[0].pv[1], computer.getPonderMove());
+
+  // The board is left as it was, and the line can actually be played
+  const auto pv = toUciPv(*m_board, last.lines[0].pv);
+  ASSERT_EQ(pv.size(), 4);
+  Color color = Color::white;
+  for (const auto &uci : pv) {
+    ASSERT_TRUE(playUciMove(*m_board, color, uci)) << uci;
+    color = getOtherColor(color);
+  }
+}
+
+TEST_F(TestBoard, Analyze) {
+  AI computer(*m_board);
+  SearchLimits limits;
+  limits.depth = 3;
+
+  LumpedBoardAndGameState state;
+  ASSERT_TRUE(readFen("6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1", state));
+  auto result = analyzePosition(*m_board, computer, state, limits);
+  EXPECT_EQ(result.bestMove, "a1a8");
+  EXPECT_EQ(result.san, "Ra8");
+  ASSERT_TRUE(result.mateMoves.has_value());
+  EXPECT_EQ(result.mateMoves.value(), 1);
+  EXPECT_GT(result.nodes, 0);
+
+  std::string out;
+  writeAnalysis(7, state, result, out);
+  EXPECT_EQ(out.rfind("{\"line\":7,\"fen\":\"6k1/5ppp/8/8/8/8/5PPP/R5K1 w - "
+                      "- 0 1\",\"bestmove\":\"a1a8\",\"san\":\"Ra8\",",
+                      0),
+            0);
+  EXPECT_NE(out.find("\"mate\":1,\"depth\":2,"), std::string::npos);
+  EXPECT_NE(out.find("\"pv\":[\"a1a8\"]}\n"), std::string::npos);
+  EXPECT_EQ(out.find("\"lines\""), std::string::npos);
+
+  // The best few moves, best first, from the same search
+  limits.multiPv = 3;
+  result = analyzePosition(*m_board, computer, state, limits);
+  EXPECT_EQ(result.bestMove, "a1a8");
+  ASSERT_EQ(result.lines.size(), 3);
+  EXPECT_EQ(result.lines[0].move, "a1a8");
+  EXPECT_EQ(result.lines[0].san, "Ra8");
+  EXPECT_EQ(result.lines[0].mateMoves, 1);
+  EXPECT_GE(result.lines[0].score, result.lines[1].score);
+  EXPECT_GE(result.lines[1].score, result.lines[2].score);
+  EXPECT_FALSE(result.lines[1].mateMoves.has_value());
+  out.clear();
+  writeAnalysis(7, state, result, out);
+  EXPECT_NE(out.find(",\"lines\":[{\"move\":\"a1a8\",\"san\":\"Ra8\","),
+            std::string::npos);
+  limits.multiPv = 1;
+
+  // Same computer, next position, and one with no moves at all
+  ASSERT_TRUE(readFen("7k/5Q2/6K1/8/8/8/8/8 b - - 0 1", state));
+  result = analyzePosition(*m_board, computer, state, limits);
+  EXPECT_TRUE(result.bestMove.empty());
+  out.clear();
+  writeAnalysis(8, state, result, out);
+  EXPECT_NE(out.find("\"bestmove\":null"), std::string::npos);
+  EXPECT_NE(out.find("\"pv\":[]"), std::string::npos);
+}
+
+TEST_F(TestBoard, Bench) {
+  // Stops mid-depth, which is still the same every time
+  SearchLimits limits;
+  limits.nodes = 300;
+
+  const auto results = runBenchSearches(limits, 1);
+  ASSERT_FALSE(results.empty());
+  for (const auto &result : results) {
+    EXPECT_GE(result.nodes, 300);
+    EXPECT_FALSE(result.bestMove.empty());
+  }
+
+  // However the positions get shared out between threads
+  const auto threaded = runBenchSearches(limits, 3);
+  ASSERT_EQ(threaded.size(), results.size());
+  for (size_t i = 0; i < results.size(); ++i) {
+    EXPECT_EQ(threaded[i].nodes, results[i].nodes);
+    EXPECT_EQ(threaded[i].bestMove, results[i].bestMove);
+  }
+
+  // Random moves repeat with the same seed
+  AI computer(*m_board);
+  computer.setColor(Color::white);
+  std::vector<std::pair<Position, Position>> moves;
+  for (int i = 0; i < 2; ++i) {
+    computer.setSeed(42);
+    for (int j = 0; j < 5; ++j) {
+      moves.push_back(computer.getRandomMove());
+    }
+  }
+  EXPECT_TRUE(std::equal(moves.begin(), moves.begin() + 5, moves.begin() + 5));
+}
+
+TEST_F(TestBoard, EngineServer) {
+  const std::string socketPath = "chessd_test.sock";
+  EngineServer server(2);
+  ASSERT_TRUE(server.listen(socketPath));
+  std::thread loop([&server]() { server.run(); });
+
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, socketPath.c_str());
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(connect(fd, reinterpret_cast<const sockaddr *>(&address),
+                    sizeof(address)),
+            0);
+
+  std::string received;
+  auto readLine = [&]() {
+    char buffer[256];
+    size_t end = received.find('\n');
+    while (end == std::string::npos) {
+      const ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+      if (count <= 0) {
+        return std::string();
+      }
+      received.append(buffer, count);
+      end = received.find('\n');
+    }
+    const std::string line = received.substr(0, end);
+    received.erase(0, end + 1);
+    return line;
+  };
+  auto request = [&](const std::string &line) {
+    const std::string toSend = line + "\n";
+    send(fd, toSend.data(), toSend.size(), 0);
+    return readLine();
+  };
+
+  // White mates in one along the back rank
+  EXPECT_EQ(request("{\"id\":1,\"op\":\"new\",\"fen\":\"6k1/5ppp/8/8/8/8/"
+                    "5PPP/R5K1 w - - 0 1\"}"),
+            "{\"id\":1,\"game\":1,\"fen\":\"6k1/5ppp/8/8/8/8/5PPP/R5K1 w - "
+            "- 0 1\"}");
+  const std::string result =
+      request("{\"id\":2,\"op\":\"search\",\"game\":1,\"depth\":3}");
+  EXPECT_EQ(result.rfind("{\"id\":2,\"game\":1,\"bestmove\":\"a1a8\"", 0), 0);
+  EXPECT_NE(result.find("\"mate\":1,"), std::string::npos);
+  EXPECT_NE(request("{\"op\":\"move\",\"game\":1,\"move\":\"a1a8\"}")
+                .find("\"status\":\"checkmate\""),
+            std::string::npos);
+  EXPECT_EQ(request("{\"op\":\"move\",\"game\":1,\"move\":\"a8a1\"}"),
+            "{\"game\":1,\"error\":\"illegal move\"}");
+  EXPECT_EQ(request("{\"op\":\"search\",\"game\":9}"),
+            "{\"error\":\"unknown game\"}");
+  EXPECT_EQ(request("not json"), "{\"error\":\"bad request\"}");
+
+  // A search with no end answers once it's cancelled
+  EXPECT_EQ(request("{\"op\":\"new\"}").rfind("{\"game\":2,", 0), 0);
+  EXPECT_EQ(request("{\"op\":\"search\",\"game\":2,\"depth\":64}"
+                    "\n{\"op\":\"move\",\"game\":2,\"move\":\"e2e4\"}"),
+            "{\"game\":2,\"error\":\"searching\"}");
+  EXPECT_EQ(request("{\"op\":\"cancel\",\"game\":2}"), "{\"game\":2}");
+  EXPECT_EQ(readLine().rfind("{\"game\":2,\"bestmove\":", 0), 0);
+
+  EXPECT_EQ(request("{\"op\":\"end\",\"game\":1}"), "{\"game\":1}");
+  EXPECT_EQ(request("{\"op\":\"end\",\"game\":1}"),
+            "{\"error\":\"unknown game\"}");
+
+  // A line that never ends gets the client dropped rather than buffered
+  const int flooder = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(connect(flooder, reinterpret_cast<const sockaddr *>(&address),
+                    sizeof(address)),
+            0);
+  const std::string flood(1 << 17, 'x');
+  send(flooder, flood.data(), flood.size(), MSG_NOSIGNAL);
+  char buffer[16];
+  EXPECT_LE(recv(flooder, buffer, sizeof(buffer), 0), 0);
+  close(flooder);
+
+  // Others carry on as before
+  EXPECT_EQ(request("{\"op\":\"end\",\"game\":2}"), "{\"game\":2}");
+
+  close(fd);
+  server.stop();
+  loop.join();
+}
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
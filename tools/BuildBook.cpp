@@ -0,0 +1,317 @@
+#include "CommandLine.h"
+#include "Fen.h"
+#include "OpeningBook.h"
+#include "Pgn.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Opening book builder
+//
+// Usage: build_book <games.pgn>... [--out <file>] [--depth <moves>]
+//                   [--min-games <n>] [--threads <n>] [--keys <file>]
+//
+// Streams every game out of the PGN files and replays the first --depth moves
+// of each across a pool of threads, counting wins, draws and losses for every
+// move played from every position. Moves played in at least --min-games games
+// are written out as a Polyglot book for --book, weighted by 2 * wins + draws
+// from the mover's point of view. --keys is the same as --book-keys in the
+// game, see inc/Zobrist.h
+
+namespace {
+
+const std::string k_defaultOutputFilename = "book.bin";
+constexpr int k_defaultDepth = 12;
+constexpr int k_defaultMinGames = 2;
+
+// Games are handed to the workers this many at a time
+constexpr size_t k_batchSize = 256;
+// Per worker, keeps the reader from running too far ahead
+constexpr size_t k_maxQueuedBatchesPerThread = 4;
+
+// Each shard has its own lock, so workers rarely wait on each other
+constexpr size_t k_numShards = 64;
+
+constexpr int k_progressInterval = 100000;
+
+// Options that are followed by a value
+const std::vector<std::string> k_valueOptions = {
+    "--out", "--depth", "--min-games", "--threads", "--keys"};
+
+struct MoveKey {
+  uint64_t key;
+  uint16_t move;
+
+  bool operator==(const MoveKey &other) const {
+    return key == other.key && move == other.move;
+  }
+};
+
+struct MoveKeyHash {
+  size_t operator()(const MoveKey &moveKey) const {
+    return moveKey.key ^ (moveKey.move * 0x9e3779b97f4a7c15);
+  }
+};
+
+// From the point of view of the side that played the move
+struct MoveStats {
+  uint32_t wins = 0;
+  uint32_t draws = 0;
+  uint32_t losses = 0;
+
+  inline uint32_t games() const { return wins + draws + losses; }
+  inline uint64_t weight() const { return 2 * uint64_t(wins) + draws; }
+};
+
+enum class Outcome { win, draw, loss };
+
+class ShardedStats {
+public:
+  void add(const MoveKey &moveKey, Outcome outcome) {
+    // The low bits pick the bucket inside the map, so use the high ones here
+    Shard &shard = m_shards[(moveKey.key >> 32) % k_numShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    MoveStats &stats = shard.moves[moveKey];
+    if (outcome == Outcome::win) {
+      ++stats.wins;
+    } else if (outcome == Outcome::draw) {
+      ++stats.draws;
+    } else {
+      ++stats.losses;
+    }
+  }
+
+  // Only once the workers are done
+  std::vector<BookEntry> getEntries(uint32_t minGames) const {
+    std::vector<std::pair<MoveKey, uint64_t>> weighted;
+    uint64_t maxWeight = 0;
+    for (const auto &shard : m_shards) {
+      for (const auto &[moveKey, stats] : shard.moves) {
+        if (stats.games() < minGames || stats.weight() == 0) {
+          continue;
+        }
+        weighted.emplace_back(moveKey, stats.weight());
+        maxWeight = std::max(maxWeight, stats.weight());
+      }
+    }
+
+    // Weights have to fit in 16 bits, but shouldn't round down to 0
+    std::vector<BookEntry> entries;
+    entries.reserve(weighted.size());
+    for (const auto &[moveKey, weight] : weighted) {
+      const uint64_t scaled =
+          (maxWeight > UINT16_MAX) ? weight * UINT16_MAX / maxWeight : weight;
+      entries.push_back({moveKey.key, moveKey.move,
+                         static_cast<uint16_t>(std::max<uint64_t>(scaled, 1)),
+                         0});
+    }
+    return entries;
+  }
+
+private:
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<MoveKey, MoveStats, MoveKeyHash> moves;
+  };
+
+  std::array<Shard, k_numShards> m_shards;
+};
+
+// Bounded queue of game batches between the reader and the workers
+class BatchQueue {
+public:
+  explicit BatchQueue(size_t maxBatches) : m_maxBatches(maxBatches) {}
+
+  void push(std::vector<PgnGame> &&batch) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_notFull.wait(lock, [this] { return m_batches.size() < m_maxBatches; });
+    m_batches.push_back(std::move(batch));
+    m_notEmpty.notify_one();
+  }
+
+  // Returns false once the queue is closed and empty
+  bool pop(std::vector<PgnGame> &batch) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_notEmpty.wait(lock, [this] { return !m_batches.empty() || m_closed; });
+    if (m_batches.empty()) {
+      return false;
+    }
+    batch = std::move(m_batches.front());
+    m_batches.pop_front();
+    m_notFull.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closed = true;
+    m_notEmpty.notify_all();
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_notEmpty;
+  std::condition_variable m_notFull;
+  std::deque<std::vector<PgnGame>> m_batches;
+  size_t m_maxBatches;
+  bool m_closed = false;
+};
+
+std::optional<Color> getWinner(std::string_view result, bool &isDraw) {
+  isDraw = (result == "1/2-1/2");
+  if (result == "1-0") {
+    return Color::white;
+  } else if (result == "0-1") {
+    return Color::black;
+  }
+  return std::nullopt;
+}
+
+// Replays up to maxPlies moves of game and records them, returns the number
+// of positions recorded
+size_t addGame(Board &board, const PgnGame &game, int maxPlies,
+               ShardedStats &stats) {
+  bool isDraw = false;
+  const auto winner = getWinner(game.result, isDraw);
+  // Unfinished games say nothing about the moves
+  if (!winner.has_value() && !isDraw) {
+    return 0;
+  }
+
+  LumpedBoardAndGameState start;
+  const std::string_view fen = game.getTag("FEN");
+  if (fen.empty()) {
+    board.loadGame();
+    board.refreshValidMoves();
+  } else if (readFen(fen, start)) {
+    board.loadFromState(start);
+  } else {
+    return 0;
+  }
+
+  Color color = start.whoseTurn;
+  const size_t numPlies = std::min<size_t>(game.moves.size(), maxPlies);
+  for (size_t ply = 0; ply < numPlies; ++ply) {
+    PieceType promotion;
+    const auto move = fromSan(board, color, game.moves[ply], promotion);
+    // Anything we can't follow ends the game here
+    if (!move.has_value()) {
+      return ply;
+    }
+
+    const uint64_t key = getZobristKey(board.getBoardAndGameState(color));
+    const Outcome outcome = isDraw              ? Outcome::draw
+                            : (winner == color) ? Outcome::win
+                                                : Outcome::loss;
+    stats.add({key, encodeBookMove(move.value(), promotion)}, outcome);
+
+    if (!board.applyMove(color, move->start, move->end, promotion)) {
+      return ply + 1;
+    }
+    color = getOtherColor(color);
+  }
+
+  return numPlies;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const auto inputFilenames = getInputFilenames(argc, argv, k_valueOptions);
+  if (inputFilenames.empty() || argumentPassed(argv, argv + argc, "-h")) {
+    std::cout << "Usage: build_book <games.pgn>... [--out <file>] "
+                 "[--depth <moves>] [--min-games <n>] [--threads <n>] "
+                 "[--keys <file>]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string outputFilename =
+      getArgumentValue(argv, argv + argc, "--out")
+          .value_or(k_defaultOutputFilename);
+  const int depth =
+      std::max(1, std::stoi(getArgumentValue(argv, argv + argc, "--depth")
+                                .value_or(std::to_string(k_defaultDepth))));
+  const int minGames = std::max(
+      1, std::stoi(getArgumentValue(argv, argv + argc, "--min-games")
+                       .value_or(std::to_string(k_defaultMinGames))));
+  const unsigned int defaultThreads =
+      std::max(1u, std::thread::hardware_concurrency());
+  const int numThreads =
+      std::max(1, std::stoi(getArgumentValue(argv, argv + argc, "--threads")
+                                .value_or(std::to_string(defaultThreads))));
+
+  if (auto keys = getArgumentValue(argv, argv + argc, "--keys")) {
+    if (!loadZobristKeys(keys.value())) {
+      return 1;
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  ShardedStats stats;
+  BatchQueue queue(k_maxQueuedBatchesPerThread * numThreads);
+  std::atomic<size_t> numGames = 0;
+  std::atomic<size_t> numPositions = 0;
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < numThreads; ++i) {
+    workers.emplace_back([&]() {
+      Board board;
+      std::vector<PgnGame> batch;
+      while (queue.pop(batch)) {
+        for (const auto &game : batch) {
+          numPositions += addGame(board, game, 2 * depth, stats);
+          if (++numGames % k_progressInterval == 0) {
+            std::cout << numGames << " games, " << numPositions
+                      << " positions" << std::endl;
+          }
+        }
+      }
+    });
+  }
+
+  // Games point into the mapped files, so they stay open until the end
+  std::vector<std::unique_ptr<PgnReader>> readers;
+  for (const auto &filename : inputFilenames) {
+    readers.push_back(std::make_unique<PgnReader>());
+    if (!readers.back()->open(filename)) {
+      continue;
+    }
+
+    std::vector<PgnGame> batch(k_batchSize);
+    size_t batchSize = 0;
+    while (readers.back()->nextGame(batch[batchSize])) {
+      if (++batchSize == k_batchSize) {
+        queue.push(std::move(batch));
+        batch.assign(k_batchSize, PgnGame());
+        batchSize = 0;
+      }
+    }
+    batch.resize(batchSize);
+    if (!batch.empty()) {
+      queue.push(std::move(batch));
+    }
+  }
+
+  queue.close();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  auto entries = stats.getEntries(minGames);
+  if (!writeOpeningBook(outputFilename, entries)) {
+    return 1;
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("Read %zu games (%zu positions), wrote %zu entries to %s in %.1f s\n",
+         numGames.load(), numPositions.load(), entries.size(),
+         outputFilename.c_str(), elapsed.count());
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include "CommandLine.h"
+#include "PositionDatabase.h"
+
+#include <chrono>
+
+// Position database builder
+//
+// Usage: build_posdb <games.pgn>... [--out <file>] [--memory <MB>]
+//                    [--depth <plies>] [--keys <file>]
+//
+// Replays every game in the PGN files and indexes the first --depth plies of
+// each by Zobrist key, for --posdb in the game. At most --memory MB of
+// positions are held at once, anything more is sorted into temporary runs next
+// to the output and merged at the end. The index refers to the PGN files by
+// their absolute paths, so it can be used from anywhere, but the files have to
+// stay where they are. --keys is the same as --book-keys in the game, see
+// inc/Zobrist.h
+
+namespace {
+
+const std::string k_defaultOutputFilename = "positions.db";
+constexpr size_t k_defaultMemoryMB = 256;
+constexpr int k_defaultDepth = 40;
+
+// Options that are followed by a value
+const std::vector<std::string> k_valueOptions = {"--out", "--memory",
+                                                 "--depth", "--keys"};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const auto inputFilenames = getInputFilenames(argc, argv, k_valueOptions);
+  if (inputFilenames.empty() || argumentPassed(argv, argv + argc, "-h")) {
+    std::cout << "Usage: build_posdb <games.pgn>... [--out <file>] "
+                 "[--memory <MB>] [--depth <plies>] [--keys <file>]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string outputFilename =
+      getArgumentValue(argv, argv + argc, "--out")
+          .value_or(k_defaultOutputFilename);
+  const size_t memoryMB = std::max(
+      1, std::stoi(getArgumentValue(argv, argv + argc, "--memory")
+                       .value_or(std::to_string(k_defaultMemoryMB))));
+  const int depth =
+      std::max(0, std::stoi(getArgumentValue(argv, argv + argc, "--depth")
+                                .value_or(std::to_string(k_defaultDepth))));
+
+  if (auto keys = getArgumentValue(argv, argv + argc, "--keys")) {
+    if (!loadZobristKeys(keys.value())) {
+      return 1;
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  PositionDatabaseBuilder builder(outputFilename, memoryMB << 20, depth);
+  for (const auto &filename : inputFilenames) {
+    if (!builder.addPgnFile(filename)) {
+      return 1;
+    }
+    std::cout << filename << ": " << builder.getNumGames() << " games so far"
+              << std::endl;
+  }
+
+  if (!builder.finish()) {
+    return 1;
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("Indexed %zu games (%zu positions) into %s in %.1f s\n",
+         builder.getNumGames(), builder.getNumPositions(),
+         outputFilename.c_str(), elapsed.count());
+
+  return 0;
+}
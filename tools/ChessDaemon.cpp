@@ -0,0 +1,88 @@
+#include "CommandLine.h"
+#include "EngineServer.h"
+
+#include <csignal>
+
+// Engine server for many games at once
+//
+// Usage: chessd [--socket <path>] [--workers <n>] [--tb <file>]
+//               [--book <file>] [--book-depth <moves>]
+//
+// Listens on a Unix domain socket and plays any number of games for the
+// clients that connect, one JSON request per line. See inc/EngineServer.h for
+// the protocol. Searches share --workers threads, one per core by default,
+// and every game shares the one tablebase and opening book. Runs until
+// interrupted
+
+namespace {
+
+const std::string k_defaultSocketPath = "/tmp/chessd.sock";
+
+// In moves
+constexpr size_t k_defaultBookDepth = 12;
+
+EngineServer *g_server = nullptr;
+
+void handleSignal(int) {
+  if (g_server) {
+    g_server->stop();
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argumentPassed(argv, argv + argc, "-h")) {
+    std::cout << "Usage: chessd [--socket <path>] [--workers <n>] "
+                 "[--tb <file>] [--book <file>] [--book-depth <moves>]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string socketPath = getArgumentValue(argv, argv + argc, "--socket")
+                                     .value_or(k_defaultSocketPath);
+  const unsigned int defaultWorkers =
+      std::max(1u, std::thread::hardware_concurrency());
+  const int numWorkers =
+      std::max(1, std::stoi(getArgumentValue(argv, argv + argc, "--workers")
+                                .value_or(std::to_string(defaultWorkers))));
+
+  Tablebase tablebase;
+  if (auto filename = getArgumentValue(argv, argv + argc, "--tb")) {
+    if (!tablebase.load(filename.value())) {
+      return 1;
+    }
+  }
+
+  OpeningBook book;
+  if (auto filename = getArgumentValue(argv, argv + argc, "--book")) {
+    if (!book.open(filename.value())) {
+      return 1;
+    }
+  }
+
+  EngineServer server(numWorkers);
+  if (tablebase.isLoaded()) {
+    server.setTablebase(&tablebase);
+  }
+  if (book.isOpen()) {
+    const size_t bookDepth =
+        std::stoul(getArgumentValue(argv, argv + argc, "--book-depth")
+                       .value_or(std::to_string(k_defaultBookDepth)));
+    server.setOpeningBook(&book, bookDepth);
+  }
+
+  if (!server.listen(socketPath)) {
+    return 1;
+  }
+
+  g_server = &server;
+  std::signal(SIGINT, handleSignal);
+  std::signal(SIGTERM, handleSignal);
+
+  std::cout << "Listening on " << socketPath << " with " << numWorkers
+            << " workers" << std::endl;
+  const int result = server.run();
+  g_server = nullptr;
+  return result;
+}
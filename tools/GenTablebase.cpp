@@ -0,0 +1,62 @@
+#include "CommandLine.h"
+#include "TablebaseGenerator.h"
+
+#include <chrono>
+
+// Endgame tablebase generator, see inc/TablebaseGenerator.h
+//
+// Usage: gen_tablebase [--out <file>] [--pieces <n>] [--threads <n>]
+//
+// Writes every table with up to --pieces pieces (3 or 4, kings included) into
+// a single file that the game loads with --tb <file>
+
+namespace {
+
+const std::string k_defaultOutputFilename = "chess.tb";
+
+const std::string k_usage =
+    "Usage: gen_tablebase [--out <file>] [--pieces <n>] [--threads <n>]";
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argumentPassed(argv, argv + argc, "-h") ||
+      argumentPassed(argv, argv + argc, "--help")) {
+    std::cout << k_usage << std::endl;
+    return 1;
+  }
+
+  const std::string outputFilename =
+      getArgumentValue(argv, argv + argc, "--out")
+          .value_or(k_defaultOutputFilename);
+  const unsigned int defaultThreads =
+      std::max(1u, std::thread::hardware_concurrency());
+  const auto pieces =
+      parseNumber(getArgumentValue(argv, argv + argc, "--pieces")
+                      .value_or(std::to_string(k_maxTablebasePieces)));
+  const auto threads =
+      parseNumber(getArgumentValue(argv, argv + argc, "--threads")
+                      .value_or(std::to_string(defaultThreads)));
+  if (!pieces.has_value() || !threads.has_value()) {
+    std::cout << k_usage << std::endl;
+    return 1;
+  }
+
+  const int maxPieces = static_cast<int>(
+      std::clamp<long long>(pieces.value(), 3, k_maxTablebasePieces));
+  const int numThreads = static_cast<int>(std::clamp<long long>(
+      threads.value(), 1, std::numeric_limits<int>::max()));
+
+  const auto start = std::chrono::steady_clock::now();
+
+  TablebaseGenerator generator(numThreads);
+  if (!generator.generateAll(maxPieces, outputFilename)) {
+    return 1;
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("Wrote %s in %.1f s\n", outputFilename.c_str(), elapsed.count());
+
+  return 0;
+}
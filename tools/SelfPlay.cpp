@@ -0,0 +1,586 @@
+#include "AI.h"
+#include "CommandLine.h"
+#include "Fen.h"
+#include "OpeningBook.h"
+#include "Pgn.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <mutex>
+
+// Engine vs engine match runner
+//
+// Usage: selfplay [--engine1 <spec>] [--engine2 <spec>] [--games <n>]
+//                 [--concurrency <n>] [--openings <file>] [--plies <n>]
+//                 [--pgn <file>] [--sprt <elo0>,<elo1>] [--alpha <a>]
+//                 [--beta <b>] [--resign <cp>,<plies>]
+//                 [--draw <cp>,<plies>,<move>] [--max-plies <n>]
+//                 [--tb <file>] [--seed <n>]
+//
+// Plays two configurations of the computer player against each other, a game
+// per thread. An engine spec is a comma separated list of name=<name>,
+// depth=<n>, nodes=<n>, movetime=<ms> and tc=<ms>+<increment ms>, e.g.
+// "name=deep,depth=4" or "tc=10000+100". Openings come from a FEN or EPD
+// file, one per line, or from --plies random moves out of a Polyglot book
+// (.bin). Each opening is played twice with colours reversed. Games are
+// written to --pgn, and with --sprt the match stops as soon as the sequential
+// probability ratio test accepts elo0 or elo1 for engine1 over engine2
+
+namespace {
+
+const std::string k_defaultPgnFilename = "selfplay.pgn";
+constexpr int k_defaultGames = 100;
+constexpr int k_defaultBookPlies = 8;
+constexpr int k_defaultMaxPlies = 400;
+constexpr int k_defaultDepth = 3;
+constexpr double k_defaultAlpha = 0.05;
+constexpr double k_defaultBeta = 0.05;
+
+// Resign once this many plies in a row agree someone is this far ahead
+constexpr int k_defaultResignScore = 1000;
+constexpr int k_defaultResignPlies = 6;
+
+// Draw once this many plies in a row are this close to level, past the move
+constexpr int k_defaultDrawScore = 10;
+constexpr int k_defaultDrawPlies = 12;
+constexpr int k_defaultDrawMove = 40;
+
+using Milliseconds = std::chrono::milliseconds;
+
+struct EngineConfig {
+  std::string name;
+  SearchLimits limits;
+
+  // Game clock, instead of limits.time
+  std::optional<Milliseconds> clock = std::nullopt;
+  Milliseconds increment = Milliseconds(0);
+};
+
+struct Adjudication {
+  int resignScore = k_defaultResignScore;
+  int resignPlies = k_defaultResignPlies;
+  int drawScore = k_defaultDrawScore;
+  int drawPlies = k_defaultDrawPlies;
+  int drawMove = k_defaultDrawMove;
+  int maxPlies = k_defaultMaxPlies;
+};
+
+struct GameResult {
+  std::optional<Color> winner = std::nullopt;
+  std::string termination = "";
+};
+
+// From engine1's point of view
+struct MatchResults {
+  size_t wins = 0;
+  size_t draws = 0;
+  size_t losses = 0;
+
+  inline size_t games() const { return wins + draws + losses; }
+  inline double score() const {
+    return (wins + draws / 2.0) / std::max<size_t>(games(), 1);
+  }
+};
+
+inline double getExpectedScore(double elo) {
+  return 1 / (1 + std::pow(10, -elo / 400));
+}
+
+inline double getElo(double score) {
+  score = std::clamp(score, 1e-6, 1 - 1e-6);
+  return -400 * std::log10(1 / score - 1);
+}
+
+// Log likelihood ratio of elo1 against elo0, using the normal approximation
+// to the trinomial (win/draw/loss) distribution that fishtest's GSPRT uses
+double getLlr(const MatchResults &results, double elo0, double elo1) {
+  const double n = results.games();
+  if (results.wins == 0 || results.losses == 0) {
+    // Like cutechess, wait for at least one of each before trusting the
+    // variance
+    return 0;
+  }
+
+  const double score = results.score();
+  const double variance = (results.wins * std::pow(1 - score, 2) +
+                           results.draws * std::pow(0.5 - score, 2) +
+                           results.losses * std::pow(score, 2)) /
+                          n;
+  const double score0 = getExpectedScore(elo0);
+  const double score1 = getExpectedScore(elo1);
+  return n * (score1 - score0) * (2 * score - score0 - score1) /
+         (2 * variance);
+}
+
+bool parseEngineConfig(const std::string &spec, EngineConfig &config) {
+  size_t start = 0;
+  while (start < spec.size()) {
+    size_t end = spec.find(',', start);
+    if (end == std::string::npos) {
+      end = spec.size();
+    }
+
+    const std::string option = spec.substr(start, end - start);
+    start = end + 1;
+
+    const size_t equals = option.find('=');
+    if (equals == std::string::npos) {
+      std::cout << "Error: expected key=value in " << option << std::endl;
+      return false;
+    }
+    const std::string key = option.substr(0, equals);
+    const std::string value = option.substr(equals + 1);
+
+    if (key == "name") {
+      config.name = value;
+    } else if (key == "depth") {
+      config.limits.depth = std::clamp(std::stoi(value), 1, k_maxSearchDepth);
+    } else if (key == "nodes") {
+      config.limits.nodes = std::max(std::stoul(value), 1ul);
+    } else if (key == "movetime") {
+      config.limits.time = Milliseconds(std::max(std::stoi(value), 1));
+    } else if (key == "tc") {
+      const size_t plus = value.find('+');
+      config.clock = Milliseconds(std::stoi(value.substr(0, plus)));
+      if (plus != std::string::npos) {
+        config.increment = Milliseconds(std::stoi(value.substr(plus + 1)));
+      }
+    } else {
+      std::cout << "Error: unknown engine option " << key << std::endl;
+      return false;
+    }
+  }
+
+  // Without anything else to go on, play like the GUI does
+  if (config.limits.depth == k_maxSearchDepth && !config.limits.nodes &&
+      !config.limits.time && !config.clock) {
+    config.limits.depth = k_defaultDepth;
+  }
+  return true;
+}
+
+// Pair of numbers like 0,5 or 900,6
+std::vector<double> parseNumbers(const std::string &value) {
+  std::vector<double> numbers;
+  size_t start = 0;
+  while (start <= value.size()) {
+    size_t end = value.find(',', start);
+    if (end == std::string::npos) {
+      end = value.size();
+    }
+    numbers.push_back(std::stod(value.substr(start, end - start)));
+    start = end + 1;
+  }
+  return numbers;
+}
+
+// Sets up the opening for a pair of games, returning the moves played from
+// the start position in SAN, or the FEN tag if it came from a FEN file
+bool setUpOpening(Board &board, const FenFile *fenFile,
+                  const OpeningBook *book, int bookPlies, size_t pair,
+                  uint32_t seed, std::vector<std::string> &moves,
+                  std::string &fen, Color &color) {
+  moves.clear();
+  fen.clear();
+  color = Color::white;
+
+  if (fenFile) {
+    // Blank or broken lines just move on to the next one
+    LumpedBoardAndGameState state;
+    for (size_t i = 0; i < fenFile->size(); ++i) {
+      const size_t line = (pair + i) % fenFile->size();
+      if (fenFile->getPosition(line, state)) {
+        board.loadFromState(state);
+        color = state.whoseTurn;
+        char buffer[k_maxFenLength];
+        writeFen(state, buffer, sizeof(buffer));
+        fen = buffer;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  board.loadGame();
+  board.refreshValidMoves();
+  if (!book) {
+    return true;
+  }
+
+  // Both games of a pair get the same walk through the book
+  std::mt19937 generator(seed + pair);
+  for (int ply = 0; ply < bookPlies; ++ply) {
+    const auto bookMove =
+        book->pickMove(board.getBoardAndGameState(color), false, generator);
+    if (!bookMove.has_value()) {
+      break;
+    }
+
+    const auto &validMoves = board.getAllValidMoves();
+    const auto move = std::find_if(
+        validMoves.begin(), validMoves.end(), [&](const FullMove &valid) {
+          return valid.color == color && valid.start == bookMove->start &&
+                 valid.end == bookMove->end;
+        });
+    if (move == validMoves.end()) {
+      break;
+    }
+
+    const FullMove fullMove = *move;
+    const std::string san =
+        playSanMove(board, fullMove, bookMove->promotion);
+    if (san.empty()) {
+      break;
+    }
+    moves.push_back(san);
+    color = getOtherColor(color);
+  }
+  return true;
+}
+
+// Plays one game from the position on board, engines[0] having white
+GameResult playGame(Board &board, std::array<AI *, 2> engines,
+                    std::array<const EngineConfig *, 2> configs,
+                    const Adjudication &adjudication, Color color,
+                    std::vector<std::string> &moves) {
+  std::array<std::optional<Milliseconds>, 2> clocks = {configs[0]->clock,
+                                                       configs[1]->clock};
+
+  // For spotting threefold repetition
+  std::vector<uint64_t> keys = {
+      getZobristKey(board.getBoardAndGameState(color))};
+
+  // Scores from white's point of view, nullopt when the search didn't finish
+  // a single depth
+  std::vector<std::optional<int>> scores;
+
+  auto allRecent = [&scores](int plies, auto predicate) {
+    if (scores.size() < static_cast<size_t>(plies)) {
+      return false;
+    }
+    return std::all_of(scores.end() - plies, scores.end(),
+                       [&](const std::optional<int> &score) {
+                         return score.has_value() && predicate(score.value());
+                       });
+  };
+
+  const size_t openingPlies = moves.size();
+  for (int ply = 0;; ++ply) {
+    if (ply >= adjudication.maxPlies) {
+      return {std::nullopt, "adjudication"};
+    }
+
+    const size_t side = (color == Color::white) ? 0 : 1;
+    AI &engine = *engines[side];
+    engine.setColor(color);
+
+    SearchLimits limits = configs[side]->limits;
+    if (clocks[side].has_value()) {
+      limits.time = getMoveTime(clocks[side].value(), configs[side]->increment,
+                                0);
+    }
+
+    std::optional<int> score;
+    const auto start = std::chrono::steady_clock::now();
+    const auto move =
+        engine.search(color, limits, [&score](const SearchInfo &info) {
+          score = info.score;
+        });
+    const auto elapsed = std::chrono::duration_cast<Milliseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    if (clocks[side].has_value()) {
+      *clocks[side] -= elapsed;
+      if (clocks[side]->count() < 0) {
+        return {getOtherColor(color), "time forfeit"};
+      }
+      *clocks[side] += configs[side]->increment;
+    }
+
+    // Games end after the move that ends them, so this shouldn't happen
+    if (!move.has_value()) {
+      return {std::nullopt, "normal"};
+    }
+
+    const auto &validMoves = board.getAllValidMoves();
+    const auto fullMove = std::find_if(
+        validMoves.begin(), validMoves.end(), [&](const FullMove &valid) {
+          return valid.color == color && valid.start == move->first &&
+                 valid.end == move->second;
+        });
+    const std::string san =
+        (fullMove == validMoves.end()) ? "" : playSanMove(board, *fullMove);
+    if (san.empty()) {
+      return {getOtherColor(color), "illegal move"};
+    }
+    moves.push_back(san);
+
+    if (score.has_value() && color == Color::black) {
+      score = -score.value();
+    }
+    scores.push_back(score);
+
+    const Color other = getOtherColor(color);
+    if (board.isKingCheckmated(other)) {
+      return {color, "normal"};
+    }
+    if (board.hasStalemateOccurred(other)) {
+      return {std::nullopt, "normal"};
+    }
+
+    keys.push_back(getZobristKey(board.getBoardAndGameState(other)));
+    if (std::count(keys.begin(), keys.end(), keys.back()) >= 3) {
+      return {std::nullopt, "normal"};
+    }
+
+    const int resign = adjudication.resignScore;
+    if (allRecent(adjudication.resignPlies,
+                  [resign](int value) { return value >= resign; })) {
+      return {Color::white, "adjudication"};
+    }
+    if (allRecent(adjudication.resignPlies,
+                  [resign](int value) { return value <= -resign; })) {
+      return {Color::black, "adjudication"};
+    }
+
+    const int draw = adjudication.drawScore;
+    const size_t moveNumber = (moves.size() - openingPlies) / 2 + 1;
+    if (moveNumber > static_cast<size_t>(adjudication.drawMove) &&
+        allRecent(adjudication.drawPlies,
+                  [draw](int value) { return std::abs(value) <= draw; })) {
+      return {std::nullopt, "adjudication"};
+    }
+
+    color = other;
+  }
+}
+
+std::string getDate() {
+  const std::time_t now = std::time(nullptr);
+  std::tm local;
+  localtime_r(&now, &local);
+
+  char buffer[16];
+  std::strftime(buffer, sizeof(buffer), "%Y.%m.%d", &local);
+  return buffer;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argumentPassed(argv, argv + argc, "-h")) {
+    std::cout << "Usage: selfplay [--engine1 <spec>] [--engine2 <spec>] "
+                 "[--games <n>] [--concurrency <n>] [--openings <file>] "
+                 "[--plies <n>] [--pgn <file>] [--sprt <elo0>,<elo1>] "
+                 "[--alpha <a>] [--beta <b>] [--resign <cp>,<plies>] "
+                 "[--draw <cp>,<plies>,<move>] [--max-plies <n>] "
+                 "[--tb <file>] [--seed <n>]"
+              << std::endl;
+    return 1;
+  }
+
+  std::array<EngineConfig, 2> configs;
+  configs[0].name = "engine1";
+  configs[1].name = "engine2";
+  for (size_t i = 0; i < configs.size(); ++i) {
+    const auto spec = getArgumentValue(argv, argv + argc,
+                                       "--engine" + std::to_string(i + 1));
+    if (!parseEngineConfig(spec.value_or(""), configs[i])) {
+      return 1;
+    }
+  }
+
+  const int numGames =
+      std::max(1, std::stoi(getArgumentValue(argv, argv + argc, "--games")
+                                .value_or(std::to_string(k_defaultGames))));
+  const unsigned int defaultConcurrency =
+      std::max(1u, std::thread::hardware_concurrency());
+  const int concurrency = std::max(
+      1, std::stoi(getArgumentValue(argv, argv + argc, "--concurrency")
+                       .value_or(std::to_string(defaultConcurrency))));
+  const int bookPlies =
+      std::max(0, std::stoi(getArgumentValue(argv, argv + argc, "--plies")
+                                .value_or(std::to_string(k_defaultBookPlies))));
+  const uint32_t seed = std::stoul(
+      getArgumentValue(argv, argv + argc, "--seed")
+          .value_or(std::to_string(std::random_device()())));
+  const std::string pgnFilename = getArgumentValue(argv, argv + argc, "--pgn")
+                                      .value_or(k_defaultPgnFilename);
+
+  Adjudication adjudication;
+  if (auto resign = getArgumentValue(argv, argv + argc, "--resign")) {
+    const auto numbers = parseNumbers(resign.value());
+    adjudication.resignScore = numbers[0];
+    adjudication.resignPlies = numbers.size() > 1 ? numbers[1] : 1;
+  }
+  if (auto draw = getArgumentValue(argv, argv + argc, "--draw")) {
+    const auto numbers = parseNumbers(draw.value());
+    adjudication.drawScore = numbers[0];
+    adjudication.drawPlies = numbers.size() > 1 ? numbers[1] : 1;
+    adjudication.drawMove = numbers.size() > 2 ? numbers[2] : 0;
+  }
+  adjudication.maxPlies =
+      std::max(1, std::stoi(getArgumentValue(argv, argv + argc, "--max-plies")
+                                .value_or(std::to_string(k_defaultMaxPlies))));
+
+  std::optional<std::vector<double>> sprt;
+  if (auto bounds = getArgumentValue(argv, argv + argc, "--sprt")) {
+    sprt = parseNumbers(bounds.value());
+    if (sprt->size() != 2) {
+      std::cout << "Error: --sprt takes <elo0>,<elo1>" << std::endl;
+      return 1;
+    }
+  }
+  const double alpha = std::stod(getArgumentValue(argv, argv + argc, "--alpha")
+                                     .value_or(std::to_string(k_defaultAlpha)));
+  const double beta = std::stod(getArgumentValue(argv, argv + argc, "--beta")
+                                    .value_or(std::to_string(k_defaultBeta)));
+  const double lowerBound = std::log(beta / (1 - alpha));
+  const double upperBound = std::log((1 - beta) / alpha);
+
+  // Both engines probe the same tables
+  Tablebase tablebase;
+  const Tablebase *tablebasePointer = nullptr;
+  if (auto filename = getArgumentValue(argv, argv + argc, "--tb")) {
+    if (!tablebase.load(filename.value())) {
+      return 1;
+    }
+    tablebasePointer = &tablebase;
+  }
+
+  FenFile fenFile;
+  OpeningBook book;
+  const FenFile *fenFilePointer = nullptr;
+  const OpeningBook *bookPointer = nullptr;
+  if (auto openings = getArgumentValue(argv, argv + argc, "--openings")) {
+    const bool isBook = openings->size() > 4 &&
+                        openings->compare(openings->size() - 4, 4, ".bin") == 0;
+    if (isBook ? !book.open(openings.value())
+               : !fenFile.open(openings.value())) {
+      return 1;
+    }
+    if (isBook) {
+      bookPointer = &book;
+    } else {
+      fenFilePointer = &fenFile;
+    }
+  }
+
+  std::FILE *pgnFile = std::fopen(pgnFilename.c_str(), "wb");
+  if (!pgnFile) {
+    std::cout << "Error: could not open " << pgnFilename << " for writing"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string date = getDate();
+  const auto start = std::chrono::steady_clock::now();
+
+  MatchResults results;
+  std::atomic<int> next = 0;
+  std::atomic<bool> isFinished = false;
+  std::mutex resultsMutex;
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < concurrency; ++i) {
+    workers.emplace_back([&]() {
+      Board board;
+      std::array<AI, 2> engines = {AI(board), AI(board)};
+      for (auto &engine : engines) {
+        engine.setTablebase(tablebasePointer);
+      }
+
+      std::vector<std::string> moves;
+      std::string fen;
+      std::string pgn;
+
+      for (int game = next++; game < numGames && !isFinished;
+           game = next++) {
+        Color color;
+        if (!setUpOpening(board, fenFilePointer, bookPointer, bookPlies,
+                          game / 2, seed, moves, fen, color)) {
+          isFinished = true;
+          break;
+        }
+
+        // engine1 has white in even games
+        const size_t white = game % 2;
+        const size_t black = 1 - white;
+        const GameResult result = playGame(
+            board, {&engines[white], &engines[black]},
+            {&configs[white], &configs[black]}, adjudication, color, moves);
+
+        PgnGame record;
+        const std::string round = std::to_string(game + 1);
+        record.tags = {{"Event", "Self-play"},
+                       {"Date", date},
+                       {"Round", round},
+                       {"White", configs[white].name},
+                       {"Black", configs[black].name},
+                       {"Termination", result.termination}};
+        if (!fen.empty()) {
+          record.tags.push_back({"SetUp", "1"});
+          record.tags.push_back({"FEN", fen});
+        }
+        record.moves.assign(moves.begin(), moves.end());
+        record.result = !result.winner.has_value()         ? "1/2-1/2"
+                        : (result.winner == Color::white) ? "1-0"
+                                                          : "0-1";
+        pgn.clear();
+        writePgn(record, pgn);
+
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        std::fwrite(pgn.data(), 1, pgn.size(), pgnFile);
+
+        if (!result.winner.has_value()) {
+          ++results.draws;
+        } else if ((result.winner == Color::white) == (white == 0)) {
+          ++results.wins;
+        } else {
+          ++results.losses;
+        }
+
+        printf("Game %d: %s vs %s %s (%s) | %s: +%zu -%zu =%zu, Elo %.1f",
+               game + 1, configs[white].name.c_str(),
+               configs[black].name.c_str(), std::string(record.result).c_str(),
+               result.termination.c_str(), configs[0].name.c_str(),
+               results.wins, results.losses, results.draws,
+               getElo(results.score()));
+        if (sprt.has_value()) {
+          const double llr = getLlr(results, (*sprt)[0], (*sprt)[1]);
+          printf(", LLR %.2f (%.2f, %.2f)", llr, lowerBound, upperBound);
+          if (llr <= lowerBound || llr >= upperBound) {
+            isFinished = true;
+          }
+        }
+        printf("\n");
+        std::fflush(stdout);
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  std::fclose(pgnFile);
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("%s vs %s: +%zu -%zu =%zu in %zu games, score %.3f, Elo %.1f, "
+         "%.1f s\n",
+         configs[0].name.c_str(), configs[1].name.c_str(), results.wins,
+         results.losses, results.draws, results.games(), results.score(),
+         getElo(results.score()), elapsed.count());
+
+  if (sprt.has_value()) {
+    const double llr = getLlr(results, (*sprt)[0], (*sprt)[1]);
+    const char *verdict = (llr >= upperBound)   ? "H1 accepted"
+                          : (llr <= lowerBound) ? "H0 accepted"
+                                                : "inconclusive";
+    printf("SPRT elo0 %.1f elo1 %.1f: LLR %.2f, %s\n", (*sprt)[0], (*sprt)[1],
+           llr, verdict);
+  }
+
+  return 0;
+}
@@ -0,0 +1,457 @@
+#include "CommandLine.h"
+#include "EvalTables.h"
+#include "Fen.h"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+// Texel tuner for the piece values and piece-square tables in EvalTables.h
+//
+// Usage: tune_eval <corpus> [--out <header>] [--epochs <n>] [--threads <n>]
+//                           [--rate <r>] [--k <k>]
+//
+// The corpus holds one quiet position per line, as FEN or EPD, labelled with
+// the game result from white's point of view in any of the usual forms:
+//   <fen> [1.0]       <fen> [0.5]       <fen> [0.0]
+//   <epd> c9 "1-0";   <epd> c9 "1/2-1/2";
+//   <fen> 1-0         <fen> 1/2-1/2     <fen> 0-1
+//
+// Every position is flattened into a short list of (parameter, coefficient)
+// features once at load time, so evaluating a position during an epoch is a
+// dot product over a contiguous array with no allocation at all
+
+namespace {
+
+const std::string k_defaultOutputFilename = "EvalTables.h";
+constexpr int k_defaultEpochs = 100;
+constexpr double k_defaultLearningRate = 1.0;
+
+// Adam parameters
+constexpr double k_beta1 = 0.9;
+constexpr double k_beta2 = 0.999;
+constexpr double k_epsilon = 1e-8;
+
+// Search window for the sigmoid scaling constant
+constexpr double k_minK = 0.1;
+constexpr double k_maxK = 3.0;
+constexpr int k_kSearchIterations = 40;
+
+// The king's value is the same for both sides, so it always cancels out and
+// is left alone
+constexpr int k_numPieceValues = 5;
+constexpr int k_numTables = 7;
+constexpr int k_tableSize = k_totalSquares;
+constexpr int k_numParameters = k_numPieceValues + k_numTables * k_tableSize;
+
+constexpr int k_maxSquareIndex = 7;
+
+// Parameter layout: piece values first, then each table in turn
+enum ValueIndex { pawnValue, knightValue, bishopValue, rookValue, queenValue };
+enum TableIndex {
+  pawnTable,
+  knightTable,
+  bishopTable,
+  rookTable,
+  queenTable,
+  kingOpeningTable,
+  kingEndgameTable
+};
+
+const std::array<std::string, k_numTables> k_tableNames = {
+    "k_pawnEvalTable",  "k_knightEvalTable",      "k_bishopEvalTable",
+    "k_rookEvalTable",  "k_queenEvalTable",       "k_kingOpeningEvalTable",
+    "k_kingEndgameEvalTable"};
+
+const std::array<std::string, k_numPieceValues> k_valueNames = {
+    "k_pawnValue", "k_knightValue", "k_bishopValue", "k_rookValue",
+    "k_queenValue"};
+
+struct Feature {
+  uint16_t index;
+  int16_t coefficient;
+};
+
+// All positions live in one flat feature array. Position i owns the range
+// [offsets[i], offsets[i + 1])
+struct Corpus {
+  std::vector<Feature> features;
+  std::vector<uint32_t> offsets = {0};
+  std::vector<float> results;
+
+  inline size_t size() const { return results.size(); }
+};
+
+using Parameters = std::array<double, k_numParameters>;
+using Gradient = std::array<double, k_numParameters>;
+
+inline int tableParameter(TableIndex table, int row, int column) {
+  return k_numPieceValues + table * k_tableSize + row * 8 + column;
+}
+
+// Splits the result label off of the line, returns the result from white's
+// point of view
+std::optional<float> splitResult(std::string_view &line) {
+  // Board field can't contain any of the markers, so start after it
+  const size_t boardEnd = line.find(' ');
+  if (boardEnd == std::string_view::npos) {
+    return std::nullopt;
+  }
+
+  std::optional<float> result = std::nullopt;
+  size_t labelStart = std::string_view::npos;
+
+  if ((labelStart = line.find('[', boardEnd)) != std::string_view::npos) {
+    // The line isn't null-terminated, so copy the few characters needed
+    const std::string label(line.substr(labelStart + 1, 8));
+    result = std::strtof(label.c_str(), nullptr);
+  } else if ((labelStart = line.find("1/2-1/2", boardEnd)) !=
+             std::string_view::npos) {
+    result = 0.5f;
+  } else if ((labelStart = line.find("1-0", boardEnd)) !=
+             std::string_view::npos) {
+    result = 1.0f;
+  } else if ((labelStart = line.find("0-1", boardEnd)) !=
+             std::string_view::npos) {
+    result = 0.0f;
+  } else {
+    return std::nullopt;
+  }
+
+  // EPD opcodes also need to go
+  const size_t opcodeStart = line.find(" c9", boardEnd);
+  if (opcodeStart != std::string_view::npos && opcodeStart < labelStart) {
+    labelStart = opcodeStart;
+  }
+
+  line = line.substr(0, labelStart);
+  return result;
+}
+
+// Mirrors AI::getAdvantage, but records which parameters each piece touches
+// instead of summing them up
+void addFeatures(const LumpedBoardAndGameState &state, Corpus &corpus) {
+  std::array<int, k_numPieceValues> materialCount = {};
+
+  auto addContainer = [&](const PieceContainer &container, int valueIndex,
+                          TableIndex table) {
+    for (const auto &piece : container) {
+      const int sign = (piece.first == Color::white) ? 1 : -1;
+      const int column = piece.second.first;
+      const int row = (piece.first == Color::white)
+                          ? piece.second.second
+                          : k_maxSquareIndex - piece.second.second;
+
+      if (valueIndex >= 0) {
+        materialCount[valueIndex] += sign;
+      }
+
+      corpus.features.push_back(
+          {static_cast<uint16_t>(tableParameter(table, row, column)),
+           static_cast<int16_t>(sign)});
+    }
+  };
+
+  addContainer(state.pawns, pawnValue, pawnTable);
+  addContainer(state.knights, knightValue, knightTable);
+  addContainer(state.bishops, bishopValue, bishopTable);
+  addContainer(state.rooks, rookValue, rookTable);
+  addContainer(state.queens, queenValue, queenTable);
+  addContainer(state.kings, -1,
+               state.queens.empty() ? kingEndgameTable : kingOpeningTable);
+
+  for (int i = 0; i < k_numPieceValues; ++i) {
+    if (materialCount[i] != 0) {
+      corpus.features.push_back({static_cast<uint16_t>(i),
+                                 static_cast<int16_t>(materialCount[i])});
+    }
+  }
+}
+
+bool loadCorpus(const std::string &filename, Corpus &corpus) {
+  FenFile file;
+  if (!file.open(filename)) {
+    return false;
+  }
+
+  LumpedBoardAndGameState state;
+  size_t skipped = 0;
+
+  for (size_t i = 0; i < file.size(); ++i) {
+    std::string_view line = file.getLine(i);
+    const auto result = splitResult(line);
+    if (!result.has_value()) {
+      ++skipped;
+      continue;
+    }
+
+    if (!readFen(line, state) || state.kings.size() != 2) {
+      ++skipped;
+      continue;
+    }
+
+    addFeatures(state, corpus);
+    corpus.offsets.push_back(static_cast<uint32_t>(corpus.features.size()));
+    corpus.results.push_back(result.value());
+  }
+
+  std::cout << "Loaded " << corpus.size() << " positions (" << skipped
+            << " skipped)" << std::endl;
+
+  return corpus.size() > 0;
+}
+
+Parameters getCurrentParameters() {
+  Parameters parameters = {};
+  parameters[pawnValue] = k_pawnValue;
+  parameters[knightValue] = k_knightValue;
+  parameters[bishopValue] = k_bishopValue;
+  parameters[rookValue] = k_rookValue;
+  parameters[queenValue] = k_queenValue;
+
+  const std::array<const EvalTable *, k_numTables> tables = {
+      &k_pawnEvalTable,  &k_knightEvalTable,      &k_bishopEvalTable,
+      &k_rookEvalTable,  &k_queenEvalTable,       &k_kingOpeningEvalTable,
+      &k_kingEndgameEvalTable};
+
+  for (int table = 0; table < k_numTables; ++table) {
+    for (int row = 0; row < 8; ++row) {
+      for (int column = 0; column < 8; ++column) {
+        parameters[tableParameter(static_cast<TableIndex>(table), row,
+                                  column)] = (*tables[table])[row][column];
+      }
+    }
+  }
+
+  return parameters;
+}
+
+inline double sigmoid(double k, double eval) {
+  return 1.0 / (1.0 + std::pow(10.0, -k * eval / 400.0));
+}
+
+// Mean squared error of the corpus, split evenly across threads. If
+// gradients is non-null, each thread also accumulates its share of the
+// gradient into its own preallocated buffer
+double computeError(const Corpus &corpus, const Parameters &parameters,
+                    double k, int numThreads,
+                    std::vector<Gradient> *gradients) {
+  std::vector<double> errors(numThreads, 0.0);
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads);
+
+  const size_t chunk = (corpus.size() + numThreads - 1) / numThreads;
+  const double gradientScale = k * std::log(10.0) / 400.0;
+
+  for (int t = 0; t < numThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      const size_t begin = t * chunk;
+      const size_t end = std::min(corpus.size(), begin + chunk);
+      Gradient *gradient = gradients ? &(*gradients)[t] : nullptr;
+      double error = 0.0;
+
+      if (gradient) {
+        gradient->fill(0.0);
+      }
+
+      for (size_t i = begin; i < end; ++i) {
+        const Feature *first = corpus.features.data() + corpus.offsets[i];
+        const Feature *last = corpus.features.data() + corpus.offsets[i + 1];
+
+        double eval = 0.0;
+        for (const Feature *f = first; f != last; ++f) {
+          eval += parameters[f->index] * f->coefficient;
+        }
+
+        const double s = sigmoid(k, eval);
+        const double diff = s - corpus.results[i];
+        error += diff * diff;
+
+        if (gradient) {
+          const double g = 2.0 * diff * s * (1.0 - s) * gradientScale;
+          for (const Feature *f = first; f != last; ++f) {
+            (*gradient)[f->index] += g * f->coefficient;
+          }
+        }
+      }
+
+      errors[t] = error;
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  double error = 0.0;
+  for (const double e : errors) {
+    error += e;
+  }
+
+  return error / corpus.size();
+}
+
+// Golden section search for the scaling constant that best fits the current
+// evaluation to the results
+double findBestK(const Corpus &corpus, const Parameters &parameters,
+                 int numThreads) {
+  const double ratio = (std::sqrt(5.0) - 1.0) / 2.0;
+  double low = k_minK;
+  double high = k_maxK;
+
+  for (int i = 0; i < k_kSearchIterations; ++i) {
+    const double k1 = high - ratio * (high - low);
+    const double k2 = low + ratio * (high - low);
+    if (computeError(corpus, parameters, k1, numThreads, nullptr) <
+        computeError(corpus, parameters, k2, numThreads, nullptr)) {
+      high = k2;
+    } else {
+      low = k1;
+    }
+  }
+
+  return (low + high) / 2.0;
+}
+
+bool writeHeader(const std::string &filename, const Parameters &parameters,
+                 const std::string &corpusName, size_t corpusSize, double k,
+                 double error) {
+  std::ofstream ofs(filename);
+  if (!ofs.is_open()) {
+    std::cout << "Error: could not write " << filename << std::endl;
+    return false;
+  }
+
+  ofs << "#ifndef EVALTABLES_H\n"
+      << "#define EVALTABLES_H\n\n"
+      << "#include \"Defs.h\"\n\n"
+      << "// Piece values and piece-square tables used by AI::getAdvantage\n"
+      << "// Tables are laid out from white's point of view, with row 0 being "
+         "white's\n"
+      << "// back rank, and are flipped vertically for black\n"
+      << "// Generated by tune_eval from " << corpusName << " (" << corpusSize
+      << " positions, K = " << std::setprecision(4) << k
+      << ", error = " << std::setprecision(6) << error << ")\n\n";
+
+  for (int i = 0; i < k_numPieceValues; ++i) {
+    ofs << "constexpr int " << k_valueNames[i] << " = "
+        << std::lround(parameters[i]) << ";\n";
+  }
+  ofs << "constexpr int k_kingValue = " << k_kingValue << ";\n\n";
+
+  ofs << "// clang-format off\n\n"
+      << "using EvalTable = int[k_totalSquares / 8][k_totalSquares / 8];\n";
+
+  for (int table = 0; table < k_numTables; ++table) {
+    ofs << "\nconstexpr EvalTable " << k_tableNames[table] << " = {\n";
+    for (int row = 0; row < 8; ++row) {
+      ofs << "    {";
+      for (int column = 0; column < 8; ++column) {
+        const long value = std::lround(parameters[tableParameter(
+            static_cast<TableIndex>(table), row, column)]);
+        ofs << std::left << std::setw(column == 7 ? 0 : 5)
+            << (std::to_string(value) + (column == 7 ? "" : ","));
+      }
+      ofs << ((row == 7) ? "}\n" : "},\n");
+    }
+    ofs << "};\n";
+  }
+
+  ofs << "\n// clang-format on\n\n"
+      << "#endif // EVALTABLES_H\n";
+
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argumentPassed(argv, argv + argc, "-h")) {
+    std::cout << "Usage: tune_eval <corpus> [--out <header>] [--epochs <n>] "
+                 "[--threads <n>] [--rate <r>] [--k <k>]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string corpusName = argv[1];
+  const std::string outputFilename =
+      getArgumentValue(argv, argv + argc, "--out")
+          .value_or(k_defaultOutputFilename);
+  const int epochs = std::stoi(getArgumentValue(argv, argv + argc, "--epochs")
+                                   .value_or(std::to_string(k_defaultEpochs)));
+  const int numThreads = std::max(
+      1, std::stoi(getArgumentValue(argv, argv + argc, "--threads")
+                       .value_or(std::to_string(
+                           std::max(1u, std::thread::hardware_concurrency())))));
+  const double learningRate =
+      std::stod(getArgumentValue(argv, argv + argc, "--rate")
+                    .value_or(std::to_string(k_defaultLearningRate)));
+
+  Corpus corpus;
+  if (!loadCorpus(corpusName, corpus)) {
+    return 1;
+  }
+
+  Parameters parameters = getCurrentParameters();
+
+  double k = 0.0;
+  if (auto kArgument = getArgumentValue(argv, argv + argc, "--k")) {
+    k = std::stod(kArgument.value());
+  } else {
+    k = findBestK(corpus, parameters, numThreads);
+  }
+
+  std::cout << "K = " << k << ", starting error = "
+            << computeError(corpus, parameters, k, numThreads, nullptr)
+            << std::endl;
+
+  // Everything used inside the epoch loop is allocated up front
+  std::vector<Gradient> gradients(numThreads);
+  Parameters firstMoment = {};
+  Parameters secondMoment = {};
+  double error = 0.0;
+
+  for (int epoch = 1; epoch <= epochs; ++epoch) {
+    const auto epochStart = std::chrono::steady_clock::now();
+
+    error = computeError(corpus, parameters, k, numThreads, &gradients);
+
+    // Adam step
+    const double correction1 = 1.0 - std::pow(k_beta1, epoch);
+    const double correction2 = 1.0 - std::pow(k_beta2, epoch);
+    for (int i = 0; i < k_numParameters; ++i) {
+      double gradient = 0.0;
+      for (const auto &threadGradient : gradients) {
+        gradient += threadGradient[i];
+      }
+      gradient /= corpus.size();
+
+      firstMoment[i] = k_beta1 * firstMoment[i] + (1.0 - k_beta1) * gradient;
+      secondMoment[i] =
+          k_beta2 * secondMoment[i] + (1.0 - k_beta2) * gradient * gradient;
+
+      parameters[i] -= learningRate * (firstMoment[i] / correction1) /
+                       (std::sqrt(secondMoment[i] / correction2) + k_epsilon);
+    }
+
+    const std::chrono::duration<double> diff =
+        std::chrono::steady_clock::now() - epochStart;
+    std::cout << "Epoch " << epoch << ": error = " << std::setprecision(8)
+              << error << " (" << std::setprecision(3)
+              << corpus.size() / diff.count() / 1e6 << "M positions/s)"
+              << std::endl;
+  }
+
+  error = computeError(corpus, parameters, k, numThreads, nullptr);
+  if (!writeHeader(outputFilename, parameters, corpusName, corpus.size(), k,
+                   error)) {
+    return 1;
+  }
+
+  std::cout << "Final error = " << std::setprecision(8) << error
+            << ", tables written to "
+            << outputFilename << std::endl;
+
+  return 0;
+}